@@ -0,0 +1,283 @@
+//
+// Allan variance
+// Overlapping Allan deviation computed incrementally over the sample stream
+//
+// Copyright (c) 2023 Jonathan Tainer. Subject to the BSD 2-Clause License.
+//
+
+#include "allan.h"
+#include "frame.h"
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <math.h>
+
+const int allan_channels[ALLAN_CHANNELS] = { CH_ANG_X, CH_ANG_Y, CH_GYR_X, CH_GYR_Y, CH_GYR_Z };
+
+// The first two channels are angles, the rest are rates that get integrated
+#define ALLAN_FIRST_RATE 2
+
+// Gaps in the device timestamps longer than this are not sample periods
+#define ALLAN_MAX_PERIOD 1.0
+
+int allan_init(allan* a) {
+	memset(a, 0, sizeof(*a));
+	a->limit = ULONG_MAX;
+
+	// Cluster sizes spaced evenly on a log scale, without duplicates
+	for (int j = 0; j < ALLAN_MAX_POINTS; j++) {
+		int m = (int)lround(pow(2.0, (double)j / ALLAN_PER_OCTAVE));
+		if (m > ALLAN_MAX_M)
+			break;
+		if (a->points == 0 || m != a->m[a->points - 1])
+			a->m[a->points++] = m;
+	}
+
+	a->ring = calloc((size_t)ALLAN_RING * ALLAN_CHANNELS, sizeof(double));
+	return a->ring ? 0 : -1;
+}
+
+void allan_free(allan* a) {
+	free(a->ring);
+	a->ring = NULL;
+}
+
+void allan_push(allan* a, const sample_block* b) {
+	const unsigned long mask = ALLAN_RING - 1;
+	for (int i = 0; i < b->count; i++) {
+		if (a->n == 0)
+			a->first_time = b->time[i];
+		a->last_time = b->time[i];
+		if (b->has_raw[i])
+			a->seen_raw = true;
+
+		unsigned long n = a->n++;
+		double* now = a->ring + (n & mask) * ALLAN_CHANNELS;
+		for (int c = 0; c < ALLAN_CHANNELS; c++) {
+			float value = b->ch[allan_channels[c]][i];
+			if (c >= ALLAN_FIRST_RATE) {
+				a->integral[c] += value;
+				now[c] = a->integral[c];
+			}
+			else {
+				now[c] = value;
+			}
+		}
+
+		// Second difference theta[k + 2m] - 2 theta[k + m] + theta[k] for every
+		// cluster size whose window ends at this sample
+		for (int p = 0; p < a->points; p++) {
+			unsigned long m = a->m[p];
+			if (n < 2 * m)
+				break;
+			unsigned long k = n - 2 * m;
+			if (k >= a->limit)
+				continue;
+			const double* mid = a->ring + ((k + m) & mask) * ALLAN_CHANNELS;
+			const double* start = a->ring + (k & mask) * ALLAN_CHANNELS;
+			for (int c = 0; c < ALLAN_CHANNELS; c++) {
+				double d = now[c] - 2.0 * mid[c] + start[c];
+				a->sum[c][p] += d * d;
+			}
+			a->terms[p]++;
+		}
+	}
+}
+
+void allan_merge(allan* a, const allan* other) {
+	for (int p = 0; p < a->points; p++) {
+		for (int c = 0; c < ALLAN_CHANNELS; c++)
+			a->sum[c][p] += other->sum[c][p];
+		a->terms[p] += other->terms[p];
+	}
+	a->seen_raw |= other->seen_raw;
+}
+
+void allan_compute(const allan* a, double period, allan_curve* out) {
+	memset(out, 0, sizeof(*out));
+	if (period <= 0.0 && a->n > 1)
+		period = (a->last_time - a->first_time) / (double)(a->n - 1);
+	if (period <= 0.0)
+		return;
+
+	for (int p = 0; p < a->points; p++) {
+		// Too few terms give a meaningless estimate
+		if (a->terms[p] < 4)
+			break;
+		double m = a->m[p];
+		out->tau[out->points] = m * period;
+		for (int c = 0; c < ALLAN_CHANNELS; c++) {
+			double scale = (c >= ALLAN_FIRST_RATE) ? 1.0 : period * period;
+			double avar = a->sum[c][p] / (2.0 * m * m * scale * (double)a->terms[p]);
+			out->adev[c][out->points] = sqrt(avar);
+		}
+		out->points++;
+	}
+	for (int c = 0; c < ALLAN_CHANNELS; c++)
+		out->valid[c] = out->points > 0 && (c < ALLAN_FIRST_RATE || a->seen_raw);
+}
+
+int allan_live_init(allan_live* live) {
+	pthread_mutex_init(&live->lock, NULL);
+	return allan_init(&live->acc);
+}
+
+void allan_live_push(allan_live* live, const sample_block* b) {
+	pthread_mutex_lock(&live->lock);
+	if (live->acc.ring)
+		allan_push(&live->acc, b);
+	pthread_mutex_unlock(&live->lock);
+}
+
+void allan_live_curve(allan_live* live, allan_curve* out) {
+	pthread_mutex_lock(&live->lock);
+	allan_compute(&live->acc, 0.0, out);
+	pthread_mutex_unlock(&live->lock);
+}
+
+void allan_live_reset(allan_live* live) {
+	pthread_mutex_lock(&live->lock);
+	allan_free(&live->acc);
+	allan_init(&live->acc);
+	pthread_mutex_unlock(&live->lock);
+}
+
+typedef struct allan_job {
+	const char* path;
+	long start;
+	long end;
+	allan acc;
+	double period_sum;
+	unsigned long period_count;
+	int err;
+} allan_job;
+
+static void* allan_job_thread(void* arg) {
+	allan_job* job = arg;
+	FILE* f = fopen(job->path, "r");
+	if (!f) {
+		job->err = -1;
+		return NULL;
+	}
+
+	// Lines belong to the range they start in, skip the partial first line
+	long pos = job->start;
+	char* line = NULL;
+	size_t cap = 0;
+	ssize_t len = 0;
+	if (job->start > 0) {
+		fseek(f, job->start - 1, SEEK_SET);
+		len = getline(&line, &cap, f);
+		pos = job->start - 1 + (len > 0 ? len : 0);
+	}
+
+	sample_block block = { 0 };
+	bool have_ticks = false;
+	uint32_t last_ticks = 0;
+	while ((len = getline(&line, &cap, f)) > 0) {
+		// Past the end, keep reading only to complete the terms that start
+		// inside this range
+		if (pos >= job->end && job->acc.limit == ULONG_MAX)
+			job->acc.limit = job->acc.n + block.count;
+		if (job->acc.limit != ULONG_MAX && job->acc.n + block.count >= job->acc.limit + 2 * ALLAN_MAX_M)
+			break;
+		pos += len;
+
+		imu_frame frame;
+		if (frame_parse(line, &frame) != FRAME_OK)
+			continue;
+
+		if (frame.has_time) {
+			double dt = (uint32_t)(frame.ticks - last_ticks) / 1e6;
+			if (have_ticks && dt > 0.0 && dt < ALLAN_MAX_PERIOD && job->acc.limit == ULONG_MAX) {
+				job->period_sum += dt;
+				job->period_count++;
+			}
+			have_ticks = true;
+			last_ticks = frame.ticks;
+		}
+
+		imu_sample s = { 0 };
+		s.orientation = (Vector2) { (float)frame.ang_x, (float)frame.ang_y };
+		s.has_raw = frame.has_raw;
+		s.gyro = (Vector3) { frame.gyro[0], frame.gyro[1], frame.gyro[2] };
+		if (!sample_block_append(&block, &s)) {
+			allan_push(&job->acc, &block);
+			block.count = 0;
+			sample_block_append(&block, &s);
+		}
+	}
+	allan_push(&job->acc, &block);
+	free(line);
+	fclose(f);
+	return NULL;
+}
+
+int allan_analyze_file(const char* path, double rate, int threads, allan_curve* out) {
+	FILE* f = fopen(path, "r");
+	if (!f) {
+		perror(path);
+		return -1;
+	}
+	fseek(f, 0, SEEK_END);
+	long size = ftell(f);
+	fclose(f);
+
+	if (threads < 1)
+		threads = 1;
+	allan_job* jobs = calloc(threads, sizeof(allan_job));
+	pthread_t* handles = calloc(threads, sizeof(pthread_t));
+	int err = (jobs && handles) ? 0 : -1;
+
+	for (int t = 0; t < threads && err == 0; t++) {
+		jobs[t].path = path;
+		jobs[t].start = size * t / threads;
+		jobs[t].end = size * (t + 1) / threads;
+		err = allan_init(&jobs[t].acc);
+	}
+	for (int t = 0; t < threads && err == 0; t++)
+		pthread_create(&handles[t], NULL, allan_job_thread, &jobs[t]);
+
+	double period_sum = 0.0;
+	unsigned long period_count = 0;
+	for (int t = 0; t < threads && err == 0; t++) {
+		pthread_join(handles[t], NULL);
+		err = jobs[t].err;
+		period_sum += jobs[t].period_sum;
+		period_count += jobs[t].period_count;
+		if (t > 0)
+			allan_merge(&jobs[0].acc, &jobs[t].acc);
+	}
+
+	if (err == 0) {
+		double period = rate > 0.0 ? 1.0 / rate : (period_count ? period_sum / period_count : 0.0);
+		if (period > 0.0) {
+			allan_compute(&jobs[0].acc, period, out);
+		}
+		else {
+			printf("No sample rate given and no device timestamps in %s\n", path);
+			err = -1;
+		}
+	}
+
+	for (int t = 0; jobs && t < threads; t++)
+		allan_free(&jobs[t].acc);
+	free(jobs);
+	free(handles);
+	return err;
+}
+
+void allan_print(FILE* f, const allan_curve* c) {
+	fprintf(f, "%12s", "tau (s)");
+	for (int ch = 0; ch < ALLAN_CHANNELS; ch++)
+		if (c->valid[ch])
+			fprintf(f, " %12s", channel_names[allan_channels[ch]]);
+	fprintf(f, "\n");
+	for (int p = 0; p < c->points; p++) {
+		fprintf(f, "%12.6g", c->tau[p]);
+		for (int ch = 0; ch < ALLAN_CHANNELS; ch++)
+			if (c->valid[ch])
+				fprintf(f, " %12.6g", c->adev[ch][p]);
+		fprintf(f, "\n");
+	}
+}
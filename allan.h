@@ -0,0 +1,91 @@
+//
+// Allan variance
+// Overlapping Allan deviation computed incrementally over the sample stream
+//
+// Copyright (c) 2023 Jonathan Tainer. Subject to the BSD 2-Clause License.
+//
+
+#ifndef ALLAN_H
+#define ALLAN_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include "sample.h"
+
+// Cluster sizes m run from 1 to just under 2^ALLAN_OCTAVES samples with
+// ALLAN_PER_OCTAVE points per octave; memory is a ring of 2^(ALLAN_OCTAVES + 1)
+// values per channel regardless of how long the recording is
+#define ALLAN_OCTAVES 16
+#define ALLAN_PER_OCTAVE 2
+#define ALLAN_MAX_POINTS (ALLAN_OCTAVES * ALLAN_PER_OCTAVE + 1)
+#define ALLAN_RING (1 << (ALLAN_OCTAVES + 1))
+#define ALLAN_MAX_M (ALLAN_RING / 2 - 1)
+
+// Channels analyzed: the angles (already integrated) and the raw gyro rates
+#define ALLAN_CHANNELS 5
+extern const int allan_channels[ALLAN_CHANNELS];
+
+typedef struct allan_curve {
+	int points;
+	double tau[ALLAN_MAX_POINTS];			// Seconds
+	double adev[ALLAN_CHANNELS][ALLAN_MAX_POINTS];	// Rate units (deg/s)
+	bool valid[ALLAN_CHANNELS];
+} allan_curve;
+
+typedef struct allan {
+	int points;
+	int m[ALLAN_MAX_POINTS];
+
+	// Integrated signal, theta for the angles and the running sum of the
+	// rate for the gyro channels (the sample period cancels for those)
+	// Channels are interleaved so each lookup touches a single cache line
+	double* ring;
+	double integral[ALLAN_CHANNELS];
+	unsigned long n;
+
+	// Only terms starting before this sample index are accumulated, used to
+	// split a recording between threads without double counting
+	unsigned long limit;
+
+	double sum[ALLAN_CHANNELS][ALLAN_MAX_POINTS];
+	unsigned long terms[ALLAN_MAX_POINTS];
+	bool seen_raw;
+
+	// Sample period estimate from timestamps
+	double first_time;
+	double last_time;
+} allan;
+
+int allan_init(allan* a);
+void allan_free(allan* a);
+
+// Add samples, uniformly spaced in time
+void allan_push(allan* a, const sample_block* b);
+
+// Merge the sums of another accumulator (same cluster sizes)
+void allan_merge(allan* a, const allan* other);
+
+// Allan deviation at every cluster size with enough terms
+// period is the sample period in seconds, 0 to estimate it from the timestamps
+void allan_compute(const allan* a, double period, allan_curve* out);
+
+// Online analysis of the live stream, fed by the modem thread
+typedef struct allan_live {
+	pthread_mutex_t lock;
+	allan acc;
+} allan_live;
+
+int allan_live_init(allan_live* live);
+void allan_live_push(allan_live* live, const sample_block* b);
+void allan_live_curve(allan_live* live, allan_curve* out);
+void allan_live_reset(allan_live* live);
+
+// Analyze a recorded serial log (text frames) in parallel
+// The file is split into byte ranges processed by separate threads
+// rate is the sample rate in Hz, 0 to estimate it from the T fields
+int allan_analyze_file(const char* path, double rate, int threads, allan_curve* out);
+
+void allan_print(FILE* f, const allan_curve* c);
+
+#endif
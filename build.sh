@@ -1,2 +1,3 @@
-gcc -o demo main.c -lraylib -lGL -lm -lpthread -ldl -lrt -lX11
-
+gcc -O2 -o demo main.c clock_sync.c sample.c frame.c stream_stats.c overlay.c realtime.c serial_tune.c command.c link_control.c calibration.c allan.c spectrum.c filter.c resample.c capture.c channel_stats.c outlier.c device.c skeleton.c event.c swarm.c wireframe.c mesh_cache.c scene.c render_wake.c viewport.c video.c resolution.c ghost.c hud.c -lraylib -lGL -lm -lpthread -ldl -lrt -lX11
+gcc -O2 -o hud_test hud_test.c hud.c -lraylib -lGL -lm -lpthread -ldl -lrt -lX11
+gcc -O2 -o resample_test resample_test.c resample.c -lm
@@ -0,0 +1,573 @@
+//
+// Calibration
+// Sensor calibration solved in the background and applied to every sample
+//
+// Copyright (c) 2023 Jonathan Tainer. Subject to the BSD 2-Clause License.
+//
+
+#include "calibration.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <limits.h>
+#include <errno.h>
+#include <libgen.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define STANDARD_GRAVITY 9.80665
+
+void calibration_identity(calibration* c) {
+	memset(c, 0, sizeof(*c));
+	c->accel_scale = (Vector3) { 1.f, 1.f, 1.f };
+	for (int i = 0; i < 3; i++)
+		c->mag_soft[i][i] = 1.f;
+}
+
+void calibration_apply(const calibration* c, sample_block* b) {
+	const int n = b->count;
+
+	// Straight loops over the channel arrays so the compiler can vectorize them
+	float* ax = b->ch[CH_ANG_X];
+	float* ay = b->ch[CH_ANG_Y];
+	for (int i = 0; i < n; i++) {
+		ax[i] -= c->angle_offset.x;
+		ay[i] -= c->angle_offset.y;
+	}
+
+	// Raw channels hold zeros for samples without raw data, leave those alone
+	float mask[SAMPLE_BLOCK_LEN];
+	for (int i = 0; i < n; i++)
+		mask[i] = b->has_raw[i] ? 1.f : 0.f;
+
+	if (c->has_gyro) {
+		const float bias[3] = { c->gyro_bias.x, c->gyro_bias.y, c->gyro_bias.z };
+		for (int axis = 0; axis < 3; axis++) {
+			float* g = b->ch[CH_GYR_X + axis];
+			for (int i = 0; i < n; i++)
+				g[i] -= mask[i] * bias[axis];
+		}
+	}
+
+	if (c->has_accel) {
+		const float offset[3] = { c->accel_offset.x, c->accel_offset.y, c->accel_offset.z };
+		const float scale[3] = { c->accel_scale.x, c->accel_scale.y, c->accel_scale.z };
+		for (int axis = 0; axis < 3; axis++) {
+			float* a = b->ch[CH_ACC_X + axis];
+			for (int i = 0; i < n; i++)
+				a[i] = (a[i] - mask[i] * offset[axis]) * scale[axis];
+		}
+	}
+
+	if (c->has_mag) {
+		float* mx = b->ch[CH_MAG_X];
+		float* my = b->ch[CH_MAG_Y];
+		float* mz = b->ch[CH_MAG_Z];
+		const float ox = c->mag_offset.x, oy = c->mag_offset.y, oz = c->mag_offset.z;
+		const float (*w)[3] = c->mag_soft;
+		for (int i = 0; i < n; i++) {
+			float x = mx[i] - mask[i] * ox;
+			float y = my[i] - mask[i] * oy;
+			float z = mz[i] - mask[i] * oz;
+			mx[i] = w[0][0] * x + w[0][1] * y + w[0][2] * z;
+			my[i] = w[1][0] * x + w[1][1] * y + w[1][2] * z;
+			mz[i] = w[2][0] * x + w[2][1] * y + w[2][2] * z;
+		}
+	}
+}
+
+// The default path's directory and its parent may not exist yet, so
+// create both levels
+static void make_parents(const char* path) {
+	char copy[PATH_MAX];
+	char dir[PATH_MAX];
+	snprintf(copy, sizeof(copy), "%s", path);
+	snprintf(dir, sizeof(dir), "%s", dirname(copy));
+	mkdir(dirname(copy), 0755);
+	mkdir(dir, 0755);
+}
+
+int calibration_save(const calibration* c, const char* path) {
+	FILE* f = fopen(path, "w");
+	if (!f && errno == ENOENT) {
+		make_parents(path);
+		f = fopen(path, "w");
+	}
+	if (!f)
+		return -1;
+	fprintf(f, "angle_offset %.9g %.9g\n", c->angle_offset.x, c->angle_offset.y);
+	if (c->has_gyro)
+		fprintf(f, "gyro_bias %.9g %.9g %.9g\n", c->gyro_bias.x, c->gyro_bias.y, c->gyro_bias.z);
+	if (c->has_accel) {
+		fprintf(f, "accel_offset %.9g %.9g %.9g\n", c->accel_offset.x, c->accel_offset.y, c->accel_offset.z);
+		fprintf(f, "accel_scale %.9g %.9g %.9g\n", c->accel_scale.x, c->accel_scale.y, c->accel_scale.z);
+	}
+	if (c->has_mag) {
+		fprintf(f, "mag_offset %.9g %.9g %.9g\n", c->mag_offset.x, c->mag_offset.y, c->mag_offset.z);
+		fprintf(f, "mag_soft");
+		for (int i = 0; i < 9; i++)
+			fprintf(f, " %.9g", c->mag_soft[i / 3][i % 3]);
+		fprintf(f, "\n");
+	}
+	return fclose(f) == 0 ? 0 : -1;
+}
+
+int calibration_load(calibration* c, const char* path) {
+	FILE* f = fopen(path, "r");
+	if (!f)
+		return -1;
+	calibration_identity(c);
+
+	char line[512];
+	while (fgets(line, sizeof(line), f)) {
+		float* s = &c->mag_soft[0][0];
+		if (sscanf(line, "angle_offset %f %f", &c->angle_offset.x, &c->angle_offset.y) == 2)
+			continue;
+		if (sscanf(line, "gyro_bias %f %f %f", &c->gyro_bias.x, &c->gyro_bias.y, &c->gyro_bias.z) == 3)
+			c->has_gyro = true;
+		else if (sscanf(line, "accel_offset %f %f %f", &c->accel_offset.x, &c->accel_offset.y, &c->accel_offset.z) == 3)
+			c->has_accel = true;
+		else if (sscanf(line, "accel_scale %f %f %f", &c->accel_scale.x, &c->accel_scale.y, &c->accel_scale.z) == 3)
+			c->has_accel = true;
+		else if (sscanf(line, "mag_offset %f %f %f", &c->mag_offset.x, &c->mag_offset.y, &c->mag_offset.z) == 3)
+			c->has_mag = true;
+		else if (sscanf(line, "mag_soft %f %f %f %f %f %f %f %f %f",
+			&s[0], &s[1], &s[2], &s[3], &s[4], &s[5], &s[6], &s[7], &s[8]) == 9)
+			c->has_mag = true;
+	}
+	fclose(f);
+	return 0;
+}
+
+int calibration_default_path(const char* dev, char* out, size_t len) {
+	char real[PATH_MAX], sys[PATH_MAX + 64], dir[PATH_MAX];
+	if (!realpath(dev, real))
+		return -1;
+	const char* tty = basename(real);
+
+	// Walk up from the tty's device node looking for the USB serial number
+	char id[128] = { 0 };
+	snprintf(sys, sizeof(sys), "/sys/class/tty/%s/device", tty);
+	if (realpath(sys, dir)) {
+		for (int depth = 0; depth < 5 && id[0] == 0 && strlen(dir) > 1; depth++) {
+			snprintf(sys, sizeof(sys), "%s/serial", dir);
+			FILE* f = fopen(sys, "r");
+			if (f) {
+				if (fscanf(f, "%127s", id) != 1)
+					id[0] = 0;
+				fclose(f);
+			}
+			char* slash = strrchr(dir, '/');
+			if (!slash)
+				break;
+			*slash = 0;
+		}
+	}
+	if (id[0] == 0)
+		snprintf(id, sizeof(id), "%s", tty);
+
+	const char* config = getenv("XDG_CONFIG_HOME");
+	const char* home = getenv("HOME");
+	if (config && config[0])
+		snprintf(dir, sizeof(dir), "%s/imu-visualizer", config);
+	else if (home)
+		snprintf(dir, sizeof(dir), "%s/.config/imu-visualizer", home);
+	else
+		return -1;
+
+	// Created on the first save
+	snprintf(out, len, "%s/%s.cal", dir, id);
+	return 0;
+}
+
+// Solve the n x n system a x = b in place by Gaussian elimination with
+// partial pivoting, a is row-major. Returns -1 if singular
+static int solve_linear(double* a, double* b, int n) {
+	for (int col = 0; col < n; col++) {
+		int pivot = col;
+		for (int row = col + 1; row < n; row++)
+			if (fabs(a[row * n + col]) > fabs(a[pivot * n + col]))
+				pivot = row;
+		if (fabs(a[pivot * n + col]) < 1e-12)
+			return -1;
+		if (pivot != col) {
+			for (int k = 0; k < n; k++) {
+				double t = a[col * n + k];
+				a[col * n + k] = a[pivot * n + k];
+				a[pivot * n + k] = t;
+			}
+			double t = b[col];
+			b[col] = b[pivot];
+			b[pivot] = t;
+		}
+		for (int row = col + 1; row < n; row++) {
+			double f = a[row * n + col] / a[col * n + col];
+			for (int k = col; k < n; k++)
+				a[row * n + k] -= f * a[col * n + k];
+			b[row] -= f * b[col];
+		}
+	}
+	for (int row = n - 1; row >= 0; row--) {
+		double sum = b[row];
+		for (int k = row + 1; k < n; k++)
+			sum -= a[row * n + k] * b[k];
+		b[row] = sum / a[row * n + row];
+	}
+	return 0;
+}
+
+// Least squares fit of rows . p = 1, rows are n wide
+static int fit_unit_quadric(const double* rows, int count, int n, double* p) {
+	double ata[81] = { 0 };
+	for (int k = 0; k < n; k++)
+		p[k] = 0.0;
+	for (int r = 0; r < count; r++) {
+		const double* x = rows + r * n;
+		for (int i = 0; i < n; i++) {
+			p[i] += x[i];
+			for (int j = 0; j < n; j++)
+				ata[i * n + j] += x[i] * x[j];
+		}
+	}
+	return solve_linear(ata, p, n);
+}
+
+// Eigen decomposition of a symmetric 3x3 matrix by Jacobi rotations
+// a is destroyed, eigenvalues end up on its diagonal
+static void jacobi_eigen(double a[3][3], double v[3][3]) {
+	for (int i = 0; i < 3; i++)
+		for (int j = 0; j < 3; j++)
+			v[i][j] = (i == j) ? 1.0 : 0.0;
+
+	for (int sweep = 0; sweep < 50; sweep++) {
+		double off = fabs(a[0][1]) + fabs(a[0][2]) + fabs(a[1][2]);
+		if (off < 1e-15)
+			break;
+		for (int p = 0; p < 2; p++) {
+			for (int q = p + 1; q < 3; q++) {
+				if (fabs(a[p][q]) < 1e-18)
+					continue;
+				double theta = (a[q][q] - a[p][p]) / (2.0 * a[p][q]);
+				double t = (theta >= 0 ? 1.0 : -1.0) / (fabs(theta) + sqrt(theta * theta + 1.0));
+				double c = 1.0 / sqrt(t * t + 1.0);
+				double s = t * c;
+				for (int k = 0; k < 3; k++) {
+					double akp = a[k][p], akq = a[k][q];
+					a[k][p] = c * akp - s * akq;
+					a[k][q] = s * akp + c * akq;
+				}
+				for (int k = 0; k < 3; k++) {
+					double apk = a[p][k], aqk = a[q][k];
+					a[p][k] = c * apk - s * aqk;
+					a[q][k] = s * apk + c * aqk;
+				}
+				for (int k = 0; k < 3; k++) {
+					double vkp = v[k][p], vkq = v[k][q];
+					v[k][p] = c * vkp - s * vkq;
+					v[k][q] = s * vkp + c * vkq;
+				}
+			}
+		}
+	}
+}
+
+// Axis aligned ellipsoid through the rest poses, scaled so |accel| = g
+static bool solve_accel(const Vector3* poses, int count, calibration* c) {
+	double rows[CAL_MAX_POSES * 6];
+	double magnitude = 0.0;
+	for (int i = 0; i < count; i++) {
+		double x = poses[i].x, y = poses[i].y, z = poses[i].z;
+		double* r = rows + i * 6;
+		r[0] = x * x; r[1] = y * y; r[2] = z * z;
+		r[3] = x; r[4] = y; r[5] = z;
+		magnitude += sqrt(x * x + y * y + z * z) / count;
+	}
+	double p[6];
+	if (fit_unit_quadric(rows, count, 6, p) != 0 || p[0] <= 0 || p[1] <= 0 || p[2] <= 0)
+		return false;
+
+	// Firmware reports either g or m/s^2, keep whichever it uses
+	double g = fabs(magnitude - STANDARD_GRAVITY) < fabs(magnitude - 1.0) ? STANDARD_GRAVITY : 1.0;
+
+	double o[3], k = 1.0;
+	for (int axis = 0; axis < 3; axis++) {
+		o[axis] = -p[3 + axis] / (2.0 * p[axis]);
+		k += p[axis] * o[axis] * o[axis];
+	}
+	double s[3];
+	for (int axis = 0; axis < 3; axis++)
+		s[axis] = g * sqrt(p[axis] / k);
+
+	c->accel_offset = (Vector3) { (float)o[0], (float)o[1], (float)o[2] };
+	c->accel_scale = (Vector3) { (float)s[0], (float)s[1], (float)s[2] };
+	c->has_accel = true;
+	return true;
+}
+
+// General ellipsoid through the magnetometer samples: hard iron offset is its
+// center, soft iron correction maps it onto a sphere of the mean field radius
+static bool solve_mag(const Vector3* mag, int count, calibration* c) {
+	double* rows = malloc(sizeof(double) * 9 * count);
+	if (!rows)
+		return false;
+	for (int i = 0; i < count; i++) {
+		double x = mag[i].x, y = mag[i].y, z = mag[i].z;
+		double* r = rows + i * 9;
+		r[0] = x * x; r[1] = y * y; r[2] = z * z;
+		r[3] = 2 * x * y; r[4] = 2 * x * z; r[5] = 2 * y * z;
+		r[6] = 2 * x; r[7] = 2 * y; r[8] = 2 * z;
+	}
+	double p[9];
+	int err = fit_unit_quadric(rows, count, 9, p);
+	free(rows);
+	if (err != 0)
+		return false;
+
+	double m[3][3] = {
+		{ p[0], p[3], p[4] },
+		{ p[3], p[1], p[5] },
+		{ p[4], p[5], p[2] },
+	};
+	double center[3] = { -p[6], -p[7], -p[8] };
+	double minv[9] = { m[0][0], m[0][1], m[0][2], m[1][0], m[1][1], m[1][2], m[2][0], m[2][1], m[2][2] };
+	if (solve_linear(minv, center, 3) != 0)
+		return false;
+
+	// (x - c)' M (x - c) = 1 + c' M c
+	double k = 1.0;
+	for (int i = 0; i < 3; i++)
+		for (int j = 0; j < 3; j++)
+			k += center[i] * m[i][j] * center[j];
+	if (k <= 0.0)
+		return false;
+
+	double a[3][3], v[3][3];
+	for (int i = 0; i < 3; i++)
+		for (int j = 0; j < 3; j++)
+			a[i][j] = m[i][j] / k;
+	jacobi_eigen(a, v);
+	double e[3] = { a[0][0], a[1][1], a[2][2] };
+	if (e[0] <= 0.0 || e[1] <= 0.0 || e[2] <= 0.0)
+		return false;
+
+	// Geometric mean radius keeps the corrected field in firmware units
+	double radius = 1.0 / cbrt(sqrt(e[0] * e[1] * e[2]));
+	for (int i = 0; i < 3; i++) {
+		for (int j = 0; j < 3; j++) {
+			double w = 0.0;
+			for (int l = 0; l < 3; l++)
+				w += v[i][l] * sqrt(e[l]) * v[j][l];
+			c->mag_soft[i][j] = (float)(radius * w);
+		}
+	}
+	c->mag_offset = (Vector3) { (float)center[0], (float)center[1], (float)center[2] };
+	c->has_mag = true;
+	return true;
+}
+
+static void* calibrator_worker(void* arg) {
+	calibrator* cal = arg;
+	pthread_mutex_lock(&cal->lock);
+	while (!cal->quit) {
+		if (cal->save_requested && cal->state != CALIB_SOLVING) {
+			calibration c = cal->result;
+			cal->save_requested = false;
+			pthread_mutex_unlock(&cal->lock);
+			if (cal->path[0])
+				calibration_save(&c, cal->path);
+			pthread_mutex_lock(&cal->lock);
+			continue;
+		}
+		if (cal->state != CALIB_SOLVING) {
+			pthread_cond_wait(&cal->wake, &cal->lock);
+			continue;
+		}
+
+		// The modem thread doesn't touch the collected data while solving
+		calibration c = cal->result;
+		pthread_mutex_unlock(&cal->lock);
+
+		bool gyro = false, accel = false, mag = false;
+		if (cal->poses > 0) {
+			Vector3 bias = { 0 };
+			for (int i = 0; i < cal->poses; i++) {
+				bias.x += cal->pose_gyro[i].x / cal->poses;
+				bias.y += cal->pose_gyro[i].y / cal->poses;
+				bias.z += cal->pose_gyro[i].z / cal->poses;
+			}
+			c.gyro_bias = bias;
+			c.has_gyro = gyro = true;
+		}
+		if (cal->poses >= CAL_MIN_ACCEL_POSES)
+			accel = solve_accel(cal->pose_accel, cal->poses, &c);
+		if (cal->mag_count >= CAL_MIN_MAG)
+			mag = solve_mag(cal->mag, cal->mag_count, &c);
+
+		int saved = (gyro || accel || mag) && cal->path[0] ? calibration_save(&c, cal->path) : -1;
+
+		pthread_mutex_lock(&cal->lock);
+		if (gyro || accel || mag) {
+			// Keep a level done while solving
+			c.angle_offset = cal->result.angle_offset;
+			cal->result = c;
+			cal->version++;
+		}
+		snprintf(cal->status, sizeof(cal->status), "gyro %s, accel %s (%d poses), mag %s (%d samples)%s",
+			gyro ? "solved" : "-", accel ? "solved" : "-", cal->poses,
+			mag ? "solved" : "-", cal->mag_count, saved == 0 ? ", saved" : "");
+		cal->state = CALIB_IDLE;
+	}
+	pthread_mutex_unlock(&cal->lock);
+	return NULL;
+}
+
+void calibrator_init(calibrator* cal, const calibration* initial, const char* path) {
+	memset(cal, 0, sizeof(*cal));
+	pthread_mutex_init(&cal->lock, NULL);
+	pthread_cond_init(&cal->wake, NULL);
+	cal->result = *initial;
+	if (path)
+		snprintf(cal->path, sizeof(cal->path), "%s", path);
+	snprintf(cal->status, sizeof(cal->status), "idle");
+	pthread_create(&cal->worker, NULL, calibrator_worker, cal);
+}
+
+void calibrator_shutdown(calibrator* cal) {
+	pthread_mutex_lock(&cal->lock);
+	cal->quit = true;
+	pthread_cond_signal(&cal->wake);
+	pthread_mutex_unlock(&cal->lock);
+	pthread_join(cal->worker, NULL);
+}
+
+void calibrator_toggle(calibrator* cal) {
+	pthread_mutex_lock(&cal->lock);
+	if (cal->state == CALIB_IDLE) {
+		cal->state = CALIB_COLLECTING;
+		cal->poses = 0;
+		cal->mag_count = 0;
+		cal->pose_latched = false;
+		snprintf(cal->status, sizeof(cal->status), "collecting");
+	}
+	else if (cal->state == CALIB_COLLECTING) {
+		cal->state = CALIB_SOLVING;
+		snprintf(cal->status, sizeof(cal->status), "solving");
+		pthread_cond_signal(&cal->wake);
+	}
+	pthread_mutex_unlock(&cal->lock);
+}
+
+void calibrator_level(calibrator* cal) {
+	pthread_mutex_lock(&cal->lock);
+	cal->level_requested = true;
+	snprintf(cal->status, sizeof(cal->status), "hold still to level");
+	pthread_mutex_unlock(&cal->lock);
+}
+
+// Mean and standard deviation of one channel over the rest window
+static float window_stats(const calibrator* cal, int ch, float* stddev) {
+	float sum = 0.f, sq = 0.f;
+	for (int i = 0; i < CAL_STILL_WINDOW; i++) {
+		sum += cal->window[ch][i];
+		sq += cal->window[ch][i] * cal->window[ch][i];
+	}
+	float mean = sum / CAL_STILL_WINDOW;
+	*stddev = sqrtf(fmaxf(sq / CAL_STILL_WINDOW - mean * mean, 0.f));
+	return mean;
+}
+
+static bool window_still(const calibrator* cal, float mean[CH_COUNT]) {
+	float sd[CH_COUNT];
+	for (int ch = 0; ch < CH_COUNT; ch++)
+		mean[ch] = window_stats(cal, ch, &sd[ch]);
+
+	if (!cal->window_raw)
+		return sd[CH_ANG_X] < CAL_STILL_ANGLE && sd[CH_ANG_Y] < CAL_STILL_ANGLE;
+
+	// Accelerometer magnitude over the window
+	float sum = 0.f, sq = 0.f;
+	for (int i = 0; i < CAL_STILL_WINDOW; i++) {
+		float x = cal->window[CH_ACC_X][i], y = cal->window[CH_ACC_Y][i], z = cal->window[CH_ACC_Z][i];
+		float m = sqrtf(x * x + y * y + z * z);
+		sum += m;
+		sq += m * m;
+	}
+	float m_mean = sum / CAL_STILL_WINDOW;
+	float m_sd = sqrtf(fmaxf(sq / CAL_STILL_WINDOW - m_mean * m_mean, 0.f));
+	return sd[CH_GYR_X] < CAL_STILL_GYRO && sd[CH_GYR_Y] < CAL_STILL_GYRO && sd[CH_GYR_Z] < CAL_STILL_GYRO
+		&& m_mean > 0.f && m_sd / m_mean < CAL_STILL_ACCEL;
+}
+
+void calibrator_collect(calibrator* cal, const sample_block* b) {
+	// Held for the whole block so the worker never sees a half-written pose
+	pthread_mutex_lock(&cal->lock);
+	bool collecting = cal->state == CALIB_COLLECTING;
+	if (!collecting && !cal->level_requested) {
+		pthread_mutex_unlock(&cal->lock);
+		return;
+	}
+
+	for (int i = 0; i < b->count; i++) {
+		for (int ch = 0; ch < CH_COUNT; ch++)
+			cal->window[ch][cal->window_head] = b->ch[ch][i];
+		cal->window_head = (cal->window_head + 1) % CAL_STILL_WINDOW;
+		if (cal->window_len < CAL_STILL_WINDOW)
+			cal->window_len++;
+		cal->window_raw = b->has_raw[i];
+
+		// Keep magnetometer samples that moved noticeably since the last one kept
+		if (collecting && b->has_raw[i] && cal->mag_count < CAL_MAX_MAG) {
+			Vector3 m = { b->ch[CH_MAG_X][i], b->ch[CH_MAG_Y][i], b->ch[CH_MAG_Z][i] };
+			Vector3 last = cal->mag_count ? cal->mag[cal->mag_count - 1] : (Vector3) { 0 };
+			float dx = m.x - last.x, dy = m.y - last.y, dz = m.z - last.z;
+			float r = sqrtf(m.x * m.x + m.y * m.y + m.z * m.z);
+			if (dx * dx + dy * dy + dz * dz > 0.0004f * r * r)
+				cal->mag[cal->mag_count++] = m;
+		}
+
+		if (cal->window_len < CAL_STILL_WINDOW)
+			continue;
+		float mean[CH_COUNT];
+		if (!window_still(cal, mean)) {
+			cal->pose_latched = false;
+			continue;
+		}
+
+		if (cal->level_requested) {
+			cal->result.angle_offset = (Vector2) { mean[CH_ANG_X], mean[CH_ANG_Y] };
+			cal->version++;
+			cal->level_requested = false;
+			cal->save_requested = true;
+			pthread_cond_signal(&cal->wake);
+			snprintf(cal->status, sizeof(cal->status), "levelled at %.1f, %.1f", mean[CH_ANG_X], mean[CH_ANG_Y]);
+		}
+
+		// One pose per rest period
+		if (collecting && cal->window_raw && !cal->pose_latched && cal->poses < CAL_MAX_POSES) {
+			cal->pose_gyro[cal->poses] = (Vector3) { mean[CH_GYR_X], mean[CH_GYR_Y], mean[CH_GYR_Z] };
+			cal->pose_accel[cal->poses] = (Vector3) { mean[CH_ACC_X], mean[CH_ACC_Y], mean[CH_ACC_Z] };
+			cal->poses++;
+			cal->pose_latched = true;
+			snprintf(cal->status, sizeof(cal->status), "collecting: %d poses, %d mag samples", cal->poses, cal->mag_count);
+		}
+	}
+	pthread_mutex_unlock(&cal->lock);
+}
+
+bool calibrator_latest(calibrator* cal, calibration* out, unsigned int* version) {
+	pthread_mutex_lock(&cal->lock);
+	bool newer = cal->version != *version;
+	if (newer) {
+		*out = cal->result;
+		*version = cal->version;
+	}
+	pthread_mutex_unlock(&cal->lock);
+	return newer;
+}
+
+void calibrator_status(calibrator* cal, char* out, int len) {
+	pthread_mutex_lock(&cal->lock);
+	snprintf(out, len, "%s", cal->status);
+	pthread_mutex_unlock(&cal->lock);
+}
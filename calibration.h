@@ -0,0 +1,116 @@
+//
+// Calibration
+// Sensor calibration solved in the background and applied to every sample
+//
+// Copyright (c) 2023 Jonathan Tainer. Subject to the BSD 2-Clause License.
+//
+
+#ifndef CALIBRATION_H
+#define CALIBRATION_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <raylib.h>
+#include "sample.h"
+
+// Samples in the sliding window used to detect that the device is at rest
+#define CAL_STILL_WINDOW 50
+
+// Rest thresholds: standard deviation within the window
+#define CAL_STILL_GYRO 0.5f	// Per gyro axis, firmware units (deg/s)
+#define CAL_STILL_ACCEL 0.01f	// Accelerometer magnitude, relative
+#define CAL_STILL_ANGLE 0.3f	// Per angle channel without raw data, degrees
+
+#define CAL_MAX_POSES 64
+#define CAL_MIN_ACCEL_POSES 6
+#define CAL_MAX_MAG 4000
+#define CAL_MIN_MAG 100
+
+// Correction applied to each sample:
+//   angle' = angle - angle_offset
+//   gyro'  = gyro - gyro_bias
+//   accel' = accel_scale * (accel - accel_offset)	(per axis)
+//   mag'   = mag_soft * (mag - mag_offset)
+typedef struct calibration {
+	Vector2 angle_offset;
+	bool has_gyro;
+	Vector3 gyro_bias;
+	bool has_accel;
+	Vector3 accel_offset;
+	Vector3 accel_scale;
+	bool has_mag;
+	Vector3 mag_offset;
+	float mag_soft[3][3];
+} calibration;
+
+void calibration_identity(calibration* c);
+
+// Correct a block of samples in place
+void calibration_apply(const calibration* c, sample_block* b);
+
+// Creates the file's directory and its parent if they are missing
+int calibration_save(const calibration* c, const char* path);
+int calibration_load(calibration* c, const char* path);
+
+// Per-device file under $XDG_CONFIG_HOME/imu-visualizer, named after the USB
+// serial number of the adapter behind the tty (or the tty name without one)
+int calibration_default_path(const char* dev, char* out, size_t len);
+
+typedef enum calib_state {
+	CALIB_IDLE = 0,
+	CALIB_COLLECTING,
+	CALIB_SOLVING,
+} calib_state;
+
+// Collects rest poses and magnetometer samples from the live stream on the
+// modem thread and hands them to a worker thread that solves the fits, so
+// neither ingest nor rendering ever waits for the solver
+typedef struct calibrator {
+	pthread_mutex_t lock;
+	pthread_cond_t wake;
+	pthread_t worker;
+	bool quit;
+	calib_state state;
+	bool level_requested;
+	bool save_requested;
+
+	// Rest detection over the last CAL_STILL_WINDOW samples (modem thread)
+	float window[CH_COUNT][CAL_STILL_WINDOW];
+	int window_len;
+	int window_head;
+	bool window_raw;
+	bool pose_latched;
+
+	// Collected data
+	int poses;
+	Vector3 pose_gyro[CAL_MAX_POSES];
+	Vector3 pose_accel[CAL_MAX_POSES];
+	int mag_count;
+	Vector3 mag[CAL_MAX_MAG];
+
+	// Latest solution, picked up by the modem thread when version changes
+	calibration result;
+	unsigned int version;
+	char status[128];
+	char path[4096];
+} calibrator;
+
+void calibrator_init(calibrator* cal, const calibration* initial, const char* path);
+void calibrator_shutdown(calibrator* cal);
+
+// Start collecting, or stop and solve if already collecting
+void calibrator_toggle(calibrator* cal);
+
+// Zero the angles at the next rest period
+void calibrator_level(calibrator* cal);
+
+// Feed uncorrected samples (modem thread)
+void calibrator_collect(calibrator* cal, const sample_block* b);
+
+// Copy the latest solution if it is newer than *version
+bool calibrator_latest(calibrator* cal, calibration* out, unsigned int* version);
+
+void calibrator_status(calibrator* cal, char* out, int len);
+
+#endif
@@ -0,0 +1,346 @@
+//
+// Capture
+// Triggered recording of the samples around an event
+//
+// Copyright (c) 2023 Jonathan Tainer. Subject to the BSD 2-Clause License.
+//
+
+#include "capture.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+static int alloc_samples(unsigned long size, double** time, bool** has_raw, float** ch) {
+	*time = malloc(size * sizeof(double));
+	*has_raw = malloc(size * sizeof(bool));
+	bool ok = *time && *has_raw;
+	for (int c = 0; c < CH_COUNT; c++) {
+		ch[c] = malloc(size * sizeof(float));
+		ok = ok && ch[c];
+	}
+	return ok ? 0 : -1;
+}
+
+static void free_samples(double** time, bool** has_raw, float** ch) {
+	free(*time);
+	free(*has_raw);
+	*time = NULL;
+	*has_raw = NULL;
+	for (int c = 0; c < CH_COUNT; c++) {
+		free(ch[c]);
+		ch[c] = NULL;
+	}
+}
+
+int capture_init(capture* cap, const char* dir, double pre, double post) {
+	memset(cap, 0, sizeof(*cap));
+	pthread_mutex_init(&cap->lock, NULL);
+	pthread_cond_init(&cap->wake, NULL);
+	snprintf(cap->dir, sizeof(cap->dir), "%s", dir ? dir : ".");
+	cap->pre = pre;
+	cap->post = post;
+	if (!(pre >= 0.0 && post >= 0.0 && pre + post <= CAPTURE_MAX_SPAN))
+		return -1;
+
+	// The whole window, and a block arriving before the post window closes
+	const double samples = (pre + post) * CAPTURE_MAX_RATE + SAMPLE_BLOCK_LEN;
+	cap->size = 1;
+	while (cap->size < samples)
+		cap->size *= 2;
+	return 0;
+}
+
+// Called with the lock held, or before the modem thread starts
+static int alloc_buffers(capture* cap) {
+	int result = alloc_samples(cap->size, &cap->time, &cap->has_raw, cap->ch);
+	for (int j = 0; j < CAPTURE_QUEUE && result == 0; j++)
+		result = alloc_samples(cap->size, &cap->job[j].time, &cap->job[j].has_raw, cap->job[j].ch);
+	if (result != 0) {
+		// Left unallocated, so capture_push keeps skipping
+		free_samples(&cap->time, &cap->has_raw, cap->ch);
+		for (int j = 0; j < CAPTURE_QUEUE; j++)
+			free_samples(&cap->job[j].time, &cap->job[j].has_raw, cap->job[j].ch);
+	}
+	return result;
+}
+
+int capture_add_trigger(capture* cap, const char* spec) {
+	if (cap->triggers == CAPTURE_MAX_TRIGGERS)
+		return -1;
+	trigger t = { 0 };
+	snprintf(t.text, sizeof(t.text), "%s", spec);
+
+	const char* op = strpbrk(spec, "<>");
+	if (!op || op == spec)
+		return -1;
+	t.above = *op == '>';
+	char* end = NULL;
+	t.value = strtof(op + 1, &end);
+	if (end == op + 1 || *end != '\0')
+		return -1;
+
+	char name[16] = "";
+	int len = (int)(op - spec);
+	if (len >= (int)sizeof(name))
+		return -1;
+	memcpy(name, spec, len);
+
+	const char* channel = name;
+	if (strcmp(name, "tilt") == 0) {
+		t.kind = TRIGGER_TILT;
+		t.channel = CH_ANG_X;
+	}
+	else {
+		t.kind = TRIGGER_LEVEL;
+		if (name[0] == 'd') {
+			t.kind = TRIGGER_SLOPE;
+			channel++;
+		}
+		t.channel = -1;
+		for (int c = 0; c < CH_COUNT; c++) {
+			if (strcmp(channel, channel_names[c]) == 0)
+				t.channel = c;
+		}
+		if (t.channel < 0)
+			return -1;
+	}
+	cap->trigger[cap->triggers++] = t;
+	return 0;
+}
+
+// Write one event as CSV, time relative to the trigger
+static int capture_write(const capture_job* job, double pre, double post) {
+	FILE* f = fopen(job->path, "w");
+	if (!f)
+		return -1;
+	// The span held, which is short of the one asked for if the stream
+	// outran the ring or started after the window did
+	const double first = job->count > 0 ? job->trigger_time - job->time[0] : 0.0;
+	const double last = job->count > 0 ? job->time[job->count - 1] - job->trigger_time : 0.0;
+	fprintf(f, "# trigger %s at %.6f, pre %.3f s, post %.3f s (requested %.3f s, %.3f s)\n", job->reason,
+		job->trigger_time, first, last, pre, post);
+	fprintf(f, "t");
+	for (int c = 0; c < CH_COUNT; c++)
+		fprintf(f, ",%s", channel_names[c]);
+	fprintf(f, "\n");
+	for (int i = 0; i < job->count; i++) {
+		fprintf(f, "%.6f", job->time[i] - job->trigger_time);
+		int channels = job->has_raw[i] ? CH_COUNT : CH_GYR_X;
+		for (int c = 0; c < CH_COUNT; c++) {
+			if (c < channels)
+				fprintf(f, ",%g", job->ch[c][i]);
+			else
+				fprintf(f, ",");
+		}
+		fprintf(f, "\n");
+	}
+	return fclose(f);
+}
+
+static void* capture_writer(void* arg) {
+	capture* cap = arg;
+	pthread_mutex_lock(&cap->lock);
+	while (true) {
+		capture_job* job = NULL;
+		for (int j = 0; j < CAPTURE_QUEUE && !job; j++) {
+			if (cap->job[j].state == CAPTURE_READY)
+				job = &cap->job[j];
+		}
+		if (!job) {
+			if (cap->quit)
+				break;
+			pthread_cond_wait(&cap->wake, &cap->lock);
+			continue;
+		}
+
+		// The modem thread leaves slots alone until they are free again
+		job->state = CAPTURE_WRITING;
+		pthread_mutex_unlock(&cap->lock);
+		int result = capture_write(job, cap->pre, cap->post);
+		pthread_mutex_lock(&cap->lock);
+
+		if (result == 0) {
+			cap->written++;
+			snprintf(cap->last_file, sizeof(cap->last_file), "%s", job->path);
+		}
+		else
+			printf("Failed to write capture %s\n", job->path);
+		job->state = CAPTURE_FREE;
+	}
+	pthread_mutex_unlock(&cap->lock);
+	return NULL;
+}
+
+int capture_start(capture* cap) {
+	if (cap->triggers > 0 && alloc_buffers(cap) != 0)
+		return -1;
+	cap->running = pthread_create(&cap->writer, NULL, capture_writer, cap) == 0;
+	return 0;
+}
+
+// Copy the recorded window into a free slot for the writer
+// Called with the lock held
+static void capture_finish(capture* cap) {
+	cap->recording = false;
+	capture_job* job = NULL;
+	for (int j = 0; j < CAPTURE_QUEUE && !job; j++) {
+		if (cap->job[j].state == CAPTURE_FREE)
+			job = &cap->job[j];
+	}
+	if (!job) {
+		cap->dropped++;
+		return;
+	}
+
+	time_t now = time(NULL);
+	struct tm tm;
+	char stamp[32];
+	localtime_r(&now, &tm);
+	strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", &tm);
+	int length = snprintf(job->path, sizeof(job->path), "%s/capture-%s-%lu.csv", cap->dir, stamp, cap->events);
+	if (length < 0 || length >= (int)sizeof(job->path)) {
+		printf("Capture directory path too long, skipped capture %lu\n", cap->events);
+		return;
+	}
+
+	// Walk back to the start of the pre-trigger window, or as far as the
+	// ring still holds
+	unsigned long oldest = cap->count > cap->size ? cap->count - cap->size : 0;
+	unsigned long first = cap->count;
+	while (first > oldest && cap->time[(first - 1) & (cap->size - 1)] >= cap->trigger_time - cap->pre)
+		first--;
+
+	job->count = 0;
+	for (unsigned long n = first; n < cap->count; n++) {
+		unsigned long k = n & (cap->size - 1);
+		if (cap->time[k] > cap->trigger_time + cap->post)
+			break;
+		int i = job->count++;
+		job->time[i] = cap->time[k];
+		job->has_raw[i] = cap->has_raw[k];
+		for (int c = 0; c < CH_COUNT; c++)
+			job->ch[c][i] = cap->ch[c][k];
+	}
+	job->trigger_time = cap->trigger_time;
+	snprintf(job->reason, sizeof(job->reason), "%s", cap->reason);
+
+	job->state = CAPTURE_READY;
+	pthread_cond_signal(&cap->wake);
+}
+
+static void capture_fire(capture* cap, double time, const char* reason) {
+	if (cap->recording) {
+		cap->ignored++;
+		return;
+	}
+	cap->recording = true;
+	cap->trigger_time = time;
+	cap->events++;
+	snprintf(cap->reason, sizeof(cap->reason), "%s", reason);
+}
+
+static float trigger_value(const trigger* t, const sample_block* b, int i, const capture* cap) {
+	switch (t->kind) {
+	case TRIGGER_TILT:
+		return hypotf(b->ch[CH_ANG_X][i], b->ch[CH_ANG_Y][i]);
+	case TRIGGER_SLOPE: {
+		// Against the previous sample, which is in the ring or this block
+		float prev;
+		double prev_time;
+		if (i > 0) {
+			prev = b->ch[t->channel][i - 1];
+			prev_time = b->time[i - 1];
+		}
+		else if (cap->count > 0) {
+			prev = cap->ch[t->channel][(cap->count - 1) & (cap->size - 1)];
+			prev_time = cap->time[(cap->count - 1) & (cap->size - 1)];
+		}
+		else
+			return 0.f;
+		double dt = b->time[i] - prev_time;
+		return dt > 0.0 ? (float)((b->ch[t->channel][i] - prev) / dt) : 0.f;
+	}
+	default:
+		return b->ch[t->channel][i];
+	}
+}
+
+void capture_push(capture* cap, const sample_block* b) {
+	pthread_mutex_lock(&cap->lock);
+	// Until the first capture by hand when there are no triggers
+	if (!cap->time) {
+		pthread_mutex_unlock(&cap->lock);
+		return;
+	}
+	for (int i = 0; i < b->count; i++) {
+		if (cap->manual) {
+			cap->manual = false;
+			capture_fire(cap, b->time[i], "manual");
+		}
+		for (int j = 0; j < cap->triggers; j++) {
+			trigger* t = &cap->trigger[j];
+			if (t->channel >= CH_GYR_X && !b->has_raw[i])
+				continue;
+			float v = trigger_value(t, b, i, cap);
+			bool met = t->above ? v > t->value : v < t->value;
+			if (met && !t->active)
+				capture_fire(cap, b->time[i], t->text);
+			t->active = met;
+		}
+
+		unsigned long k = cap->count++ & (cap->size - 1);
+		cap->time[k] = b->time[i];
+		cap->has_raw[k] = b->has_raw[i];
+		for (int c = 0; c < CH_COUNT; c++)
+			cap->ch[c][k] = b->ch[c][i];
+
+		if (cap->recording && b->time[i] >= cap->trigger_time + cap->post)
+			capture_finish(cap);
+	}
+	pthread_mutex_unlock(&cap->lock);
+}
+
+void capture_trigger(capture* cap) {
+	pthread_mutex_lock(&cap->lock);
+	if (!cap->time && alloc_buffers(cap) != 0)
+		printf("Not enough memory for the capture buffers\n");
+	else
+		cap->manual = true;
+	pthread_mutex_unlock(&cap->lock);
+}
+
+void capture_shutdown(capture* cap) {
+	pthread_mutex_lock(&cap->lock);
+	if (cap->recording)
+		capture_finish(cap);
+	cap->quit = true;
+	pthread_cond_signal(&cap->wake);
+	pthread_mutex_unlock(&cap->lock);
+	if (cap->running)
+		pthread_join(cap->writer, NULL);
+	cap->running = false;
+}
+
+void capture_status(capture* cap, char* out, int len) {
+	pthread_mutex_lock(&cap->lock);
+	int pending = 0;
+	for (int j = 0; j < CAPTURE_QUEUE; j++)
+		pending += cap->job[j].state != CAPTURE_FREE;
+	if (cap->recording)
+		snprintf(out, len, "recording %s", cap->reason);
+	else if (pending > 0)
+		snprintf(out, len, "writing %d", pending);
+	else if (cap->written > 0)
+		snprintf(out, len, "armed, %lu written, last %s", cap->written, cap->last_file);
+	else
+		snprintf(out, len, "armed, %d triggers, %.1f s before and %.1f s after", cap->triggers, cap->pre, cap->post);
+	pthread_mutex_unlock(&cap->lock);
+}
+
+void capture_report(FILE* out, capture* cap) {
+	pthread_mutex_lock(&cap->lock);
+	fprintf(out, "Captures: %lu events, %lu written to %s, %lu dropped (writer busy), %lu triggers while recording\n",
+		cap->events, cap->written, cap->dir, cap->dropped, cap->ignored);
+	pthread_mutex_unlock(&cap->lock);
+}
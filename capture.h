@@ -0,0 +1,121 @@
+//
+// Capture
+// Triggered recording of the samples around an event
+//
+// Copyright (c) 2023 Jonathan Tainer. Subject to the BSD 2-Clause License.
+//
+
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include "sample.h"
+
+// The ring and each capture being written hold pre + post seconds at up
+// to this many samples per second
+#define CAPTURE_MAX_RATE 1000
+#define CAPTURE_MAX_SPAN 60.0	// Longest pre + post
+#define CAPTURE_QUEUE 4
+#define CAPTURE_MAX_TRIGGERS 8
+
+#define CAPTURE_DEFAULT_PRE 2.0
+#define CAPTURE_DEFAULT_POST 1.0
+
+typedef enum trigger_kind {
+	TRIGGER_LEVEL = 0,	// Channel value
+	TRIGGER_SLOPE,		// Channel rate of change per second
+	TRIGGER_TILT,		// Combined angle magnitude
+} trigger_kind;
+
+// Fires when the condition becomes true, then re-arms once it is false
+typedef struct trigger {
+	trigger_kind kind;
+	int channel;
+	bool above;
+	float value;
+	bool active;
+	char text[32];
+} trigger;
+
+typedef enum capture_slot_state {
+	CAPTURE_FREE = 0,
+	CAPTURE_READY,
+	CAPTURE_WRITING,
+} capture_slot_state;
+
+// Samples of one event, handed to the writer thread
+typedef struct capture_job {
+	capture_slot_state state;
+	int count;
+	double trigger_time;
+	char reason[64];
+	char path[4096];
+	double* time;
+	bool* has_raw;
+	float* ch[CH_COUNT];
+} capture_job;
+
+typedef struct capture {
+	pthread_mutex_t lock;
+	pthread_cond_t wake;
+	pthread_t writer;
+	bool running;
+	bool quit;
+
+	double pre;
+	double post;
+	char dir[4096];
+	int triggers;
+	trigger trigger[CAPTURE_MAX_TRIGGERS];
+
+	// Ring of the latest samples (modem thread), allocated with the jobs
+	// once there is a trigger or a capture by hand
+	unsigned long size;	// Power of two
+	double* time;
+	bool* has_raw;
+	float* ch[CH_COUNT];
+	unsigned long count;
+
+	// Event being recorded, finished once post seconds have passed
+	bool manual;
+	bool recording;
+	double trigger_time;
+	char reason[64];
+
+	// Buffers preallocated so the modem thread never allocates
+	capture_job job[CAPTURE_QUEUE];
+
+	unsigned long events;
+	unsigned long written;
+	unsigned long dropped;	// Queue full
+	unsigned long ignored;	// Triggered while recording
+	char last_file[4096];
+} capture;
+
+// Returns -1 if the window is negative or longer than CAPTURE_MAX_SPAN
+int capture_init(capture* cap, const char* dir, double pre, double post);
+
+// Add a trigger: <channel>>v, <channel><v, d<channel>>v (per second) or
+// tilt>v (degrees); returns -1 if invalid or there are too many
+int capture_add_trigger(capture* cap, const char* spec);
+
+// Allocate the buffers if there are triggers and start the writer thread;
+// returns -1 if the buffers can't be allocated
+int capture_start(capture* cap);
+
+// Finish the event being recorded and wait for the files to be written
+void capture_shutdown(capture* cap);
+
+// Evaluate triggers and record samples (modem thread)
+void capture_push(capture* cap, const sample_block* b);
+
+// Trigger at the next sample, e.g. from a keypress; without triggers the
+// first call allocates the buffers, so that capture has no window before
+void capture_trigger(capture* cap);
+
+void capture_status(capture* cap, char* out, int len);
+void capture_report(FILE* out, capture* cap);
+
+#endif
@@ -0,0 +1,214 @@
+//
+// Channel statistics
+// Running mean, deviation, extremes and quantiles of every channel
+//
+// Copyright (c) 2023 Jonathan Tainer. Subject to the BSD 2-Clause License.
+//
+
+#include "channel_stats.h"
+#include <string.h>
+#include <math.h>
+
+const char* chstats_window_names[CHSTATS_WINDOWS] = { "1 s", "10 s", "60 s", "session" };
+
+static const double window_length[CHSTATS_WINDOWS] = { 1.0, 10.0, 60.0, INFINITY };
+
+static void moments_add(moments* m, float x) {
+	if (m->n == 0)
+		m->min = m->max = x;
+	m->min = fminf(m->min, x);
+	m->max = fmaxf(m->max, x);
+	m->n++;
+	double d = x - m->mean;
+	m->mean += d / m->n;
+	m->m2 += d * (x - m->mean);
+}
+
+// Chan et al. pairwise combination
+static void moments_merge(moments* a, const moments* b) {
+	if (b->n == 0)
+		return;
+	if (a->n == 0) {
+		*a = *b;
+		return;
+	}
+	unsigned long n = a->n + b->n;
+	double d = b->mean - a->mean;
+	a->m2 += b->m2 + d * d * ((double)a->n * b->n / n);
+	a->mean += d * b->n / n;
+	a->min = fminf(a->min, b->min);
+	a->max = fmaxf(a->max, b->max);
+	a->n = n;
+}
+
+static void p2_init(p2_quantile* e, double p) {
+	memset(e, 0, sizeof(*e));
+	e->p = p;
+	const double step[5] = { 0.0, p / 2.0, p, (1.0 + p) / 2.0, 1.0 };
+	memcpy(e->step, step, sizeof(step));
+}
+
+static void p2_add(p2_quantile* e, double x) {
+	// Exact until five observations, which seed the markers
+	if (e->count < 5) {
+		int i = e->count++;
+		while (i > 0 && e->q[i - 1] > x) {
+			e->q[i] = e->q[i - 1];
+			i--;
+		}
+		e->q[i] = x;
+		if (e->count == 5) {
+			const double desired[5] = { 0.0, 2.0 * e->p, 4.0 * e->p, 2.0 + 2.0 * e->p, 4.0 };
+			memcpy(e->desired, desired, sizeof(desired));
+			for (int k = 0; k < 5; k++)
+				e->pos[k] = k;
+		}
+		return;
+	}
+	e->count++;
+
+	int k;
+	if (x < e->q[0]) {
+		e->q[0] = x;
+		k = 0;
+	}
+	else if (x >= e->q[4]) {
+		e->q[4] = x;
+		k = 3;
+	}
+	else {
+		for (k = 0; k < 3 && x >= e->q[k + 1]; k++)
+			;
+	}
+	for (int i = k + 1; i < 5; i++)
+		e->pos[i] += 1.0;
+	for (int i = 0; i < 5; i++)
+		e->desired[i] += e->step[i];
+
+	// Move the middle markers towards their desired positions, with a
+	// piecewise parabolic prediction or linearly if that would overshoot
+	for (int i = 1; i < 4; i++) {
+		double d = e->desired[i] - e->pos[i];
+		if ((d >= 1.0 && e->pos[i + 1] - e->pos[i] > 1.0) || (d <= -1.0 && e->pos[i - 1] - e->pos[i] < -1.0)) {
+			double s = d > 0.0 ? 1.0 : -1.0;
+			double np = e->pos[i + 1] - e->pos[i], nm = e->pos[i] - e->pos[i - 1];
+			double q = e->q[i] + s / (e->pos[i + 1] - e->pos[i - 1]) *
+				((nm + s) * (e->q[i + 1] - e->q[i]) / np + (np - s) * (e->q[i] - e->q[i - 1]) / nm);
+			if (e->q[i - 1] < q && q < e->q[i + 1])
+				e->q[i] = q;
+			else {
+				int j = i + (int)s;
+				e->q[i] += s * (e->q[j] - e->q[i]) / (e->pos[j] - e->pos[i]);
+			}
+			e->pos[i] += s;
+		}
+	}
+}
+
+static double p2_value(const p2_quantile* e) {
+	if (e->count == 0)
+		return NAN;
+	if (e->count < 5)
+		return e->q[(int)lround(e->p * (e->count - 1))];
+	return e->q[2];
+}
+
+static void channel_stats_clear(channel_stats* cs) {
+	memset(cs->bucket, 0, sizeof(cs->bucket));
+	memset(cs->session, 0, sizeof(cs->session));
+	memset(cs->has_last, 0, sizeof(cs->has_last));
+	cs->current = -1;
+	for (int w = 0; w < CHSTATS_WINDOWS; w++) {
+		cs->window_start[w] = 0.0;
+		for (int c = 0; c < CH_COUNT; c++) {
+			p2_init(&cs->p50[w][c], 0.5);
+			p2_init(&cs->p99[w][c], 0.99);
+		}
+	}
+}
+
+void channel_stats_init(channel_stats* cs) {
+	pthread_mutex_init(&cs->lock, NULL);
+	channel_stats_clear(cs);
+}
+
+void channel_stats_reset(channel_stats* cs) {
+	pthread_mutex_lock(&cs->lock);
+	channel_stats_clear(cs);
+	pthread_mutex_unlock(&cs->lock);
+}
+
+void channel_stats_push(channel_stats* cs, const sample_block* b) {
+	pthread_mutex_lock(&cs->lock);
+	for (int i = 0; i < b->count; i++) {
+		double t = b->time[i];
+
+		// Clear the buckets the clock moved past, or all of them after a
+		// jump backwards or longer than the history
+		long index = (long)floor(t / CHSTATS_BUCKET);
+		if (cs->current < 0 || index < cs->current || index - cs->current >= CHSTATS_BUCKETS)
+			memset(cs->bucket, 0, sizeof(cs->bucket));
+		else {
+			for (long k = cs->current + 1; k <= index; k++)
+				memset(cs->bucket[k % CHSTATS_BUCKETS], 0, sizeof(cs->bucket[0]));
+		}
+		cs->current = index;
+		moments* bucket = cs->bucket[index % CHSTATS_BUCKETS];
+
+		// Publish the quantiles of windows that just completed
+		for (int w = 0; w < CHSTATS_SESSION; w++) {
+			if (cs->window_start[w] == 0.0)
+				cs->window_start[w] = t;
+			if (t - cs->window_start[w] < window_length[w])
+				continue;
+			for (int c = 0; c < CH_COUNT; c++) {
+				cs->last_p50[w][c] = p2_value(&cs->p50[w][c]);
+				cs->last_p99[w][c] = p2_value(&cs->p99[w][c]);
+				p2_init(&cs->p50[w][c], 0.5);
+				p2_init(&cs->p99[w][c], 0.99);
+			}
+			cs->has_last[w] = true;
+			cs->window_start[w] = t;
+		}
+
+		int channels = b->has_raw[i] ? CH_COUNT : CH_GYR_X;
+		for (int c = 0; c < channels; c++) {
+			float x = b->ch[c][i];
+			moments_add(&bucket[c], x);
+			moments_add(&cs->session[c], x);
+			for (int w = 0; w < CHSTATS_WINDOWS; w++) {
+				p2_add(&cs->p50[w][c], x);
+				p2_add(&cs->p99[w][c], x);
+			}
+		}
+	}
+	pthread_mutex_unlock(&cs->lock);
+}
+
+void channel_stats_summary(channel_stats* cs, chstats_window w, chstats_summary out[CH_COUNT]) {
+	moments m[CH_COUNT] = { 0 };
+	pthread_mutex_lock(&cs->lock);
+	if (w == CHSTATS_SESSION)
+		memcpy(m, cs->session, sizeof(m));
+	else if (cs->current >= 0) {
+		long buckets = lround(window_length[w] / CHSTATS_BUCKET);
+		for (long k = cs->current - buckets + 1; k <= cs->current; k++) {
+			if (k < 0)
+				continue;
+			for (int c = 0; c < CH_COUNT; c++)
+				moments_merge(&m[c], &cs->bucket[k % CHSTATS_BUCKETS][c]);
+		}
+	}
+	for (int c = 0; c < CH_COUNT; c++) {
+		chstats_summary* s = &out[c];
+		s->n = m[c].n;
+		s->mean = m[c].mean;
+		s->stddev = m[c].n > 1 ? sqrt(m[c].m2 / (m[c].n - 1)) : 0.0;
+		s->min = m[c].min;
+		s->max = m[c].max;
+		bool live = w == CHSTATS_SESSION || !cs->has_last[w];
+		s->p50 = live ? p2_value(&cs->p50[w][c]) : cs->last_p50[w][c];
+		s->p99 = live ? p2_value(&cs->p99[w][c]) : cs->last_p99[w][c];
+	}
+	pthread_mutex_unlock(&cs->lock);
+}
@@ -0,0 +1,87 @@
+//
+// Channel statistics
+// Running mean, deviation, extremes and quantiles of every channel
+//
+// Copyright (c) 2023 Jonathan Tainer. Subject to the BSD 2-Clause License.
+//
+
+#ifndef CHANNEL_STATS_H
+#define CHANNEL_STATS_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include "sample.h"
+
+// Sliding windows are assembled from buckets of this length (seconds)
+#define CHSTATS_BUCKET 0.1
+#define CHSTATS_BUCKETS 600
+
+typedef enum chstats_window {
+	CHSTATS_1S = 0,
+	CHSTATS_10S,
+	CHSTATS_60S,
+	CHSTATS_SESSION,
+	CHSTATS_WINDOWS,
+} chstats_window;
+
+extern const char* chstats_window_names[CHSTATS_WINDOWS];
+
+// Welford accumulator with extremes, mergeable
+typedef struct moments {
+	unsigned long n;
+	double mean;
+	double m2;
+	float min;
+	float max;
+} moments;
+
+// P-square estimator of one quantile in constant space
+typedef struct p2_quantile {
+	double p;
+	int count;
+	double q[5];
+	double pos[5];
+	double desired[5];
+	double step[5];
+} p2_quantile;
+
+// Summary of one channel over one window
+typedef struct chstats_summary {
+	unsigned long n;
+	double mean;
+	double stddev;
+	float min;
+	float max;
+	double p50;
+	double p99;
+} chstats_summary;
+
+// Moments slide with the windows, at bucket resolution
+// Quantiles can't be removed from a sketch, so for the 1/10/60 s windows
+// they are those of the last complete window of that length
+typedef struct channel_stats {
+	pthread_mutex_t lock;
+	moments bucket[CHSTATS_BUCKETS][CH_COUNT];
+	long current;	// Absolute index of the newest bucket
+	moments session[CH_COUNT];
+
+	// Quantiles: one pair per window being filled, one pair for the session
+	p2_quantile p50[CHSTATS_WINDOWS][CH_COUNT];
+	p2_quantile p99[CHSTATS_WINDOWS][CH_COUNT];
+	double window_start[CHSTATS_WINDOWS];
+	double last_p50[CHSTATS_WINDOWS][CH_COUNT];
+	double last_p99[CHSTATS_WINDOWS][CH_COUNT];
+	bool has_last[CHSTATS_WINDOWS];
+} channel_stats;
+
+void channel_stats_init(channel_stats* cs);
+
+// Add samples (modem thread), raw channels only where the sample has them
+void channel_stats_push(channel_stats* cs, const sample_block* b);
+
+// Summaries of every channel over a window ending at the newest sample
+void channel_stats_summary(channel_stats* cs, chstats_window w, chstats_summary out[CH_COUNT]);
+
+void channel_stats_reset(channel_stats* cs);
+
+#endif
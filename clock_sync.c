@@ -0,0 +1,107 @@
+//
+// Clock synchronization
+// Maps device timestamps onto the host monotonic clock
+//
+// Copyright (c) 2023 Jonathan Tainer. Subject to the BSD 2-Clause License.
+//
+
+#include "clock_sync.h"
+#include <time.h>
+#include <string.h>
+#include <stdbool.h>
+#include <math.h>
+
+// Residuals larger than this are never plausible USB latency
+#define CLOCK_SYNC_MAX_RESIDUAL 0.25
+
+// Floor for the outlier threshold so a very quiet link doesn't reject everything
+#define CLOCK_SYNC_MIN_THRESHOLD 0.0005
+
+// Device time span (seconds) needed before the drift term is estimated
+#define CLOCK_SYNC_MIN_SPAN 1.0
+
+double clock_monotonic(void) {
+	struct timespec ts = { 0 };
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+void clock_sync_init(clock_sync* cs) {
+	memset(cs, 0, sizeof(*cs));
+	cs->rate = 1.0;
+}
+
+static void clock_sync_restart(clock_sync* cs) {
+	unsigned long rejected = cs->rejected;
+	unsigned long resets = cs->resets + 1;
+	clock_sync_init(cs);
+	cs->rejected = rejected;
+	cs->resets = resets;
+}
+
+static void clock_sync_solve(clock_sync* cs) {
+	double mx = cs->sx / cs->sw;
+	double my = cs->sy / cs->sw;
+	double var = cs->sxx / cs->sw - mx * mx;
+
+	// Hold the nominal rate until the observations span enough device time
+	// for the slope to be better than the arrival jitter; the window's
+	// spread settles near CLOCK_SYNC_WINDOW, well past this
+	if (var > CLOCK_SYNC_MIN_SPAN * CLOCK_SYNC_MIN_SPAN) {
+		double cov = cs->sxy / cs->sw - mx * my;
+		cs->rate = cov / var;
+	}
+	cs->offset = my - cs->rate * mx;
+}
+
+double clock_sync_update(clock_sync* cs, uint32_t ticks, double arrival) {
+	// Unwrap the 32 bit counter
+	if (cs->count > 0 && ticks < cs->last_ticks && cs->last_ticks - ticks > 0x80000000u)
+		cs->wrap_ticks += 0x100000000ull;
+	cs->last_ticks = ticks;
+	double dev = (double)(cs->wrap_ticks + ticks) / CLOCK_SYNC_TICK_HZ;
+
+	if (cs->count == 0) {
+		cs->dev_ref = dev;
+		cs->host_ref = arrival;
+	}
+	double x = dev - cs->dev_ref;
+	double y = arrival - cs->host_ref;
+
+	// Reject late arrivals caused by USB batching once the model has settled
+	if (cs->count > 0) {
+		double residual = y - (cs->offset + cs->rate * x);
+		double threshold = fmax(4.0 * cs->jitter, CLOCK_SYNC_MIN_THRESHOLD);
+		bool outlier = residual > threshold || residual < -CLOCK_SYNC_MAX_RESIDUAL;
+		if (outlier && cs->count >= CLOCK_SYNC_WARMUP) {
+			cs->rejected++;
+			if (++cs->consecutive_rejects < CLOCK_SYNC_MAX_REJECTS)
+				return cs->host_ref + cs->offset + cs->rate * x;
+
+			// Device clock stepped, refit from this observation
+			clock_sync_restart(cs);
+			return clock_sync_update(cs, ticks, arrival);
+		}
+		cs->jitter += (fabs(residual) - cs->jitter) / CLOCK_SYNC_WARMUP;
+	}
+	cs->consecutive_rejects = 0;
+
+	// Exponentially forget old observations so the model tracks drift, by
+	// the device time since the last one so the window spans the same
+	// seconds at any rate
+	const double decay = exp(-fmax(x - cs->last_x, 0.0) / CLOCK_SYNC_WINDOW);
+	cs->last_x = x;
+	cs->sw = cs->sw * decay + 1.0;
+	cs->sx = cs->sx * decay + x;
+	cs->sy = cs->sy * decay + y;
+	cs->sxx = cs->sxx * decay + x * x;
+	cs->sxy = cs->sxy * decay + x * y;
+	cs->count++;
+
+	clock_sync_solve(cs);
+	return cs->host_ref + cs->offset + cs->rate * x;
+}
+
+double clock_sync_drift_ppm(const clock_sync* cs) {
+	return (1.0 / cs->rate - 1.0) * 1e6;
+}
@@ -0,0 +1,68 @@
+//
+// Clock synchronization
+// Maps device timestamps onto the host monotonic clock
+//
+// Copyright (c) 2023 Jonathan Tainer. Subject to the BSD 2-Clause License.
+//
+
+#ifndef CLOCK_SYNC_H
+#define CLOCK_SYNC_H
+
+#include <stdint.h>
+
+// Nominal rate of the device timestamp counter (microseconds)
+#define CLOCK_SYNC_TICK_HZ 1000000.0
+
+// Time constant (seconds of device time) of the exponential forgetting
+// applied to old observations, whatever the sample rate
+#define CLOCK_SYNC_WINDOW 10.0
+
+// Observations needed before the model starts rejecting outliers
+#define CLOCK_SYNC_WARMUP 16
+
+// Consecutive rejections after which the model assumes the device clock
+// stepped (reset, reboot) and starts over
+#define CLOCK_SYNC_MAX_REJECTS 64
+
+// Online linear model host_time = offset + rate * device_time, fitted by
+// exponentially weighted least squares over (device, arrival) pairs
+typedef struct clock_sync {
+	// Timestamp unwrapping for the 32 bit device counter
+	uint32_t last_ticks;
+	uint64_t wrap_ticks;
+
+	// Reference point subtracted from all observations to keep sums small
+	double dev_ref;
+	double host_ref;
+
+	// Weighted sums of the regression
+	double sw, sx, sy, sxx, sxy;
+	double last_x;	// Device time of the last accepted observation
+
+	// Current fit, valid once count > 0
+	double offset;
+	double rate;
+
+	// Exponentially weighted mean absolute residual of accepted points
+	double jitter;
+
+	unsigned long count;
+	unsigned long rejected;
+	unsigned long resets;
+	int consecutive_rejects;
+} clock_sync;
+
+// Host CLOCK_MONOTONIC in seconds
+double clock_monotonic(void);
+
+void clock_sync_init(clock_sync* cs);
+
+// Feed a device timestamp and the host time the frame arrived at
+// Returns the device timestamp mapped onto the host clock
+double clock_sync_update(clock_sync* cs, uint32_t ticks, double arrival);
+
+// Estimated device clock drift relative to the host in parts per million
+// Positive when the device clock runs fast
+double clock_sync_drift_ppm(const clock_sync* cs);
+
+#endif
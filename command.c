@@ -0,0 +1,121 @@
+//
+// Command channel
+// Asynchronous requests to the IMU firmware over the serial stream
+//
+// Copyright (c) 2023 Jonathan Tainer. Subject to the BSD 2-Clause License.
+//
+
+#include "command.h"
+#include "clock_sync.h"
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+void command_init(command_channel* ch, int fd) {
+	memset(ch, 0, sizeof(*ch));
+	pthread_mutex_init(&ch->lock, NULL);
+	ch->fd = fd;
+	ch->next_id = 1;
+}
+
+static void command_finish(command_channel* ch, command_pending p, command_status status, const char* response) {
+	static const char* names[] = { "OK", "ERR", "TIMEOUT" };
+	pthread_mutex_lock(&ch->lock);
+	snprintf(ch->last, sizeof(ch->last), "%s -> %s %s", p.request, names[status], response);
+	if (status == COMMAND_TIMED_OUT)
+		ch->timeouts++;
+	pthread_mutex_unlock(&ch->lock);
+
+	if (p.callback)
+		p.callback(p.user, status, p.request, response);
+}
+
+int command_send(command_channel* ch, const char* request, double timeout, command_callback callback, void* user) {
+	pthread_mutex_lock(&ch->lock);
+	command_pending* p = NULL;
+	for (int i = 0; i < COMMAND_MAX_PENDING && !p; i++)
+		if (!ch->pending[i].used)
+			p = &ch->pending[i];
+	if (!p) {
+		pthread_mutex_unlock(&ch->lock);
+		return -1;
+	}
+
+	unsigned int id = ch->next_id++;
+	p->used = true;
+	p->id = id;
+	p->deadline = clock_monotonic() + timeout;
+	p->callback = callback;
+	p->user = user;
+	snprintf(p->request, sizeof(p->request), "%s", request);
+
+	// Written under the lock so concurrent requests never interleave on the wire
+	char line[COMMAND_MAX_TEXT + 16];
+	int len = snprintf(line, sizeof(line), "$%u %s\n", id, request);
+	ssize_t res = write(ch->fd, line, len);
+	ch->sent++;
+	pthread_mutex_unlock(&ch->lock);
+
+	if (res != len) {
+		command_pending failed = *p;
+		pthread_mutex_lock(&ch->lock);
+		p->used = false;
+		pthread_mutex_unlock(&ch->lock);
+		command_finish(ch, failed, COMMAND_ERROR, "write failed");
+		return -1;
+	}
+	return (int)id;
+}
+
+bool command_handle_line(command_channel* ch, const char* line) {
+	if (line[0] != '!')
+		return false;
+
+	unsigned int id = 0;
+	char result[8] = { 0 };
+	int n = 0;
+	if (sscanf(line, "!%u %7s%n", &id, result, &n) != 2)
+		return false;
+	const char* text = line + n;
+	while (*text == ' ')
+		text++;
+
+	pthread_mutex_lock(&ch->lock);
+	command_pending p = { 0 };
+	for (int i = 0; i < COMMAND_MAX_PENDING; i++) {
+		if (ch->pending[i].used && ch->pending[i].id == id) {
+			p = ch->pending[i];
+			ch->pending[i].used = false;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&ch->lock);
+
+	// Late responses to requests that already timed out are dropped
+	if (p.used)
+		command_finish(ch, p, strcmp(result, "OK") == 0 ? COMMAND_OK : COMMAND_ERROR, text);
+	return true;
+}
+
+void command_poll_timeouts(command_channel* ch, double now) {
+	command_pending expired[COMMAND_MAX_PENDING];
+	int count = 0;
+
+	pthread_mutex_lock(&ch->lock);
+	for (int i = 0; i < COMMAND_MAX_PENDING; i++) {
+		if (ch->pending[i].used && now > ch->pending[i].deadline) {
+			expired[count++] = ch->pending[i];
+			ch->pending[i].used = false;
+		}
+	}
+	pthread_mutex_unlock(&ch->lock);
+
+	for (int i = 0; i < count; i++)
+		command_finish(ch, expired[i], COMMAND_TIMED_OUT, "");
+}
+
+void command_last(command_channel* ch, char* out, int len) {
+	pthread_mutex_lock(&ch->lock);
+	snprintf(out, len, "%s", ch->last);
+	pthread_mutex_unlock(&ch->lock);
+}
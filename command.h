@@ -0,0 +1,74 @@
+//
+// Command channel
+// Asynchronous requests to the IMU firmware over the serial stream
+//
+// Copyright (c) 2023 Jonathan Tainer. Subject to the BSD 2-Clause License.
+//
+
+#ifndef COMMAND_H
+#define COMMAND_H
+
+#include <pthread.h>
+#include <stdbool.h>
+
+// Requests are written as
+//   $<id> <command> [arguments]\n
+// and answered with a text line, interleaved with sample frames, of the form
+//   !<id> OK [text]\n   or   !<id> ERR [text]\n
+// Commands understood by the firmware:
+//   INFO                 device identification and firmware version
+//   RATE <hz>            set the output sample rate
+//   MODE TEXT|BINARY     switch between text lines and compact binary frames
+//   CAL START            start on-device calibration
+
+#define COMMAND_MAX_PENDING 16
+#define COMMAND_MAX_TEXT 128
+#define COMMAND_DEFAULT_TIMEOUT 1.0
+
+typedef enum command_status {
+	COMMAND_OK = 0,
+	COMMAND_ERROR,		// Firmware rejected the request
+	COMMAND_TIMED_OUT,	// No response before the deadline
+} command_status;
+
+// Called on the thread that handles responses (the modem thread)
+typedef void (*command_callback)(void* user, command_status status, const char* request, const char* response);
+
+typedef struct command_pending {
+	bool used;
+	unsigned int id;
+	double deadline;
+	command_callback callback;
+	void* user;
+	char request[COMMAND_MAX_TEXT];
+} command_pending;
+
+typedef struct command_channel {
+	pthread_mutex_t lock;
+	int fd;
+	unsigned int next_id;
+	command_pending pending[COMMAND_MAX_PENDING];
+
+	// Most recent completed exchange, for display
+	char last[COMMAND_MAX_TEXT * 2];
+	unsigned long sent;
+	unsigned long timeouts;
+} command_channel;
+
+void command_init(command_channel* ch, int fd);
+
+// Queue a request and write it to the port
+// Returns the request id, or -1 if too many requests are outstanding
+int command_send(command_channel* ch, const char* request, double timeout, command_callback callback, void* user);
+
+// Offer a received text line to the channel
+// Returns true if it was a response and has been consumed
+bool command_handle_line(command_channel* ch, const char* line);
+
+// Fail requests whose deadline has passed
+void command_poll_timeouts(command_channel* ch, double now);
+
+// Copy of the last completed exchange
+void command_last(command_channel* ch, char* out, int len);
+
+#endif
@@ -0,0 +1,131 @@
+//
+// Devices
+// Additional IMUs read alongside the main one, orientation only
+//
+// Copyright (c) 2023 Jonathan Tainer. Subject to the BSD 2-Clause License.
+//
+
+#include "device.h"
+#include "frame.h"
+#include "serial_tune.h"
+#include "event.h"
+#include "render_wake.h"
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+
+int imu_device_open(imu_device* d, const char* path, speed_t baud) {
+	memset(d, 0, sizeof(*d));
+	snprintf(d->path, sizeof(d->path), "%s", path);
+	d->fd = serial_open(path, baud, &d->saved);
+	if (d->fd < 0)
+		return -1;
+	clock_sync_init(&d->clock);
+	stream_stats_init(&d->stats, path);
+	sample_history_init(&d->history);
+
+	calibration_identity(&d->calibration);
+	char calibration_path[4096];
+	if (calibration_default_path(path, calibration_path, sizeof(calibration_path)) == 0 &&
+		calibration_load(&d->calibration, calibration_path) == 0)
+		printf("Loaded calibration of %s from %s\n", path, calibration_path);
+	return 0;
+}
+
+static void device_flush(imu_device* d) {
+	sample_block* b = &d->block;
+	calibration_apply(&d->calibration, b);
+	if (d->events)
+		event_engine_push(d->events, d->index, b);
+	for (int i = 0; i < b->count; i++) {
+		imu_sample s;
+		sample_block_get(b, i, &s);
+		sample_history_push(&d->history, s);
+	}
+	if (d->wake)
+		render_wake_notify(d->wake, d->index, b);
+	b->count = 0;
+}
+
+static void device_frame(imu_device* d, frame_status status, const imu_frame* frame, double arrival) {
+	double time = arrival;
+	if (status == FRAME_OK && frame->has_time)
+		time = clock_sync_update(&d->clock, frame->ticks, arrival);
+	stream_stats_frame(&d->stats, status, frame, time, arrival);
+	if (status != FRAME_OK)
+		return;
+
+	imu_sample s = { 0 };
+	s.time = time;
+	s.orientation = (Vector2) { (float)frame->ang_x, (float)frame->ang_y };
+	s.has_raw = frame->has_raw;
+	s.gyro = (Vector3) { frame->gyro[0], frame->gyro[1], frame->gyro[2] };
+	s.accel = (Vector3) { frame->accel[0], frame->accel[1], frame->accel[2] };
+	s.mag = (Vector3) { frame->mag[0], frame->mag[1], frame->mag[2] };
+	if (d->block.count == SAMPLE_BLOCK_LEN)
+		device_flush(d);
+	sample_block_append(&d->block, &s);
+}
+
+static void* device_thread(void* arg) {
+	imu_device* d = arg;
+	unsigned char buf[1024];
+	frame_decoder decoder;
+	frame_decoder_init(&decoder);
+
+	struct pollfd pfd = { .fd = d->fd, .events = POLLIN };
+	while (!d->stop) {
+		// Wake up periodically to notice the stop flag
+		if (poll(&pfd, 1, 50) <= 0)
+			continue;
+		int res = read(d->fd, buf, sizeof(buf));
+		double arrival = clock_monotonic();
+		if (res <= 0) {
+			stream_stats_read_error(&d->stats, arrival);
+			usleep(10000);
+			continue;
+		}
+		stream_stats_bytes(&d->stats, res, arrival);
+
+		for (int i = 0; i < res; i++) {
+			imu_frame frame = { 0 };
+			frame_status status = FRAME_EMPTY;
+			switch (frame_decoder_feed(&decoder, buf[i])) {
+			case FRAME_EVENT_NONE:
+				continue;
+			case FRAME_EVENT_LINE:
+				status = frame_parse(decoder.line, &frame);
+				break;
+			case FRAME_EVENT_BINARY:
+				status = frame_decode_binary(&decoder, &frame);
+				break;
+			case FRAME_EVENT_BAD_CRC:
+				status = FRAME_BAD_CHECKSUM;
+				break;
+			case FRAME_EVENT_OVERFLOW:
+				status = FRAME_MALFORMED;
+				break;
+			}
+			device_frame(d, status, &frame, arrival);
+		}
+		device_flush(d);
+	}
+	return NULL;
+}
+
+void imu_device_start(imu_device* d) {
+	d->stop = false;
+	d->running = pthread_create(&d->thread, NULL, device_thread, d) == 0;
+}
+
+void imu_device_close(imu_device* d) {
+	d->stop = true;
+	if (d->running)
+		pthread_join(d->thread, NULL);
+	d->running = false;
+	if (d->fd >= 0) {
+		tcsetattr(d->fd, TCSANOW, &d->saved);
+		close(d->fd);
+		d->fd = -1;
+	}
+}
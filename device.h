@@ -0,0 +1,60 @@
+//
+// Devices
+// Additional IMUs read alongside the main one, orientation only
+//
+// Copyright (c) 2023 Jonathan Tainer. Subject to the BSD 2-Clause License.
+//
+
+#ifndef DEVICE_H
+#define DEVICE_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <limits.h>
+#include <termios.h>
+#include "clock_sync.h"
+#include "sample.h"
+#include "stream_stats.h"
+#include "calibration.h"
+
+// Including the main device
+#define MAX_DEVICES 8
+
+struct event_engine;
+struct render_wake;
+
+// Serial port with its own clock fit, statistics and sample history; the
+// analysis stages stay with the main device
+typedef struct imu_device {
+	char path[PATH_MAX];
+	int fd;
+	struct termios saved;
+	pthread_t thread;
+	bool running;
+	volatile bool stop;
+
+	clock_sync clock;
+	stream_stats stats;
+	sample_history history;
+	calibration calibration;
+	sample_block block;
+
+	// Detectors fed with this device's samples, if any
+	struct event_engine* events;
+	int index;
+
+	// Render thread woken by this device's motion, if any
+	struct render_wake* wake;
+} imu_device;
+
+// Open the port and load the device's calibration; returns -1 on failure
+int imu_device_open(imu_device* d, const char* path, speed_t baud);
+
+// Start the ingest thread
+void imu_device_start(imu_device* d);
+
+// Stop the thread, restore the port settings and close it
+void imu_device_close(imu_device* d);
+
+#endif
@@ -0,0 +1,408 @@
+//
+// Events
+// Gesture detectors on the sample stream, published to the overlay, a log
+// and socket subscribers
+//
+// Copyright (c) 2023 Jonathan Tainer. Subject to the BSD 2-Clause License.
+//
+
+#include "event.h"
+#include "clock_sync.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define EVENT_MASK (EVENT_QUEUE - 1)
+
+// Fraction of the way the tap baseline moves towards each quiet sample
+#define TAP_BASELINE_RATE 0.01f
+
+// Hold is released once the tilt is this many degrees back under the angle
+#define HOLD_HYSTERESIS 2.f
+
+// Cross is re-armed once the channel is this far back past the value, in the
+// channel's own units unless the spec gives one
+static const float cross_hysteresis[CH_COUNT] = {
+	[CH_ANG_X] = 2.f, [CH_ANG_Y] = 2.f,	// Degrees
+	[CH_GYR_X] = 5.f, [CH_GYR_Y] = 5.f, [CH_GYR_Z] = 5.f,	// Degrees per second
+	[CH_ACC_X] = 0.05f, [CH_ACC_Y] = 0.05f, [CH_ACC_Z] = 0.05f,	// g
+	[CH_MAG_X] = 1.f, [CH_MAG_Y] = 1.f, [CH_MAG_Z] = 1.f,
+};
+
+static const char* kind_names[] = {
+	[DETECT_TAP] = "tap",
+	[DETECT_SHAKE] = "shake",
+	[DETECT_HOLD] = "hold",
+	[DETECT_CROSS] = "cross",
+	[DETECT_STILL] = "still",
+};
+
+void event_engine_init(event_engine* e) {
+	memset(e, 0, sizeof(*e));
+	pthread_mutex_init(&e->lock, NULL);
+	pthread_cond_init(&e->wake, NULL);
+	e->listen_fd = -1;
+}
+
+int event_engine_add(event_engine* e, const char* spec) {
+	if (e->detectors == EVENT_MAX_DETECTORS)
+		return -1;
+	detector d = { 0 };
+	snprintf(d.text, sizeof(d.text), "%s", spec);
+
+	char name[16] = "";
+	float a = NAN, b = NAN, c = NAN;
+	sscanf(spec, "%15[^:]:%f:%f:%f", name, &a, &b, &c);
+	d.kind = DETECT_KINDS;
+	for (int k = 0; k < DETECT_KINDS; k++) {
+		if (strcmp(name, kind_names[k]) == 0)
+			d.kind = k;
+	}
+
+	switch (d.kind) {
+	case DETECT_TAP:
+		d.threshold = isnan(a) ? 1.5f : a;
+		d.duration = isnan(b) ? 0.08f : b / 1000.f;
+		break;
+	case DETECT_SHAKE:
+		d.threshold = isnan(a) ? 200.f : a;
+		d.count = isnan(b) ? 4 : (int)b;
+		d.duration = isnan(c) ? 1.f : c;
+		if (d.count < 1 || d.count > EVENT_SHAKE_MAX)
+			return -1;
+		break;
+	case DETECT_HOLD:
+		d.threshold = isnan(a) ? 30.f : a;
+		d.duration = isnan(b) ? 1.f : b;
+		break;
+	case DETECT_STILL:
+		d.threshold = isnan(a) ? 2.f : a;
+		d.duration = isnan(b) ? 2.f : b;
+		break;
+	case DETECT_CROSS: {
+		const char* channel = spec + strlen("cross:");
+		const char* op = strpbrk(channel, "<>");
+		if (!op)
+			return -1;
+		d.above = *op == '>';
+		char* end = NULL;
+		d.threshold = strtof(op + 1, &end);
+		if (end == op + 1)
+			return -1;
+		d.hysteresis = NAN;
+		if (*end == ':') {
+			const char* field = end + 1;
+			d.hysteresis = strtof(field, &end);
+			if (end == field || d.hysteresis < 0.f)
+				return -1;
+		}
+		if (*end != '\0')
+			return -1;
+		d.channel = -1;
+		for (int ch = 0; ch < CH_COUNT; ch++) {
+			if ((int)strlen(channel_names[ch]) == op - channel && strncmp(channel, channel_names[ch], op - channel) == 0)
+				d.channel = ch;
+		}
+		if (d.channel < 0)
+			return -1;
+		if (isnan(d.hysteresis))
+			d.hysteresis = cross_hysteresis[d.channel];
+		break;
+	}
+	default:
+		return -1;
+	}
+	if (d.threshold <= 0.f && d.kind != DETECT_CROSS)
+		return -1;
+	e->detector[e->detectors++] = d;
+	return 0;
+}
+
+// Queue an event for the publishing thread, dropping it if the thread has
+// fallen a whole queue behind
+static void emit(event_engine* e, int device, int detector, double time, float value) {
+	event ev = { time, device, detector, value };
+	pthread_mutex_lock(&e->lock);
+	e->recent[e->count++ % EVENT_RECENT] = ev;
+	if (e->tail - e->head == EVENT_QUEUE)
+		e->dropped++;
+	else
+		e->queue[e->tail++ & EVENT_MASK] = ev;
+	pthread_cond_signal(&e->wake);
+	pthread_mutex_unlock(&e->lock);
+}
+
+// Returns true and the value to report when the detector fires on a sample
+static bool detect(const detector* d, detector_state* s, double t, bool raw, const float* v, float* value) {
+	switch (d->kind) {
+	case DETECT_TAP: {
+		if (!raw)
+			return false;
+		float m = sqrtf(v[CH_ACC_X] * v[CH_ACC_X] + v[CH_ACC_Y] * v[CH_ACC_Y] + v[CH_ACC_Z] * v[CH_ACC_Z]);
+		if (!s->has_baseline) {
+			s->baseline = m;
+			s->has_baseline = true;
+		}
+		float jump = m - s->baseline;
+		if (!s->active) {
+			if (jump > d->threshold) {
+				s->active = true;
+				s->since = t;
+				return false;
+			}
+			s->baseline += (m - s->baseline) * TAP_BASELINE_RATE;
+			return false;
+		}
+		// A tap is over quickly, a longer push is not one
+		if (jump < d->threshold / 2.f) {
+			s->active = false;
+			*value = (float)((t - s->since) * 1e3);
+			return t - s->since <= d->duration;
+		}
+		return false;
+	}
+	case DETECT_SHAKE: {
+		if (!raw)
+			return false;
+		int axis = 0;
+		for (int k = 1; k < 3; k++) {
+			if (fabsf(v[CH_GYR_X + k]) > fabsf(v[CH_GYR_X + axis]))
+				axis = k;
+		}
+		float g = v[CH_GYR_X + axis];
+		if (fabsf(g) < d->threshold)
+			return false;
+		int sign = g > 0.f ? 1 : -1;
+		bool reversed = s->sign[axis] != 0 && s->sign[axis] != sign;
+		s->sign[axis] = sign;
+		if (!reversed)
+			return false;
+
+		// Ring of the latest reversal times, the oldest of the last count
+		// must be within the window; one shake reports once per window
+		if (s->fired && t - s->since < d->duration)
+			return false;
+		s->fired = false;
+		s->reversal[s->reversals++ % EVENT_SHAKE_MAX] = t;
+		if (s->reversals < d->count)
+			return false;
+		double oldest = s->reversal[(s->reversals - d->count) % EVENT_SHAKE_MAX];
+		if (t - oldest > d->duration)
+			return false;
+		s->reversals = 0;
+		s->fired = true;
+		s->since = t;
+		*value = fabsf(g);
+		return true;
+	}
+	case DETECT_HOLD:
+	case DETECT_STILL: {
+		float level;
+		bool met;
+		if (d->kind == DETECT_HOLD) {
+			level = hypotf(v[CH_ANG_X], v[CH_ANG_Y]);
+			met = s->active ? level > d->threshold - HOLD_HYSTERESIS : level > d->threshold;
+		}
+		else {
+			// Rotation rate from the gyros, or from the orientation change
+			if (raw)
+				level = sqrtf(v[CH_GYR_X] * v[CH_GYR_X] + v[CH_GYR_Y] * v[CH_GYR_Y] + v[CH_GYR_Z] * v[CH_GYR_Z]);
+			else {
+				double dt = t - s->prev_time;
+				level = s->prev_time > 0.0 && dt > 0.0 ?
+					hypotf(v[CH_ANG_X] - s->prev[0], v[CH_ANG_Y] - s->prev[1]) / dt : 0.f;
+				s->prev[0] = v[CH_ANG_X];
+				s->prev[1] = v[CH_ANG_Y];
+				s->prev_time = t;
+			}
+			met = level < d->threshold;
+		}
+		if (!met) {
+			s->active = false;
+			return false;
+		}
+		if (!s->active) {
+			s->active = true;
+			s->fired = false;
+			s->since = t;
+		}
+		if (s->fired || t - s->since < d->duration)
+			return false;
+		s->fired = true;
+		*value = level;
+		return true;
+	}
+	case DETECT_CROSS: {
+		if (d->channel >= CH_GYR_X && !raw)
+			return false;
+		float x = v[d->channel];
+		bool met = d->above ? x > d->threshold : x < d->threshold;
+		bool released = d->above ? x < d->threshold - d->hysteresis : x > d->threshold + d->hysteresis;
+		if (s->active) {
+			s->active = !released;
+			return false;
+		}
+		s->active = met;
+		*value = x;
+		return met;
+	}
+	default:
+		return false;
+	}
+}
+
+void event_engine_push(event_engine* e, int device, const sample_block* b) {
+	if (e->detectors == 0 || b->count == 0 || device >= MAX_DEVICES)
+		return;
+	double start = clock_monotonic();
+	for (int i = 0; i < b->count; i++) {
+		float v[CH_COUNT];
+		for (int c = 0; c < CH_COUNT; c++)
+			v[c] = b->ch[c][i];
+		for (int k = 0; k < e->detectors; k++) {
+			float value = 0.f;
+			if (detect(&e->detector[k], &e->state[device][k], b->time[i], b->has_raw[i], v, &value))
+				emit(e, device, k, b->time[i], value);
+		}
+	}
+	double ns = (clock_monotonic() - start) * 1e9 / b->count;
+	double* avg = &e->ns_per_sample[device];
+	*avg = *avg == 0.0 ? ns : *avg + (ns - *avg) / 64.0;
+}
+
+int event_engine_recent(event_engine* e, event* out, int max) {
+	pthread_mutex_lock(&e->lock);
+	int n = 0;
+	for (; n < max && n < EVENT_RECENT && (unsigned long)n < e->count; n++)
+		out[n] = e->recent[(e->count - 1 - n) % EVENT_RECENT];
+	pthread_mutex_unlock(&e->lock);
+	return n;
+}
+
+static void publish(event_engine* e, const event* ev) {
+	char line[160];
+	int len = snprintf(line, sizeof(line), "{\"time\":%.6f,\"device\":%d,\"event\":\"%s\",\"detector\":\"%s\",\"value\":%g}\n",
+		ev->time, ev->device, kind_names[e->detector[ev->detector].kind], e->detector[ev->detector].text, ev->value);
+	if (e->log) {
+		fputs(line, e->log);
+		fflush(e->log);
+	}
+
+	// Subscribers that can't keep up are disconnected rather than waited for
+	for (int c = 0; c < e->client_count; c++) {
+		if (send(e->clients[c], line, len, MSG_DONTWAIT | MSG_NOSIGNAL) != len) {
+			close(e->clients[c]);
+			e->clients[c--] = e->clients[--e->client_count];
+		}
+	}
+}
+
+static void accept_clients(event_engine* e) {
+	if (e->listen_fd < 0)
+		return;
+	int fd;
+	while ((fd = accept(e->listen_fd, NULL, NULL)) >= 0) {
+		if (e->client_count == EVENT_MAX_CLIENTS)
+			close(fd);
+		else
+			e->clients[e->client_count++] = fd;
+	}
+}
+
+static void* event_thread(void* arg) {
+	event_engine* e = arg;
+	pthread_mutex_lock(&e->lock);
+	while (true) {
+		if (e->head == e->tail) {
+			if (e->quit)
+				break;
+
+			// Wake up now and then to accept new subscribers
+			struct timespec deadline;
+			clock_gettime(CLOCK_REALTIME, &deadline);
+			deadline.tv_nsec += 100000000;
+			if (deadline.tv_nsec >= 1000000000) {
+				deadline.tv_sec++;
+				deadline.tv_nsec -= 1000000000;
+			}
+			pthread_cond_timedwait(&e->wake, &e->lock, &deadline);
+			pthread_mutex_unlock(&e->lock);
+			accept_clients(e);
+			pthread_mutex_lock(&e->lock);
+			continue;
+		}
+		event ev = e->queue[e->head++ & EVENT_MASK];
+		pthread_mutex_unlock(&e->lock);
+		publish(e, &ev);
+		pthread_mutex_lock(&e->lock);
+	}
+	pthread_mutex_unlock(&e->lock);
+	return NULL;
+}
+
+int event_engine_start(event_engine* e, const char* log_path, const char* socket_path) {
+	if (log_path) {
+		e->log = strcmp(log_path, "-") == 0 ? stdout : fopen(log_path, "a");
+		if (!e->log) {
+			printf("Failed to open event log %s\n", log_path);
+			return -1;
+		}
+	}
+	if (socket_path) {
+		struct sockaddr_un addr = { .sun_family = AF_UNIX };
+		if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+			printf("Socket path too long: %s\n", socket_path);
+			return -1;
+		}
+		strcpy(addr.sun_path, socket_path);
+		snprintf(e->socket_path, sizeof(e->socket_path), "%s", socket_path);
+		unlink(socket_path);
+		e->listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+		if (e->listen_fd < 0 || bind(e->listen_fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(e->listen_fd, EVENT_MAX_CLIENTS) != 0) {
+			printf("Failed to listen on %s: %s\n", socket_path, strerror(errno));
+			return -1;
+		}
+	}
+	e->running = pthread_create(&e->thread, NULL, event_thread, e) == 0;
+	return 0;
+}
+
+void event_engine_shutdown(event_engine* e) {
+	pthread_mutex_lock(&e->lock);
+	e->quit = true;
+	pthread_cond_signal(&e->wake);
+	pthread_mutex_unlock(&e->lock);
+	if (e->running)
+		pthread_join(e->thread, NULL);
+	e->running = false;
+	for (int c = 0; c < e->client_count; c++)
+		close(e->clients[c]);
+	e->client_count = 0;
+	if (e->listen_fd >= 0) {
+		close(e->listen_fd);
+		unlink(e->socket_path);
+	}
+	e->listen_fd = -1;
+	if (e->log && e->log != stdout)
+		fclose(e->log);
+	e->log = NULL;
+}
+
+void event_engine_report(FILE* out, event_engine* e) {
+	pthread_mutex_lock(&e->lock);
+	fprintf(out, "Events: %lu from %d detectors, %lu dropped (publisher busy)",
+		e->count, e->detectors, e->dropped);
+	// Every device pushes into the same engine, each with its own cost
+	for (int d = 0; d < MAX_DEVICES; d++) {
+		if (e->ns_per_sample[d] > 0.0)
+			fprintf(out, ", device %d %.0f ns/sample", d, e->ns_per_sample[d]);
+	}
+	fprintf(out, "\n");
+	pthread_mutex_unlock(&e->lock);
+}
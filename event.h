@@ -0,0 +1,124 @@
+//
+// Events
+// Gesture detectors on the sample stream, published to the overlay, a log
+// and socket subscribers
+//
+// Copyright (c) 2023 Jonathan Tainer. Subject to the BSD 2-Clause License.
+//
+
+#ifndef EVENT_H
+#define EVENT_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include "sample.h"
+#include "device.h"
+
+#define EVENT_MAX_DETECTORS 32
+#define EVENT_QUEUE 256
+#define EVENT_RECENT 8
+#define EVENT_MAX_CLIENTS 8
+#define EVENT_SHAKE_MAX 16
+
+// Events stay on screen this long, seconds
+#define EVENT_DISPLAY_TIME 5.0
+
+typedef enum detector_kind {
+	DETECT_TAP = 0,	// Short spike of acceleration magnitude
+	DETECT_SHAKE,	// Repeated fast reversals of the rotation
+	DETECT_HOLD,	// Tilted beyond an angle for a while
+	DETECT_CROSS,	// Channel crosses a threshold
+	DETECT_STILL,	// No rotation for a while
+	DETECT_KINDS,
+} detector_kind;
+
+typedef struct detector {
+	detector_kind kind;
+	char text[32];
+	float threshold;
+	float duration;	// Seconds: tap maximum, hold and still minimum, shake window
+	int count;	// Shake reversals
+	int channel;	// Cross
+	bool above;
+	float hysteresis;	// Cross: distance back past the threshold that re-arms it
+} detector;
+
+// State of one detector on one device
+typedef struct detector_state {
+	bool active;	// Condition currently met
+	bool fired;	// Already reported for this activation
+	double since;
+	float baseline;	// Tap: slow average of the acceleration magnitude
+	bool has_baseline;
+
+	// Shake: times of the latest reversals and the last sign per axis
+	double reversal[EVENT_SHAKE_MAX];
+	int reversals;
+	int sign[3];
+
+	// Still without gyro data: previous orientation
+	float prev[2];
+	double prev_time;
+} detector_state;
+
+typedef struct event {
+	double time;
+	int device;
+	int detector;
+	float value;
+} event;
+
+typedef struct event_engine {
+	int detectors;
+	detector detector[EVENT_MAX_DETECTORS];
+	detector_state state[MAX_DEVICES][EVENT_MAX_DETECTORS];
+	double ns_per_sample[MAX_DEVICES];
+
+	// Queue to the publishing thread and the latest events for display
+	pthread_mutex_t lock;
+	pthread_cond_t wake;
+	pthread_t thread;
+	bool running;
+	bool quit;
+	event queue[EVENT_QUEUE];
+	unsigned long head;
+	unsigned long tail;
+	event recent[EVENT_RECENT];
+	unsigned long count;
+	unsigned long dropped;
+
+	// Subscribers, touched by the publishing thread only
+	FILE* log;
+	int listen_fd;
+	char socket_path[108];
+	int clients[EVENT_MAX_CLIENTS];
+	int client_count;
+} event_engine;
+
+void event_engine_init(event_engine* e);
+
+// Add a detector:
+//   tap[:<g>[:<ms>]]             acceleration magnitude jump shorter than ms
+//   shake[:<deg/s>[:<n>[:<s>]]]  n reversals of a gyro axis within s seconds
+//   hold[:<deg>[:<s>]]           tilt beyond deg held for s seconds
+//   cross:<channel>(<|>)<value>  channel crossing a value
+//   still[:<deg/s>[:<s>]]        rotation slower than deg/s for s seconds
+// Returns -1 if invalid or there are too many
+int event_engine_add(event_engine* e, const char* spec);
+
+// Publish to a log file ("-" for stdout) and a Unix socket, either may be
+// NULL; returns -1 if one can't be opened
+int event_engine_start(event_engine* e, const char* log_path, const char* socket_path);
+
+void event_engine_shutdown(event_engine* e);
+
+// Run every detector over a block of one device (that device's thread)
+void event_engine_push(event_engine* e, int device, const sample_block* b);
+
+// Latest events, newest first; returns how many
+int event_engine_recent(event_engine* e, event* out, int max);
+
+void event_engine_report(FILE* out, event_engine* e);
+
+#endif
@@ -0,0 +1,420 @@
+//
+// Filters
+// Per-channel DSP filter chain applied to sample blocks before display
+//
+// Copyright (c) 2023 Jonathan Tainer. Subject to the BSD 2-Clause License.
+//
+
+#include "filter.h"
+#include "clock_sync.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <complex.h>
+
+#define FILTER_DEFAULT_Q 0.7071
+
+// Frequency the reported group delay is evaluated at; display motion lives
+// well below the cutoffs, so this is the lag a user sees
+#define FILTER_DELAY_FREQ 1.0
+
+// Minimum time between sample rate estimates
+#define FILTER_RATE_PERIOD 0.5
+
+static const char* filter_names[] = {
+	[FILTER_NONE] = "none",
+	[FILTER_LOWPASS] = "lowpass",
+	[FILTER_HIGHPASS] = "highpass",
+	[FILTER_NOTCH] = "notch",
+	[FILTER_FIR] = "fir",
+	[FILTER_MEDIAN] = "median",
+};
+
+void filter_chain_init(filter_chain* f) {
+	memset(f, 0, sizeof(*f));
+	pthread_mutex_init(&f->lock, NULL);
+	f->enabled = true;
+}
+
+bool filter_chain_empty(const filter_chain* f) {
+	return f->slots == 0;
+}
+
+static bool is_biquad(filter_type t) {
+	return t == FILTER_LOWPASS || t == FILTER_HIGHPASS || t == FILTER_NOTCH;
+}
+
+static int parse_stage(char* text, filter_stage* st) {
+	memset(st, 0, sizeof(*st));
+	st->q = FILTER_DEFAULT_Q;
+	char* fields[3] = { 0 };
+	int n = 0;
+	for (char* p = strtok(text, ":"); p && n < 3; p = strtok(NULL, ":"))
+		fields[n++] = p;
+	if (n < 2)
+		return -1;
+
+	for (int t = FILTER_LOWPASS; t <= FILTER_MEDIAN; t++) {
+		if (strcmp(fields[0], filter_names[t]) == 0)
+			st->type = t;
+	}
+	if (is_biquad(st->type)) {
+		st->freq = atof(fields[1]);
+		if (n > 2)
+			st->q = atof(fields[2]);
+		return st->freq > 0.0 && st->q > 0.0 ? 0 : -1;
+	}
+	if (st->type == FILTER_FIR) {
+		st->length = atoi(fields[1]) | 1;
+		st->freq = n > 2 ? atof(fields[2]) : 0.0;
+		return st->length <= FILTER_MAX_TAPS && st->freq > 0.0 ? 0 : -1;
+	}
+	if (st->type == FILTER_MEDIAN) {
+		st->length = atoi(fields[1]) | 1;
+		return st->length > 1 && st->length <= FILTER_MAX_MEDIAN ? 0 : -1;
+	}
+	return -1;
+}
+
+// Place a stage for a channel in the first compatible slot after the ones it
+// already uses, so each channel keeps its order while channels share slots
+static int place_stage(filter_chain* f, int channel, const filter_stage* st) {
+	int after = -1;
+	for (int s = 0; s < f->slots; s++) {
+		if (f->slot[s].stage[channel].type != FILTER_NONE)
+			after = s;
+	}
+	for (int s = after + 1; s < f->slots; s++) {
+		filter_slot* slot = &f->slot[s];
+		bool compatible = is_biquad(st->type) ? slot->kind == FILTER_LOWPASS : slot->kind == st->type;
+		if (compatible) {
+			slot->stage[channel] = *st;
+			return 0;
+		}
+	}
+	if (f->slots == FILTER_MAX_SLOTS)
+		return -1;
+	filter_slot* slot = &f->slot[f->slots++];
+	memset(slot, 0, sizeof(*slot));
+	slot->kind = is_biquad(st->type) ? FILTER_LOWPASS : st->type;
+	slot->stage[channel] = *st;
+	return 0;
+}
+
+int filter_chain_parse(filter_chain* f, const char* spec) {
+	char* copy = strdup(spec);
+	char* stages = strchr(copy, '=');
+	if (!stages) {
+		free(copy);
+		return -1;
+	}
+	*stages++ = '\0';
+
+	bool mask[CH_COUNT];
+	int result = channel_mask_parse(copy, mask);
+
+	// Split the stage list first, strtok can't nest
+	char* list[FILTER_MAX_SLOTS + 1];
+	int count = 0;
+	for (char* p = strtok(stages, ","); p && result == 0; p = strtok(NULL, ",")) {
+		if (count == FILTER_MAX_SLOTS)
+			result = -1;
+		else
+			list[count++] = p;
+	}
+
+	pthread_mutex_lock(&f->lock);
+	for (int i = 0; i < count && result == 0; i++) {
+		filter_stage st;
+		result = parse_stage(list[i], &st);
+		for (int c = 0; c < CH_COUNT && result == 0; c++) {
+			if (mask[c])
+				result = place_stage(f, c, &st);
+		}
+	}
+	f->design_rate = 0.0;
+	pthread_mutex_unlock(&f->lock);
+	free(copy);
+	return count > 0 ? result : -1;
+}
+
+// Group delay in samples of a polynomial in z^-1 at angular frequency w
+static double poly_delay(const double* c, int n, double w) {
+	double complex sum = 0.0, weighted = 0.0;
+	for (int k = 0; k < n; k++) {
+		double complex term = c[k] * cexp(-I * w * k);
+		sum += term;
+		weighted += k * term;
+	}
+	return cabs(sum) > 0.0 ? creal(weighted / sum) : 0.0;
+}
+
+// Audio EQ cookbook biquads, normalized by a0
+static double design_biquad(filter_slot* slot, int l, const filter_stage* st, double rate) {
+	double w0 = 2.0 * PI * fmin(st->freq, 0.45 * rate) / rate;
+	double c = cos(w0);
+	double alpha = sin(w0) / (2.0 * st->q);
+	double b[3], a[3] = { 1.0 + alpha, -2.0 * c, 1.0 - alpha };
+	switch (st->type) {
+	case FILTER_LOWPASS:
+		b[0] = b[2] = (1.0 - c) / 2.0;
+		b[1] = 1.0 - c;
+		break;
+	case FILTER_HIGHPASS:
+		b[0] = b[2] = (1.0 + c) / 2.0;
+		b[1] = -(1.0 + c);
+		break;
+	default:
+		b[0] = b[2] = 1.0;
+		b[1] = -2.0 * c;
+		break;
+	}
+	for (int k = 2; k >= 0; k--) {
+		b[k] /= a[0];
+		a[k] /= a[0];
+	}
+	slot->b0[l] = (float)b[0];
+	slot->b1[l] = (float)b[1];
+	slot->b2[l] = (float)b[2];
+	slot->a1[l] = (float)a[1];
+	slot->a2[l] = (float)a[2];
+
+	double w = 2.0 * PI * FILTER_DELAY_FREQ / rate;
+	return poly_delay(b, 3, w) - poly_delay(a, 3, w);
+}
+
+// Hamming windowed sinc lowpass with unity gain at DC
+static double design_fir(filter_slot* slot, int l, const filter_stage* st, double rate) {
+	double fc = fmin(st->freq, 0.45 * rate) / rate;
+	double mid = (st->length - 1) / 2.0;
+	double sum = 0.0;
+	for (int t = 0; t < st->length; t++) {
+		double x = t - mid;
+		double h = x == 0.0 ? 2.0 * fc : sin(2.0 * PI * fc * x) / (PI * x);
+		h *= 0.54 - 0.46 * cos(2.0 * PI * t / (st->length - 1));
+		slot->coef[t][l] = (float)h;
+		sum += h;
+	}
+	for (int t = 0; t < st->length; t++)
+		slot->coef[t][l] = (float)(slot->coef[t][l] / sum);
+	return mid;
+}
+
+static void filter_chain_design(filter_chain* f) {
+	double delay[CH_COUNT] = { 0 };
+	for (int s = 0; s < f->slots; s++) {
+		filter_slot* slot = &f->slot[s];
+		slot->taps = 1;
+		for (int l = 0; l < FILTER_LANES; l++) {
+			// Identity unless the lane has a stage here
+			slot->b0[l] = 1.f;
+			slot->b1[l] = slot->b2[l] = slot->a1[l] = slot->a2[l] = 0.f;
+			for (int t = 0; t < FILTER_MAX_TAPS; t++)
+				slot->coef[t][l] = t == 0 ? 1.f : 0.f;
+
+			if (l >= CH_COUNT)
+				continue;
+			const filter_stage* st = &slot->stage[l];
+			if (is_biquad(st->type))
+				delay[l] += design_biquad(slot, l, st, f->rate);
+			else if (st->type == FILTER_FIR) {
+				delay[l] += design_fir(slot, l, st, f->rate);
+				if (st->length > slot->taps)
+					slot->taps = st->length;
+			}
+			else if (st->type == FILTER_MEDIAN)
+				delay[l] += (st->length - 1) / 2.0;
+		}
+	}
+	for (int c = 0; c < CH_COUNT; c++)
+		f->delay[c] = delay[c] / f->rate;
+	f->design_rate = f->rate;
+}
+
+static void filter_chain_clear(filter_chain* f) {
+	for (int s = 0; s < f->slots; s++) {
+		filter_slot* slot = &f->slot[s];
+		memset(slot->z1, 0, sizeof(slot->z1));
+		memset(slot->z2, 0, sizeof(slot->z2));
+		memset(slot->history, 0, sizeof(slot->history));
+		memset(slot->count, 0, sizeof(slot->count));
+		slot->pos = 0;
+	}
+}
+
+static void run_biquad(filter_slot* slot, float (*x)[FILTER_LANES], int count) {
+	float* restrict z1 = slot->z1;
+	float* restrict z2 = slot->z2;
+	const float* restrict b0 = slot->b0;
+	const float* restrict b1 = slot->b1;
+	const float* restrict b2 = slot->b2;
+	const float* restrict a1 = slot->a1;
+	const float* restrict a2 = slot->a2;
+	for (int i = 0; i < count; i++) {
+		float* restrict v = x[i];
+		for (int l = 0; l < FILTER_LANES; l++) {
+			float in = v[l];
+			float out = b0[l] * in + z1[l];
+			z1[l] = b1[l] * in - a1[l] * out + z2[l];
+			z2[l] = b2[l] * in - a2[l] * out;
+			v[l] = out;
+		}
+	}
+}
+
+static void run_fir(filter_slot* slot, float (*x)[FILTER_LANES], int count) {
+	const int taps = slot->taps;
+	for (int i = 0; i < count; i++) {
+		slot->pos = slot->pos == 0 ? taps - 1 : slot->pos - 1;
+		float* restrict newest = slot->history[slot->pos];
+		float* restrict mirror = slot->history[slot->pos + taps];
+		float* restrict v = x[i];
+		float acc[FILTER_LANES] = { 0 };
+		for (int l = 0; l < FILTER_LANES; l++)
+			newest[l] = mirror[l] = v[l];
+
+		// history[pos + t] is the sample t steps back
+		for (int t = 0; t < taps; t++) {
+			const float* restrict h = slot->history[slot->pos + t];
+			const float* restrict c = slot->coef[t];
+			for (int l = 0; l < FILTER_LANES; l++)
+				acc[l] += c[l] * h[l];
+		}
+		for (int l = 0; l < FILTER_LANES; l++)
+			v[l] = acc[l];
+	}
+}
+
+static void run_median(filter_slot* slot, float (*x)[FILTER_LANES], int count) {
+	for (int l = 0; l < CH_COUNT; l++) {
+		const int n = slot->stage[l].length;
+		if (slot->stage[l].type != FILTER_MEDIAN)
+			continue;
+		float* window = slot->window[l];
+		for (int i = 0; i < count; i++) {
+			window[slot->head[l]] = x[i][l];
+			slot->head[l] = (slot->head[l] + 1) % n;
+			if (slot->count[l] < n)
+				slot->count[l]++;
+
+			// Insertion sort of a copy, the window is tiny
+			float sorted[FILTER_MAX_MEDIAN];
+			int m = slot->count[l];
+			for (int j = 0; j < m; j++) {
+				float v = window[j];
+				int k = j;
+				for (; k > 0 && sorted[k - 1] > v; k--)
+					sorted[k] = sorted[k - 1];
+				sorted[k] = v;
+			}
+			x[i][l] = sorted[m / 2];
+		}
+	}
+}
+
+void filter_chain_process(filter_chain* f, sample_block* b) {
+	if (f->slots == 0 || b->count == 0)
+		return;
+	double start = clock_monotonic();
+
+	// Sample rate over at least FILTER_RATE_PERIOD, so bursts of samples
+	// stamped with their arrival time don't skew it
+	double now = b->time[b->count - 1];
+	f->rate_samples += b->count;
+	if (f->rate_time == 0.0)
+		f->rate_time = now;
+	else if (now - f->rate_time >= FILTER_RATE_PERIOD) {
+		double rate = (f->rate_samples - b->count) / (now - f->rate_time);
+		f->rate_time = now;
+		f->rate_samples = b->count;
+		pthread_mutex_lock(&f->lock);
+		f->rate = f->rate > 0.0 ? f->rate + (rate - f->rate) / 4.0 : rate;
+		pthread_mutex_unlock(&f->lock);
+	}
+
+	pthread_mutex_lock(&f->lock);
+	bool run = f->enabled && f->rate > 0.0;
+	if (run && (f->design_rate == 0.0 || fabs(f->rate / f->design_rate - 1.0) > FILTER_RATE_TOLERANCE))
+		filter_chain_design(f);
+	if (run && f->reset) {
+		filter_chain_clear(f);
+		f->reset = false;
+	}
+	pthread_mutex_unlock(&f->lock);
+	if (!run)
+		return;
+
+	// Transpose so each sample is a vector of channels
+	float x[SAMPLE_BLOCK_LEN][FILTER_LANES] = { 0 };
+	for (int c = 0; c < CH_COUNT; c++) {
+		for (int i = 0; i < b->count; i++)
+			x[i][c] = b->ch[c][i];
+	}
+
+	for (int s = 0; s < f->slots; s++) {
+		filter_slot* slot = &f->slot[s];
+		if (slot->kind == FILTER_LOWPASS)
+			run_biquad(slot, x, b->count);
+		else if (slot->kind == FILTER_FIR)
+			run_fir(slot, x, b->count);
+		else
+			run_median(slot, x, b->count);
+	}
+
+	for (int c = 0; c < CH_COUNT; c++) {
+		for (int i = 0; i < b->count; i++)
+			b->ch[c][i] = x[i][c];
+	}
+
+	double ns = (clock_monotonic() - start) * 1e9 / b->count;
+	pthread_mutex_lock(&f->lock);
+	f->ns_per_sample = f->samples == 0 ? ns : f->ns_per_sample + (ns - f->ns_per_sample) / 64.0;
+	f->samples += b->count;
+	pthread_mutex_unlock(&f->lock);
+}
+
+void filter_chain_toggle(filter_chain* f) {
+	pthread_mutex_lock(&f->lock);
+	f->enabled = !f->enabled;
+	f->reset = true;
+	pthread_mutex_unlock(&f->lock);
+}
+
+void filter_chain_status(filter_chain* f, char* out, int len) {
+	pthread_mutex_lock(&f->lock);
+	if (f->slots == 0)
+		snprintf(out, len, "none");
+	else if (!f->enabled)
+		snprintf(out, len, "bypassed");
+	else if (f->design_rate == 0.0)
+		snprintf(out, len, "waiting for the sample rate");
+	else
+		snprintf(out, len, "%d stages at %.0f Hz, %.0f ns/sample, display delay %.1f ms",
+			f->slots, f->design_rate, f->ns_per_sample, fmax(f->delay[CH_ANG_X], f->delay[CH_ANG_Y]) * 1e3);
+	pthread_mutex_unlock(&f->lock);
+}
+
+void filter_chain_report(FILE* out, filter_chain* f) {
+	pthread_mutex_lock(&f->lock);
+	fprintf(out, "Filter chain: %.0f ns/sample over %lu samples at %.1f Hz\n", f->ns_per_sample, f->samples, f->design_rate);
+	for (int c = 0; c < CH_COUNT; c++) {
+		char stages[256] = "";
+		int used = 0;
+		for (int s = 0; s < f->slots; s++) {
+			const filter_stage* st = &f->slot[s].stage[c];
+			if (st->type == FILTER_NONE)
+				continue;
+			if (is_biquad(st->type))
+				used += snprintf(stages + used, sizeof(stages) - used, " %s %g Hz q %g", filter_names[st->type], st->freq, st->q);
+			else if (st->type == FILTER_FIR)
+				used += snprintf(stages + used, sizeof(stages) - used, " fir %d taps %g Hz", st->length, st->freq);
+			else
+				used += snprintf(stages + used, sizeof(stages) - used, " median %d", st->length);
+			if (used >= (int)sizeof(stages))
+				break;
+		}
+		if (used > 0)
+			fprintf(out, "  %s:%s, group delay %.2f ms\n", channel_names[c], stages, f->delay[c] * 1e3);
+	}
+	pthread_mutex_unlock(&f->lock);
+}
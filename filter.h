@@ -0,0 +1,106 @@
+//
+// Filters
+// Per-channel DSP filter chain applied to sample blocks before display
+//
+// Copyright (c) 2023 Jonathan Tainer. Subject to the BSD 2-Clause License.
+//
+
+#ifndef FILTER_H
+#define FILTER_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include "sample.h"
+
+// Channels are processed as lanes of one vector, padded to a multiple of
+// the widest SIMD register so the lane loops vectorize without a remainder
+#define FILTER_LANES 16
+
+#define FILTER_MAX_SLOTS 8
+#define FILTER_MAX_TAPS 63
+#define FILTER_MAX_MEDIAN 15
+
+// Coefficients are redesigned when the sample rate drifts by this fraction
+#define FILTER_RATE_TOLERANCE 0.05
+
+typedef enum filter_type {
+	FILTER_NONE = 0,
+	FILTER_LOWPASS,
+	FILTER_HIGHPASS,
+	FILTER_NOTCH,
+	FILTER_FIR,
+	FILTER_MEDIAN,
+} filter_type;
+
+// Stage as configured, frequencies in Hz
+typedef struct filter_stage {
+	filter_type type;
+	double freq;
+	double q;
+	int length;	// FIR taps or median window, odd
+} filter_stage;
+
+// One position in the chain, holding a stage of the same kind for every
+// lane; lanes without a stage at this position pass through
+typedef struct filter_slot {
+	filter_type kind;	// FILTER_LOWPASS for any biquad
+	filter_stage stage[FILTER_LANES];
+
+	// Biquads, transposed direct form II
+	float b0[FILTER_LANES], b1[FILTER_LANES], b2[FILTER_LANES];
+	float a1[FILTER_LANES], a2[FILTER_LANES];
+	float z1[FILTER_LANES], z2[FILTER_LANES];
+
+	// FIR, history doubled so the taps never wrap
+	int taps;
+	float coef[FILTER_MAX_TAPS][FILTER_LANES];
+	float history[2 * FILTER_MAX_TAPS][FILTER_LANES];
+	int pos;
+
+	// Moving median, per lane
+	float window[FILTER_LANES][FILTER_MAX_MEDIAN];
+	int count[FILTER_LANES];
+	int head[FILTER_LANES];
+} filter_slot;
+
+typedef struct filter_chain {
+	pthread_mutex_t lock;
+	int slots;
+	filter_slot slot[FILTER_MAX_SLOTS];
+
+	bool enabled;
+	bool reset;	// Clear state before the next block
+	double rate;	// Estimated from the block timestamps
+	double rate_time;	// Start of the current estimate (modem thread only)
+	unsigned long rate_samples;
+	double design_rate;
+	double delay[CH_COUNT];	// Group delay at low frequency, seconds
+	double ns_per_sample;
+	unsigned long samples;
+} filter_chain;
+
+void filter_chain_init(filter_chain* f);
+
+// Add stages for some channels from a specification:
+//   <channels>=<stage>[,<stage>...]
+// channels is "all", a group ("ang", "gyr", "acc", "mag") or a channel name,
+// several joined by '+'; stages are lowpass:<hz>[:q], highpass:<hz>[:q],
+// notch:<hz>[:q], fir:<taps>:<hz> and median:<n>
+// Returns -1 if the specification is invalid or the chain is full
+int filter_chain_parse(filter_chain* f, const char* spec);
+
+bool filter_chain_empty(const filter_chain* f);
+
+// Filter a block in place (modem thread)
+void filter_chain_process(filter_chain* f, sample_block* b);
+
+// Bypass or re-enable the chain
+void filter_chain_toggle(filter_chain* f);
+
+void filter_chain_status(filter_chain* f, char* out, int len);
+
+// Stages, group delay and cost per channel
+void filter_chain_report(FILE* out, filter_chain* f);
+
+#endif
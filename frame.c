@@ -0,0 +1,200 @@
+//
+// Frame parser
+// Decodes the text lines sent by the IMU firmware
+//
+// Copyright (c) 2023 Jonathan Tainer. Subject to the BSD 2-Clause License.
+//
+
+#include "frame.h"
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+
+static int hex_digit(char c) {
+	if (c >= '0' && c <= '9') return c - '0';
+	if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+	return -1;
+}
+
+frame_status frame_parse(const char* line, imu_frame* frame) {
+	memset(frame, 0, sizeof(*frame));
+
+	// Ignore trailing line endings and whitespace
+	size_t len = strlen(line);
+	while (len > 0 && isspace((unsigned char)line[len - 1]))
+		len--;
+	if (len == 0)
+		return FRAME_EMPTY;
+
+	// Verify the checksum if the firmware appended one
+	bool bad_checksum = false;
+	if (len >= 3 && line[len - 3] == '*') {
+		int hi = hex_digit(line[len - 2]);
+		int lo = hex_digit(line[len - 1]);
+		if (hi >= 0 && lo >= 0) {
+			unsigned char sum = 0;
+			for (size_t i = 0; i < len - 3; i++)
+				sum ^= (unsigned char)line[i];
+			bad_checksum = sum != (unsigned char)(hi << 4 | lo);
+			len -= 3;
+		}
+	}
+
+	char buf[256];
+	if (len >= sizeof(buf))
+		return FRAME_MALFORMED;
+	memcpy(buf, line, len);
+	buf[len] = 0;
+
+	int n = 0;
+	if (sscanf(buf, "Ang.x = %d\t\tAng.y = %d%n", &frame->ang_x, &frame->ang_y, &n) != 2)
+		return FRAME_MALFORMED;
+
+	// Optional fields, in order
+	const char* rest = buf + n;
+	unsigned int value = 0;
+	if (sscanf(rest, "\t\tT = %u%n", &value, &n) == 1) {
+		frame->has_time = true;
+		frame->ticks = value;
+		rest += n;
+	}
+	if (sscanf(rest, "\t\tN = %u%n", &value, &n) == 1) {
+		frame->has_seq = true;
+		frame->seq = value;
+		rest += n;
+	}
+	float* g = frame->gyro;
+	float* a = frame->accel;
+	float* m = frame->mag;
+	if (sscanf(rest, "\t\tG = %f %f %f\t\tA = %f %f %f\t\tM = %f %f %f%n",
+		&g[0], &g[1], &g[2], &a[0], &a[1], &a[2], &m[0], &m[1], &m[2], &n) == 9) {
+		frame->has_raw = true;
+		rest += n;
+	}
+
+	// Unknown trailing fields are tolerated so newer firmware still parses
+	return bad_checksum ? FRAME_BAD_CHECKSUM : FRAME_OK;
+}
+
+enum {
+	DECODER_TEXT = 0,
+	DECODER_SYNC,
+	DECODER_TYPE,
+	DECODER_LENGTH,
+	DECODER_PAYLOAD,
+	DECODER_CRC_LO,
+	DECODER_CRC_HI,
+};
+
+void frame_decoder_init(frame_decoder* d) {
+	memset(d, 0, sizeof(*d));
+}
+
+uint16_t frame_crc16(uint16_t crc, unsigned char c) {
+	crc ^= (uint16_t)c << 8;
+	for (int i = 0; i < 8; i++)
+		crc = (crc & 0x8000) ? (uint16_t)(crc << 1) ^ 0x1021 : (uint16_t)(crc << 1);
+	return crc;
+}
+
+frame_event frame_decoder_feed(frame_decoder* d, unsigned char c) {
+	switch (d->state) {
+	case DECODER_TEXT:
+		// Once frames are flowing, a sync byte mid-line means the line was
+		// cut short, so it starts a frame even then
+		if (c == FRAME_SYNC0 && (d->line_len == 0 || d->binary)) {
+			d->line_len = 0;
+			d->state = DECODER_SYNC;
+			return FRAME_EVENT_NONE;
+		}
+		if (c == '\n' || c == '\r') {
+			if (d->line_len < 0) {
+				// End of an overlong line that was already reported
+				d->line_len = 0;
+				return FRAME_EVENT_NONE;
+			}
+			if (d->line_len == 0)
+				return FRAME_EVENT_NONE;
+			d->line[d->line_len] = 0;
+			d->line_len = 0;
+			return FRAME_EVENT_LINE;
+		}
+		if (d->line_len < 0)
+			return FRAME_EVENT_NONE;
+		if (d->line_len >= FRAME_MAX_LINE - 1) {
+			d->line_len = -1;
+			return FRAME_EVENT_OVERFLOW;
+		}
+		d->line[d->line_len++] = (char)c;
+		return FRAME_EVENT_NONE;
+
+	case DECODER_SYNC:
+		if (c == FRAME_SYNC1) {
+			d->state = DECODER_TYPE;
+			return FRAME_EVENT_NONE;
+		}
+		// Not a frame after all, but the byte may start one: A5 A5 5A
+		d->state = DECODER_TEXT;
+		return frame_decoder_feed(d, c);
+
+	case DECODER_TYPE:
+		d->type = c;
+		d->crc = frame_crc16(0xFFFF, c);
+		d->state = DECODER_LENGTH;
+		return FRAME_EVENT_NONE;
+
+	case DECODER_LENGTH:
+		d->length = c;
+		d->payload_len = 0;
+		d->crc = frame_crc16(d->crc, c);
+		if (c > FRAME_MAX_PAYLOAD) {
+			d->state = DECODER_TEXT;
+			return FRAME_EVENT_BAD_CRC;
+		}
+		d->state = c ? DECODER_PAYLOAD : DECODER_CRC_LO;
+		return FRAME_EVENT_NONE;
+
+	case DECODER_PAYLOAD:
+		d->payload[d->payload_len++] = c;
+		d->crc = frame_crc16(d->crc, c);
+		if (d->payload_len == d->length)
+			d->state = DECODER_CRC_LO;
+		return FRAME_EVENT_NONE;
+
+	case DECODER_CRC_LO:
+		d->crc ^= c;
+		d->state = DECODER_CRC_HI;
+		return FRAME_EVENT_NONE;
+
+	case DECODER_CRC_HI:
+		d->crc ^= (uint16_t)c << 8;
+		d->state = DECODER_TEXT;
+		if (d->crc != 0)
+			return FRAME_EVENT_BAD_CRC;
+		d->binary = true;
+		return FRAME_EVENT_BINARY;
+	}
+	d->state = DECODER_TEXT;
+	return FRAME_EVENT_NONE;
+}
+
+static uint32_t read_le(const unsigned char* p, int bytes) {
+	uint32_t value = 0;
+	for (int i = bytes - 1; i >= 0; i--)
+		value = value << 8 | p[i];
+	return value;
+}
+
+frame_status frame_decode_binary(const frame_decoder* d, imu_frame* frame) {
+	memset(frame, 0, sizeof(*frame));
+	if (d->type != FRAME_TYPE_SAMPLE || d->length < 12)
+		return FRAME_MALFORMED;
+	frame->ang_x = (int16_t)read_le(d->payload, 2);
+	frame->ang_y = (int16_t)read_le(d->payload + 2, 2);
+	frame->has_time = true;
+	frame->ticks = read_le(d->payload + 4, 4);
+	frame->has_seq = true;
+	frame->seq = read_le(d->payload + 8, 4);
+	return FRAME_OK;
+}
@@ -0,0 +1,84 @@
+//
+// Frame parser
+// Decodes the text lines sent by the IMU firmware
+//
+// Copyright (c) 2023 Jonathan Tainer. Subject to the BSD 2-Clause License.
+//
+
+#ifndef FRAME_H
+#define FRAME_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef enum frame_status {
+	FRAME_OK = 0,
+	FRAME_EMPTY,		// Blank line, ignored
+	FRAME_MALFORMED,	// Line didn't convert
+	FRAME_BAD_CHECKSUM,	// Line converted but the checksum didn't match
+} frame_status;
+
+typedef struct imu_frame {
+	int ang_x;
+	int ang_y;
+	bool has_time;
+	uint32_t ticks;		// Device timestamp, microseconds
+	bool has_seq;
+	uint32_t seq;		// Frame sequence number
+	bool has_raw;
+	float gyro[3];		// Raw sensor readings in firmware units
+	float accel[3];
+	float mag[3];
+} imu_frame;
+
+// Parse a line of the form
+//   Ang.x = <int>\t\tAng.y = <int>[\t\tT = <uint>][\t\tN = <uint>]
+//     [\t\tG = <x> <y> <z>\t\tA = <x> <y> <z>\t\tM = <x> <y> <z>][*<hex>]
+// where the optional trailing checksum is the XOR of all characters before '*'
+frame_status frame_parse(const char* line, imu_frame* frame);
+
+// Binary frames, used once the firmware is switched to compact output:
+//   0xA5 0x5A <type> <length> <payload...> <crc16 lo> <crc16 hi>
+// The CRC is CRC-16/CCITT-FALSE over type, length and payload
+// Text lines never contain the sync byte, so both kinds can be interleaved
+#define FRAME_SYNC0 0xA5
+#define FRAME_SYNC1 0x5A
+#define FRAME_MAX_PAYLOAD 64
+#define FRAME_MAX_LINE 256
+
+// Sample payload: int16 ang_x, int16 ang_y (degrees), uint32 ticks, uint32 seq,
+// all little-endian
+#define FRAME_TYPE_SAMPLE 0x01
+
+typedef enum frame_event {
+	FRAME_EVENT_NONE = 0,
+	FRAME_EVENT_LINE,	// Complete text line in decoder.line
+	FRAME_EVENT_BINARY,	// Complete binary frame in decoder.type/payload/length
+	FRAME_EVENT_BAD_CRC,	// Binary frame discarded
+	FRAME_EVENT_OVERFLOW,	// Text line too long, discarded
+} frame_event;
+
+// Splits the raw byte stream into text lines and binary frames
+typedef struct frame_decoder {
+	int state;
+	bool binary;	// A good binary frame has been seen
+	char line[FRAME_MAX_LINE];
+	int line_len;
+	unsigned char type;
+	unsigned char length;
+	unsigned char payload[FRAME_MAX_PAYLOAD];
+	int payload_len;
+	uint16_t crc;
+} frame_decoder;
+
+void frame_decoder_init(frame_decoder* d);
+
+// Feed one byte, returns an event when a line or frame completes
+frame_event frame_decoder_feed(frame_decoder* d, unsigned char c);
+
+// Decode a binary frame into a sample
+frame_status frame_decode_binary(const frame_decoder* d, imu_frame* frame);
+
+uint16_t frame_crc16(uint16_t crc, unsigned char c);
+
+#endif
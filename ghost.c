@@ -0,0 +1,133 @@
+//
+// Ghosts
+// Fading copies of the device at past orientations, with a trail of its tip
+//
+// Copyright (c) 2023 Jonathan Tainer. Subject to the BSD 2-Clause License.
+//
+
+#include "ghost.h"
+#include <raymath.h>
+#include <rlgl.h>
+#include <stdlib.h>
+
+// Instances come oldest first, so the age of each is its index
+static const char* ghost_vs =
+	"#version 330\n"
+	"in vec3 vertexPosition;\n"
+	"in vec3 vertexNormal;\n"
+	"in mat4 instanceTransform;\n"
+	"uniform mat4 mvp;\n"
+	"uniform int ghostCount;\n"
+	"out vec3 fragNormal;\n"
+	"out float fragFade;\n"
+	"void main() {\n"
+	"	float fade = float(gl_InstanceID + 1) / float(ghostCount);\n"
+	"	fragFade = fade * fade;\n"
+	"	fragNormal = mat3(instanceTransform) * vertexNormal;\n"
+	"	gl_Position = mvp * instanceTransform * vec4(vertexPosition, 1.0);\n"
+	"}\n";
+
+static const char* ghost_fs =
+	"#version 330\n"
+	"in vec3 fragNormal;\n"
+	"in float fragFade;\n"
+	"uniform vec4 colDiffuse;\n"
+	"out vec4 finalColor;\n"
+	"void main() {\n"
+	"	float light = 0.6 + 0.4 * max(dot(normalize(fragNormal), normalize(vec3(-0.4, 1.0, -0.3))), 0.0);\n"
+	"	finalColor = vec4(colDiffuse.rgb * light, colDiffuse.a * fragFade);\n"
+	"}\n";
+
+int ghost_init(ghost_trail* g, int count, double span) {
+	*g = (ghost_trail) { 0 };
+	if (count < 1 || count > GHOST_MAX || span <= 0.0)
+		return -1;
+	g->capacity = count;
+	g->spacing = span / count;
+	g->ring = malloc(count * sizeof(Matrix));
+	g->ordered = malloc(count * sizeof(Matrix));
+	g->tips = malloc(count * sizeof(Vector3));
+	if (!g->ring || !g->ordered || !g->tips) {
+		free(g->ring);
+		free(g->ordered);
+		free(g->tips);
+		*g = (ghost_trail) { 0 };
+		return -1;
+	}
+
+	g->mesh = GenMeshCube(1.f, 1.f, 1.f);
+	Shader shader = LoadShaderFromMemory(ghost_vs, ghost_fs);
+	shader.locs[SHADER_LOC_MATRIX_MVP] = GetShaderLocation(shader, "mvp");
+	shader.locs[SHADER_LOC_MATRIX_MODEL] = GetShaderLocationAttrib(shader, "instanceTransform");
+	g->count_loc = GetShaderLocation(shader, "ghostCount");
+	g->material = LoadMaterialDefault();
+	g->material.shader = shader;
+	return 0;
+}
+
+void ghost_unload(ghost_trail* g) {
+	if (g->capacity == 0)
+		return;
+	UnloadMaterial(g->material);	// Also the shader
+	UnloadMesh(g->mesh);
+	free(g->ring);
+	free(g->ordered);
+	free(g->tips);
+	*g = (ghost_trail) { 0 };
+}
+
+void ghost_update(ghost_trail* g, sample_history* h, double time, ghost_pose pose) {
+	if (!g->visible || g->capacity == 0)
+		return;
+	// After a pause only the last span is worth sampling
+	const double earliest = time - (g->capacity - 1) * g->spacing;
+	if (g->next_time < earliest)
+		g->next_time = earliest;
+	bool added = false;
+	while (g->next_time <= time) {
+		imu_sample s;
+		if (!sample_history_at(h, g->next_time, &s))
+			break;
+		g->ring[g->head] = pose(&s);
+		g->head = (g->head + 1) % g->capacity;
+		if (g->count < g->capacity)
+			g->count++;
+		g->next_time += g->spacing;
+		added = true;
+	}
+	if (!added)
+		return;
+
+	// Unrolled once here rather than in each view
+	const int oldest = (g->head - g->count + g->capacity) % g->capacity;
+	for (int i = 0; i < g->count; i++) {
+		g->ordered[i] = g->ring[(oldest + i) % g->capacity];
+		g->tips[i] = Vector3Transform(GHOST_TIP, g->ordered[i]);
+	}
+}
+
+void ghost_draw(const ghost_trail* g, Color color, Color trail) {
+	if (!g->visible || g->count == 0)
+		return;
+
+	// Translucent, so they neither hide each other nor the trail
+	Material material = g->material;
+	material.maps[MATERIAL_MAP_DIFFUSE].color = ColorAlpha(color, GHOST_ALPHA);
+	SetShaderValue(material.shader, g->count_loc, &g->count, SHADER_UNIFORM_INT);
+	rlDrawRenderBatchActive();
+	rlDisableDepthMask();
+	DrawMeshInstanced(g->mesh, material, g->ordered, g->count);
+	rlEnableDepthMask();
+
+	// All segments go into the line batch, drawn with one call
+	rlBegin(RL_LINES);
+	for (int i = 1; i < g->count; i++) {
+		const float a0 = (float)i / g->count;
+		const float a1 = (float)(i + 1) / g->count;
+		rlColor4ub(trail.r, trail.g, trail.b, (unsigned char)(trail.a * a0));
+		rlVertex3f(g->tips[i - 1].x, g->tips[i - 1].y, g->tips[i - 1].z);
+		rlColor4ub(trail.r, trail.g, trail.b, (unsigned char)(trail.a * a1));
+		rlVertex3f(g->tips[i].x, g->tips[i].y, g->tips[i].z);
+	}
+	rlEnd();
+}
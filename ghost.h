@@ -0,0 +1,58 @@
+//
+// Ghosts
+// Fading copies of the device at past orientations, with a trail of its tip
+//
+// Copyright (c) 2023 Jonathan Tainer. Subject to the BSD 2-Clause License.
+//
+
+#ifndef GHOST_H
+#define GHOST_H
+
+#include <stdbool.h>
+#include <raylib.h>
+#include "sample.h"
+
+#define GHOST_MAX 4096
+#define GHOST_DEFAULT_COUNT 64
+#define GHOST_DEFAULT_SPAN 1.0
+
+// Opacity of the newest ghost; older ones fade out towards zero
+#define GHOST_ALPHA 0.35f
+
+// Point of the device traced by the trail, in its own frame
+#define GHOST_TIP ((Vector3) { 0.f, 1.f, 0.f })
+
+// Transform of the device for a sample
+typedef Matrix (*ghost_pose)(const imu_sample* s);
+
+// The device every span / capacity seconds over the last span, in a ring
+typedef struct ghost_trail {
+	bool visible;
+	int capacity;
+	double spacing;	// Seconds between ghosts
+	double next_time;	// Host time of the next ghost, 0 before the first
+
+	Matrix* ring;
+	int head;	// Next slot written
+	int count;
+	Matrix* ordered;	// Oldest first, instance i fading with its age
+	Vector3* tips;	// Of the ordered ghosts
+
+	Mesh mesh;
+	Material material;
+	int count_loc;
+} ghost_trail;
+
+// Needs a window; returns -1 if count is out of range or allocation fails
+int ghost_init(ghost_trail* g, int count, double span);
+
+void ghost_unload(ghost_trail* g);
+
+// Add the ghosts due by the time, sampled from the device's history
+void ghost_update(ghost_trail* g, sample_history* h, double time, ghost_pose pose);
+
+// Inside a 3D view after the opaque geometry: the ghosts in one instanced
+// call, then the trail as one batch of lines
+void ghost_draw(const ghost_trail* g, Color color, Color trail);
+
+#endif
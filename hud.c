@@ -0,0 +1,380 @@
+//
+// HUD
+// Overlay text composed without printf and drawn in one call per frame
+//
+// Copyright (c) 2023 Jonathan Tainer. Subject to the BSD 2-Clause License.
+//
+
+#include "hud.h"
+#include <raymath.h>
+#include <rlgl.h>
+#include <GL/gl.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+// Smallest size DrawText accepts, which also sets its letter spacing
+#define HUD_MIN_SIZE 10.f
+
+// Distance between lines as a multiple of the size
+#define HUD_LINE_SPACING 2.f
+
+#define HUD_VERTICES_PER_GLYPH 6
+
+// Composed numbers stay exact while scaled by a power of ten a double holds
+// exactly and rounded below 2^52, where halves are still representable
+#define HUD_MAX_POWER 22
+#define HUD_MAX_DIGITS 15
+
+static const char* hud_vs =
+	"#version 330\n"
+	"in vec2 vertexPosition;\n"
+	"in vec2 vertexTexCoord;\n"
+	"in vec4 vertexColor;\n"
+	"uniform mat4 mvp;\n"
+	"out vec2 fragTexCoord;\n"
+	"out vec4 fragColor;\n"
+	"void main() {\n"
+	"	fragTexCoord = vertexTexCoord;\n"
+	"	fragColor = vertexColor;\n"
+	"	gl_Position = mvp * vec4(vertexPosition, 0.0, 1.0);\n"
+	"}\n";
+
+static const char* hud_fs =
+	"#version 330\n"
+	"in vec2 fragTexCoord;\n"
+	"in vec4 fragColor;\n"
+	"uniform sampler2D texture0;\n"
+	"out vec4 finalColor;\n"
+	"void main() {\n"
+	"	finalColor = texture(texture0, fragTexCoord) * fragColor;\n"
+	"}\n";
+
+int hud_init(hud* h) {
+	*h = (hud) { 0 };
+	h->vertices = malloc(HUD_MAX_GLYPHS * HUD_VERTICES_PER_GLYPH * sizeof(hud_vertex));
+	if (!h->vertices)
+		return -1;
+
+	// The quads DrawText would make for each character, looked up once
+	// rather than searched for per character and frame
+	h->font = GetFontDefault();
+	const float pad = (float)h->font.glyphPadding;
+	const float tw = (float)h->font.texture.width;
+	const float th = (float)h->font.texture.height;
+	for (int c = HUD_FIRST_CHAR; c <= HUD_LAST_CHAR; c++) {
+		const int i = GetGlyphIndex(h->font, c);
+		const Rectangle r = h->font.recs[i];
+		const GlyphInfo info = h->font.glyphs[i];
+		h->glyph[c - HUD_FIRST_CHAR] = (hud_glyph) {
+			.x = info.offsetX - pad,
+			.y = info.offsetY - pad,
+			.width = r.width + 2 * pad,
+			.height = r.height + 2 * pad,
+			.u0 = (r.x - pad) / tw,
+			.v0 = (r.y - pad) / th,
+			.u1 = (r.x + r.width + pad) / tw,
+			.v1 = (r.y + r.height + pad) / th,
+			.advance = info.advanceX != 0 ? (float)info.advanceX : r.width,
+		};
+	}
+
+	h->shader = LoadShaderFromMemory(hud_vs, hud_fs);
+	h->vao = rlLoadVertexArray();
+	rlEnableVertexArray(h->vao);
+	h->vbo = rlLoadVertexBuffer(NULL, HUD_MAX_GLYPHS * HUD_VERTICES_PER_GLYPH * sizeof(hud_vertex), true);
+	const int position = h->shader.locs[SHADER_LOC_VERTEX_POSITION];
+	const int texcoord = h->shader.locs[SHADER_LOC_VERTEX_TEXCOORD01];
+	const int color = h->shader.locs[SHADER_LOC_VERTEX_COLOR];
+	rlSetVertexAttribute(position, 2, GL_FLOAT, false, sizeof(hud_vertex), (void*)offsetof(hud_vertex, position));
+	rlEnableVertexAttribute(position);
+	rlSetVertexAttribute(texcoord, 2, GL_FLOAT, false, sizeof(hud_vertex), (void*)offsetof(hud_vertex, texcoord));
+	rlEnableVertexAttribute(texcoord);
+	rlSetVertexAttribute(color, 4, GL_UNSIGNED_BYTE, true, sizeof(hud_vertex), (void*)offsetof(hud_vertex, color));
+	rlEnableVertexAttribute(color);
+	rlDisableVertexArray();
+	return 0;
+}
+
+void hud_unload(hud* h) {
+	if (!h->vertices)
+		return;
+	rlUnloadVertexArray(h->vao);
+	rlUnloadVertexBuffer(h->vbo);
+	UnloadShader(h->shader);
+	free(h->vertices);
+	*h = (hud) { 0 };
+}
+
+static const hud_glyph* glyph_of(const hud* h, char c) {
+	if (c < HUD_FIRST_CHAR || c > HUD_LAST_CHAR)
+		c = '?';
+	return &h->glyph[c - HUD_FIRST_CHAR];
+}
+
+static void push_glyph(hud* h, const hud_glyph* g, float x, float y, float scale, Color color) {
+	if (h->glyphs == HUD_MAX_GLYPHS) {
+		h->dropped++;
+		return;
+	}
+	const float x0 = x + g->x * scale;
+	const float y0 = y + g->y * scale;
+	const float x1 = x0 + g->width * scale;
+	const float y1 = y0 + g->height * scale;
+	const hud_vertex corner[4] = {
+		{ { x0, y0 }, { g->u0, g->v0 }, { color.r, color.g, color.b, color.a } },
+		{ { x0, y1 }, { g->u0, g->v1 }, { color.r, color.g, color.b, color.a } },
+		{ { x1, y1 }, { g->u1, g->v1 }, { color.r, color.g, color.b, color.a } },
+		{ { x1, y0 }, { g->u1, g->v0 }, { color.r, color.g, color.b, color.a } },
+	};
+	hud_vertex* v = &h->vertices[h->glyphs * HUD_VERTICES_PER_GLYPH];
+	v[0] = corner[0];
+	v[1] = corner[1];
+	v[2] = corner[2];
+	v[3] = corner[0];
+	v[4] = corner[2];
+	v[5] = corner[3];
+	h->glyphs++;
+}
+
+float hud_text(hud* h, const char* text, float x, float y, float size, Color color) {
+	size = fmaxf(size, HUD_MIN_SIZE);
+	const float scale = size / h->font.baseSize;
+	const float spacing = size / HUD_MIN_SIZE;
+	const float left = x;
+	for (const char* c = text; *c; c++) {
+		if (*c == '\n') {
+			x = left;
+			y += HUD_LINE_SPACING * size;
+			continue;
+		}
+		const hud_glyph* g = glyph_of(h, *c);
+		if (*c != ' ')
+			push_glyph(h, g, x, y, scale, color);
+		x += g->advance * scale + spacing;
+	}
+	return x;
+}
+
+void hud_flush(hud* h) {
+	if (h->glyphs == 0)
+		return;
+	// Anything batched so far goes underneath
+	rlDrawRenderBatchActive();
+	rlUpdateVertexBuffer(h->vbo, h->vertices, h->glyphs * HUD_VERTICES_PER_GLYPH * sizeof(hud_vertex), 0);
+	const Matrix mvp = MatrixMultiply(MatrixMultiply(rlGetMatrixTransform(), rlGetMatrixModelview()), rlGetMatrixProjection());
+	rlEnableShader(h->shader.id);
+	rlSetUniformMatrix(h->shader.locs[SHADER_LOC_MATRIX_MVP], mvp);
+	rlActiveTextureSlot(0);
+	rlEnableTexture(h->font.texture.id);
+	rlEnableVertexArray(h->vao);
+	glDrawArrays(GL_TRIANGLES, 0, h->glyphs * HUD_VERTICES_PER_GLYPH);
+	rlDisableVertexArray();
+	rlDisableTexture();
+	rlDisableShader();
+	h->glyphs = 0;
+	h->dropped = 0;
+}
+
+static const double powers[HUD_MAX_POWER + 1] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+// Nearest integer to value * 10^power, rounded as printf rounds: a result
+// that lands halfway only through its own rounding error goes the way the
+// error says, and exact halves go to even. The power is at most
+// HUD_MAX_POWER either way and the result under 2^52
+static double round_scaled(double value, int power) {
+	const double unit = powers[abs(power)];
+	double p;
+	double error;	// Sign of the exact result less p
+	if (power >= 0) {
+		p = value * unit;
+		error = fma(value, unit, -p);
+	}
+	else {
+		p = value / unit;
+		error = fma(-p, unit, value);
+	}
+	const double f = floor(p);
+	if (p - f != 0.5)
+		return p - f > 0.5 ? f + 1.0 : f;
+	if (error != 0.0)
+		return error > 0.0 ? f + 1.0 : f;
+	return fmod(f, 2.0) == 0.0 ? f : f + 1.0;
+}
+
+static void put(hud_line* l, char c) {
+	if (l->length < HUD_LINE_MAX - 1) {
+		l->text[l->length++] = c;
+		l->text[l->length] = '\0';
+	}
+}
+
+void hud_line_clear(hud_line* l) {
+	l->length = 0;
+	l->text[0] = '\0';
+}
+
+void hud_line_text(hud_line* l, const char* text) {
+	while (*text)
+		put(l, *text++);
+}
+
+void hud_line_uint(hud_line* l, unsigned long value) {
+	char digits[24];
+	int n = 0;
+	do {
+		digits[n++] = (char)('0' + value % 10);
+		value /= 10;
+	} while (value > 0);
+	while (n > 0)
+		put(l, digits[--n]);
+}
+
+void hud_line_int(hud_line* l, long value) {
+	if (value < 0) {
+		put(l, '-');
+		hud_line_uint(l, -(unsigned long)value);
+	}
+	else
+		hud_line_uint(l, (unsigned long)value);
+}
+
+// Infinities and NaN as printf spells them; returns true if it was one
+static bool put_special(hud_line* l, double value) {
+	if (isnan(value))
+		hud_line_text(l, signbit(value) ? "-nan" : "nan");
+	else if (isinf(value))
+		hud_line_text(l, value < 0.0 ? "-inf" : "inf");
+	else
+		return false;
+	return true;
+}
+
+// Out of the range composed exactly
+static void put_printf(hud_line* l, const char* format, int precision, double value) {
+	char text[HUD_LINE_MAX];
+	snprintf(text, sizeof(text), format, precision, value);
+	hud_line_text(l, text);
+}
+
+void hud_line_fixed(hud_line* l, double value, int decimals) {
+	if (put_special(l, value))
+		return;
+	decimals = decimals < 0 ? 0 : decimals;
+	const double magnitude = fabs(value);
+	if (decimals > HUD_MAX_DIGITS || magnitude >= 1.8e19) {
+		put_printf(l, "%.*f", decimals, value);
+		return;
+	}
+	// The whole part is exact, and the fraction under 1 scales below 10^15;
+	// a half with no decimals goes to the even whole
+	double whole = floor(magnitude);
+	double fraction = decimals == 0 ? round_scaled(magnitude, 0) - whole : round_scaled(magnitude - whole, decimals);
+	if (fraction >= powers[decimals]) {
+		whole += 1.0;
+		fraction -= powers[decimals];
+	}
+	if (signbit(value))
+		put(l, '-');
+	hud_line_uint(l, (unsigned long)whole);
+	if (decimals == 0)
+		return;
+	put(l, '.');
+	const unsigned long f = (unsigned long)fraction;
+	for (unsigned long d = (unsigned long)powers[decimals - 1]; d > 0; d /= 10)
+		put(l, (char)('0' + f / d % 10));
+}
+
+void hud_line_general(hud_line* l, double value, int digits) {
+	if (put_special(l, value))
+		return;
+	if (value == 0.0) {
+		hud_line_text(l, signbit(value) ? "-0" : "0");
+		return;
+	}
+	digits = digits < 1 ? 1 : digits;
+	if (digits > HUD_MAX_DIGITS) {
+		put_printf(l, "%.*g", digits, value);
+		return;
+	}
+	const double magnitude = fabs(value);
+
+	// The digits as an integer, with the exponent of the first; log10 can
+	// be one off next to a power of ten and rounding can carry into a new
+	// digit, so settle the exponent on the rounded digits
+	int exponent = (int)floor(log10(magnitude));
+	double mantissa = 0.0;
+	for (int pass = 0; pass < 3; pass++) {
+		const int power = digits - 1 - exponent;
+		if (abs(power) > HUD_MAX_POWER) {
+			put_printf(l, "%.*g", digits, value);
+			return;
+		}
+		mantissa = round_scaled(magnitude, power);
+		if (mantissa >= powers[digits])
+			exponent++;
+		else if (mantissa < powers[digits - 1])
+			exponent--;
+		else
+			break;
+	}
+
+	char m[HUD_MAX_DIGITS];
+	unsigned long n = (unsigned long)mantissa;
+	for (int i = digits - 1; i >= 0; i--) {
+		m[i] = (char)('0' + n % 10);
+		n /= 10;
+	}
+	// Trailing zeros are dropped
+	int significant = digits;
+	while (significant > 1 && m[significant - 1] == '0')
+		significant--;
+
+	if (value < 0.0)
+		put(l, '-');
+	if (exponent < -4 || exponent >= digits) {
+		put(l, m[0]);
+		if (significant > 1)
+			put(l, '.');
+		for (int i = 1; i < significant; i++)
+			put(l, m[i]);
+		put(l, 'e');
+		put(l, exponent < 0 ? '-' : '+');
+		const int e = abs(exponent);
+		if (e < 10)
+			put(l, '0');
+		hud_line_uint(l, (unsigned long)e);
+	}
+	else if (exponent >= 0) {
+		for (int i = 0; i <= exponent; i++)
+			put(l, m[i]);
+		if (significant > exponent + 1)
+			put(l, '.');
+		for (int i = exponent + 1; i < significant; i++)
+			put(l, m[i]);
+	}
+	else {
+		hud_line_text(l, "0.");
+		for (int i = -1; i > exponent; i--)
+			put(l, '0');
+		for (int i = 0; i < significant; i++)
+			put(l, m[i]);
+	}
+}
+
+void hud_line_pad(hud_line* l, int start, int width) {
+	const int n = l->length - start;
+	int shift = width - n;
+	if (shift <= 0)
+		return;
+	if (l->length + shift > HUD_LINE_MAX - 1)
+		shift = HUD_LINE_MAX - 1 - l->length;
+	memmove(l->text + start + shift, l->text + start, n + 1);
+	memset(l->text + start, ' ', shift);
+	l->length += shift;
+}
@@ -0,0 +1,89 @@
+//
+// HUD
+// Overlay text composed without printf and drawn in one call per frame
+//
+// Copyright (c) 2023 Jonathan Tainer. Subject to the BSD 2-Clause License.
+//
+
+#ifndef HUD_H
+#define HUD_H
+
+#include <stdbool.h>
+#include <raylib.h>
+
+// Glyphs drawn per frame; text past this is left out
+#define HUD_MAX_GLYPHS 8192
+
+#define HUD_FIRST_CHAR 32
+#define HUD_LAST_CHAR 126
+
+// Longest line composed with hud_line
+#define HUD_LINE_MAX 256
+
+// Quad of a glyph in font pixels, with its place in the atlas
+typedef struct hud_glyph {
+	float x;	// Offset from the pen
+	float y;
+	float width;
+	float height;
+	float u0;
+	float v0;
+	float u1;
+	float v1;
+	float advance;
+} hud_glyph;
+
+typedef struct hud_vertex {
+	float position[2];
+	float texcoord[2];
+	unsigned char color[4];
+} hud_vertex;
+
+typedef struct hud {
+	Font font;	// raylib's default font; its texture is the atlas
+	hud_glyph glyph[HUD_LAST_CHAR - HUD_FIRST_CHAR + 1];
+	Shader shader;
+	unsigned int vao;
+	unsigned int vbo;
+	hud_vertex* vertices;
+	int glyphs;	// Queued this frame
+	int dropped;	// Past HUD_MAX_GLYPHS this frame
+} hud;
+
+// Text built up piece by piece, truncated at HUD_LINE_MAX - 1 characters
+typedef struct hud_line {
+	char text[HUD_LINE_MAX];
+	int length;
+} hud_line;
+
+// Needs a window; returns -1 if allocation fails
+int hud_init(hud* h);
+
+void hud_unload(hud* h);
+
+// Queue text at a pixel size, as DrawText would place it; \n starts a new
+// line. Returns the x the pen ended at
+float hud_text(hud* h, const char* text, float x, float y, float size, Color color);
+
+// Draw everything queued since the last call in one call, over whatever
+// has been drawn so far, and start over
+void hud_flush(hud* h);
+
+void hud_line_clear(hud_line* l);
+void hud_line_text(hud_line* l, const char* text);
+void hud_line_uint(hud_line* l, unsigned long value);
+void hud_line_int(hud_line* l, long value);
+
+// Fixed point with the given decimals, like %.Nf. Composed for up to 15
+// decimals and magnitudes under 1.8e19, through snprintf past those
+void hud_line_fixed(hud_line* l, double value, int decimals);
+
+// At most digits significant digits without trailing zeros, in scientific
+// notation when very large or small, like %.Ng. Composed for up to 15
+// digits and magnitudes from 1e-8 to 1e22, through snprintf past those
+void hud_line_general(hud_line* l, double value, int digits);
+
+// Right-align whatever was added since length start in width characters
+void hud_line_pad(hud_line* l, int start, int width);
+
+#endif
@@ -0,0 +1,69 @@
+//
+// HUD test
+// Compares the composed numbers with snprintf, which they must match
+//
+// Copyright (c) 2023 Jonathan Tainer. Subject to the BSD 2-Clause License.
+//
+
+#include "hud.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#define RANDOM_VALUES 200000
+
+static int mismatches = 0;
+
+static void check(const char* format, int precision, double value) {
+	hud_line l;
+	hud_line_clear(&l);
+	if (format[strlen(format) - 1] == 'f')
+		hud_line_fixed(&l, value, precision);
+	else
+		hud_line_general(&l, value, precision);
+	char expected[HUD_LINE_MAX];
+	snprintf(expected, sizeof(expected), format, precision, value);
+	if (strcmp(l.text, expected) != 0) {
+		if (mismatches < 20)
+			printf("%s of %.17g with %d: %s, expected %s\n", format, value, precision, l.text, expected);
+		mismatches++;
+	}
+}
+
+// Both formats at every precision
+static void check_all(double value) {
+	for (int p = 0; p <= 17; p++) {
+		check("%.*f", p, value);
+		check("%.*g", p, value);
+	}
+}
+
+int main(void) {
+	// Halves, exact and from rounding, carries, powers of ten and the
+	// edges of the composed ranges
+	const double cases[] = {
+		0.0, -0.0, 0.5, 1.5, 2.5, -2.5, 0.125, 0.375, 0.05, 0.15, 0.25, 0.35,
+		1.005, 2.675, 9.5, 9.95, 9.995, 99.5, 999999.5, 9999995.0, 0.0040793676,
+		1e-8, 1e-5, 1e-4, 9.9999e-5, 0.1, 1.0, 10.0, 1e15, 1e16, 1e22, 1e23,
+		999999999999999.9, 4503599627370495.5, 9007199254740993.0, 1.8e19, 1.9e19,
+		1e300, 5e-324, 123456789.123456789, -0.00049999, 0.00095, NAN, INFINITY, -INFINITY,
+	};
+	for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+		check_all(cases[i]);
+		check_all(-cases[i]);
+	}
+
+	// Random values over many magnitudes, some on round decimals
+	srand(1);
+	for (int i = 0; i < RANDOM_VALUES; i++) {
+		double v = (rand() / (double)RAND_MAX - 0.5) * pow(10.0, rand() % 40 - 20);
+		if (rand() % 4 == 0)
+			v = round(v * 1000.0) / 1000.0;
+		check("%.*f", rand() % 16, v);
+		check("%.*g", 1 + rand() % 15, v);
+	}
+
+	printf("%d mismatches\n", mismatches);
+	return mismatches == 0 ? 0 : 1;
+}
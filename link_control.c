@@ -0,0 +1,73 @@
+//
+// Link control
+// Adjusts the firmware output rate and format to the serial link headroom
+//
+// Copyright (c) 2023 Jonathan Tainer. Subject to the BSD 2-Clause License.
+//
+
+#include "link_control.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+void link_control_init(link_control* lc, command_channel* ch, double capacity, int max_rate) {
+	memset(lc, 0, sizeof(*lc));
+	lc->ch = ch;
+	lc->capacity = capacity;
+	lc->max_rate = max_rate;
+}
+
+static void link_rate_done(void* user, command_status status, const char* request, const char* response) {
+	link_control* lc = user;
+	lc->busy = false;
+	if (status == COMMAND_OK)
+		lc->rate = atoi(request + strlen("RATE "));
+	printf("%s: %s %s\n", request, status == COMMAND_OK ? "OK" : "failed", response);
+}
+
+static void link_mode_done(void* user, command_status status, const char* request, const char* response) {
+	link_control* lc = user;
+	lc->busy = false;
+	if (status == COMMAND_OK)
+		lc->binary = strcmp(request, "MODE BINARY") == 0;
+	printf("%s: %s %s\n", request, status == COMMAND_OK ? "OK" : "failed", response);
+}
+
+void link_control_set_rate(link_control* lc, int rate) {
+	char request[32];
+	snprintf(request, sizeof(request), "RATE %d", rate);
+	lc->busy = command_send(lc->ch, request, COMMAND_DEFAULT_TIMEOUT, link_rate_done, lc) >= 0;
+}
+
+void link_control_set_binary(link_control* lc, bool binary) {
+	const char* request = binary ? "MODE BINARY" : "MODE TEXT";
+	lc->busy = command_send(lc->ch, request, COMMAND_DEFAULT_TIMEOUT, link_mode_done, lc) >= 0;
+}
+
+void link_control_update(link_control* lc, stream_stats* stats, double now) {
+	if (lc->max_rate <= 0 || lc->busy || now < lc->next_check)
+		return;
+	lc->next_check = now + LINK_CHECK_PERIOD;
+
+	stream_stats s;
+	stream_stats_snapshot(stats, now, &s);
+	stats_bucket window = { 0 };
+	stream_stats_window(&s, 10, &window);
+	double rate = window.counts.frames / 10.0;
+	double utilization = window.counts.bytes / 10.0 / lc->capacity;
+	if (rate <= 0.0)
+		return;
+	if (lc->rate == 0)
+		lc->rate = (int)(rate + 0.5);
+
+	if (utilization > LINK_HIGH_WATER && !lc->binary) {
+		link_control_set_binary(lc, true);
+	}
+	else if (utilization > LINK_HIGH_WATER && lc->rate / 2 >= LINK_MIN_RATE) {
+		link_control_set_rate(lc, lc->rate / 2);
+	}
+	else if (utilization < LINK_LOW_WATER && lc->rate < lc->max_rate) {
+		int next = lc->rate * 2;
+		link_control_set_rate(lc, next < lc->max_rate ? next : lc->max_rate);
+	}
+}
@@ -0,0 +1,45 @@
+//
+// Link control
+// Adjusts the firmware output rate and format to the serial link headroom
+//
+// Copyright (c) 2023 Jonathan Tainer. Subject to the BSD 2-Clause License.
+//
+
+#ifndef LINK_CONTROL_H
+#define LINK_CONTROL_H
+
+#include <stdbool.h>
+#include "command.h"
+#include "stream_stats.h"
+
+// Seconds between decisions, long enough for the previous change to show up
+// in the 10 s statistics window
+#define LINK_CHECK_PERIOD 12.0
+
+// Utilization thresholds, fraction of line capacity
+#define LINK_LOW_WATER 0.35
+#define LINK_HIGH_WATER 0.8
+
+#define LINK_MIN_RATE 10
+
+typedef struct link_control {
+	command_channel* ch;
+	double capacity;	// Bytes per second the line can carry
+	int max_rate;		// Highest sample rate to request, 0 to never change rate
+	int rate;		// Last rate acknowledged by the firmware, 0 if unknown
+	bool binary;		// Firmware is sending binary frames
+	bool busy;		// Request in flight
+	double next_check;
+} link_control;
+
+void link_control_init(link_control* lc, command_channel* ch, double capacity, int max_rate);
+
+// Request a rate or output mode, tracking the firmware state on success
+void link_control_set_rate(link_control* lc, int rate);
+void link_control_set_binary(link_control* lc, bool binary);
+
+// Periodic policy: switch to binary output when text saturates the link,
+// raise the rate while there is headroom and back off when saturated
+void link_control_update(link_control* lc, stream_stats* stats, double now);
+
+#endif
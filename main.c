@@ -13,11 +13,46 @@
 #include <stdio.h>
 #include <unistd.h>
 #include <pthread.h>
+#include <getopt.h>
+#include <stdlib.h>
+#include <string.h>
+#include <poll.h>
 #include <raylib.h>
 #include <raymath.h>
 #include <math.h>
+#include "clock_sync.h"
+#include "sample.h"
+#include "frame.h"
+#include "stream_stats.h"
+#include "overlay.h"
+#include "realtime.h"
+#include "serial_tune.h"
+#include "command.h"
+#include "link_control.h"
+#include "calibration.h"
+#include "allan.h"
+#include "spectrum.h"
+#include "filter.h"
+#include "resample.h"
+#include "capture.h"
+#include "channel_stats.h"
+#include "outlier.h"
+#include "device.h"
+#include "skeleton.h"
+#include "event.h"
+#include "swarm.h"
+#include "wireframe.h"
+#include "mesh_cache.h"
+#include "scene.h"
+#include "render_wake.h"
+#include "viewport.h"
+#include "video.h"
+#include "resolution.h"
+#include "ghost.h"
+#include "hud.h"
 
 #define BAUDRATE B38400
+#define LINE_BYTES_PER_SEC (38400 / 10) // 8N1 framing
 #define _POSIX_SOURCE 1 // POSIX compliant source
 
 #define RAYLIB_5_0
@@ -25,95 +60,911 @@
 volatile int modem_thread_stop = 0;
 int modem_fd = 0;
 
-volatile Vector2 orientation = { 0 };
+// Samples are displayed this far in the past so they can be interpolated
+#define RENDER_DELAY 0.02
+
+// Bounding sphere of the cube or model, both scaled to a unit side
+#define DEVICE_RADIUS 0.866f
+#define DEVICE_POSITION ((Vector3) { 0.f, 1.f, 0.f })
+
+sample_history history = { 0 };
+clock_sync modem_clock = { 0 };
+stream_stats modem_stats = { 0 };
+
+// Prometheus text file rewritten once per second, if requested
+const char* metrics_path = NULL;
+
+rt_options rt = { 0 };
+
+// USB-serial latency tuning, restored on exit
+bool low_latency = false;
+int latency_timer = -1;
+double probe_seconds = 1.0;
+serial_tuning tuning = { 0 };
+
+// Requests to the firmware
+command_channel modem_commands = { 0 };
+link_control modem_link = { 0 };
+bool request_info = false;
+int request_rate = 0;
+bool request_binary = false;
+int auto_rate_max = 0;
+
+// Commands requested from the UI, carried out by the modem thread which owns
+// the link state
+typedef enum ui_request {
+	UI_REQUEST_NONE = 0,
+	UI_REQUEST_INFO,
+	UI_REQUEST_RATE_UP,
+	UI_REQUEST_RATE_DOWN,
+	UI_REQUEST_TOGGLE_MODE,
+	UI_REQUEST_CALIBRATE,
+} ui_request;
+volatile ui_request pending_ui_request = UI_REQUEST_NONE;
+
+// Sensor calibration, solved in the background and applied by the modem thread
+calibrator modem_calibrator = { 0 };
+calibration modem_calibration = { 0 };
+unsigned int modem_calibration_version = 0;
+const char* calibration_path = NULL;
+
+// Noise analysis of the live stream and optionally of a recorded log
+allan_live modem_allan = { 0 };
+const char* allan_log = NULL;
+double allan_rate = 0.0;
+int allan_threads = 0;
+allan_curve allan_recorded = { 0 };
+
+// Spectral analysis of every channel
+spectrum modem_spectrum = { 0 };
+int spectrum_size = SPECTRUM_DEFAULT_SIZE;
+
+// Rejection of corrupted samples ahead of everything else
+outlier_filter modem_outlier = { 0 };
+
+// Filters between the analysis stages and the display
+filter_chain modem_filter = { 0 };
+
+// Optional conversion to a uniform output rate ahead of the batch stages
+resampler modem_resampler = { 0 };
+sample_block modem_resampled = { 0 };
+double resample_rate = 0.0;
+resample_method resample_kind = RESAMPLE_CUBIC;
+
+// Triggered recording of events
+capture modem_capture = { 0 };
+const char* capture_dir = ".";
+double capture_pre = CAPTURE_DEFAULT_PRE;
+double capture_post = CAPTURE_DEFAULT_POST;
+const char* trigger_specs[CAPTURE_MAX_TRIGGERS];
+int trigger_count = 0;
+
+// Running statistics of every channel
+channel_stats modem_channel_stats;
+
+// IMUs after the first, which only contribute orientation to the skeleton
+imu_device extra_devices[MAX_DEVICES - 1];
+int extra_device_count = 0;
+const char* skeleton_path = NULL;
+skeleton body = { 0 };
+
+// Gesture detectors on every device
+event_engine modem_events;
+const char* event_log_path = NULL;
+const char* event_socket_path = NULL;
+
+// Simulated bodies following the live orientation, to exercise the renderer
+int swarm_count = 0;
+int swarm_bench = 0;
+
+// Model of the device drawn in place of the cube
+const char* model_path = NULL;
+
+// Past orientations of the device as fading ghosts, H toggles
+int ghost_count = GHOST_DEFAULT_COUNT;
+double ghost_span = GHOST_DEFAULT_SPAN;
+bool show_ghosts = false;
+
+// Window size, 0 for the default, and the 3D views at a scale of it held
+// to a GPU time in ms, 0 for native
+int window_width = 0;
+int window_height = 0;
+bool fullscreen = false;
+float resolution_target = 0.f;
+dynamic_resolution resolution;
+
+// Redraw only when a device moves, capped at max_fps
+bool on_demand = false;
+float wake_threshold = 0.f;
+int max_fps = 120;
+
+// Split-screen views, V cycles
+layout_kind layout = LAYOUT_SINGLE;
+render_wake modem_wake;
+render_usage render_cost;
+
+// Rendered frames written to a video file at a fixed rate
+const char* record_path = NULL;
+int record_fps = VIDEO_DEFAULT_FPS;
+video_recorder recorder;
 
 // Read from serial port in a separate thread to avoid blocking draw loop
 void* modem_thread(void* arg);
 
 void* render_thread(void* arg);
 
+// Periodically export stream statistics
+void* metrics_thread(void* arg);
+
+// Report the outcome of a command that has no other side effect
+static void command_print(void* user, command_status status, const char* request, const char* response) {
+	static const char* names[] = { "OK", "ERR", "timed out" };
+	printf("%s: %s %s\n", request, names[status], response);
+}
+
+static void usage(const char* prog) {
+	printf("Usage: %s [options] <serial port> [<serial port>...]\n", prog);
+	printf("       %s --allan <log> [--allan-rate <hz>] [--threads <n>]\n", prog);
+	printf("       %s --swarm-bench <n>\n", prog);
+	printf("  -m, --metrics <file>      write stream metrics to file every second (Prometheus text format)\n");
+	printf("      --ingest-cpu <n>      pin the serial ingest thread to CPU n\n");
+	printf("      --render-cpu <n>      pin the render thread to CPU n\n");
+	printf("      --ingest-priority <p> run the ingest thread under SCHED_FIFO with priority p\n");
+	printf("      --mlock               lock all memory and pre-fault thread stacks\n");
+	printf("      --low-latency         set ASYNC_LOW_LATENCY on the serial port\n");
+	printf("      --latency-timer <ms>  set the FTDI latency timer of the serial port\n");
+	printf("      --probe <seconds>     measure USB burst timing before and after tuning (default 1, 0 to skip)\n");
+	printf("      --info                request device information at startup\n");
+	printf("      --rate <hz>           request an output sample rate at startup\n");
+	printf("      --binary              switch the firmware to compact binary frames at startup\n");
+	printf("      --auto-rate <hz>      adapt rate and output format to link headroom, up to hz\n");
+	printf("      --calibration <file>  calibration file to load and save (default: per device in ~/.config)\n");
+	printf("      --allan <log>         Allan deviation of a recorded serial log, shown with the live curve\n");
+	printf("      --allan-rate <hz>     sample rate of the log (default: from device timestamps)\n");
+	printf("      --threads <n>         worker threads for the log analysis (default: all CPUs)\n");
+	printf("      --reject <spec>       reject outliers, e.g. ang=hampel:7:3,rate:2000 or acc=range:16 (repeatable)\n");
+	printf("      --reject-action <a>   replace (default), drop or flag rejected samples\n");
+	printf("      --max-spin <deg/s>    reject orientation and gyro samples rotating faster than this\n");
+	printf("      --filter <spec>       add filter stages, e.g. ang=lowpass:10,median:5 (repeatable)\n");
+	printf("      --resample <hz>       resample the stream to a fixed rate before processing\n");
+	printf("      --resample-method <m> linear, cubic (default) or sinc\n");
+	printf("      --trigger <cond>      capture around events, e.g. gyr.z>250, dang.x<-500, tilt>45 (repeatable)\n");
+	printf("      --pre <seconds>       capture window before the trigger (default: %.0f)\n", CAPTURE_DEFAULT_PRE);
+	printf("      --post <seconds>      capture window after the trigger (default: %.0f)\n", CAPTURE_DEFAULT_POST);
+	printf("      --capture-dir <dir>   directory for capture files (default: current)\n");
+	printf("      --detect <spec>       detect tap, shake, hold, still or cross:<channel><op><value>[:<hyst>] (repeatable)\n");
+	printf("      --event-log <file>    append detected events as JSON lines, - for stdout\n");
+	printf("      --event-socket <path> publish detected events to clients of a Unix socket\n");
+	printf("      --skeleton <file>     draw a chain of segments driven by the devices instead of the cube\n");
+	printf("      --on-demand <deg>     redraw only when a device turns by more than deg\n");
+	printf("      --max-fps <n>         frame rate cap (default: %d)\n", max_fps);
+	printf("      --size <w>x<h>        window size (default: 2560x1440)\n");
+	printf("      --fullscreen          fullscreen at the size, or the monitor's without --size\n");
+	printf("      --dynamic-res <ms>    render the 3D views at a lower resolution to keep them under ms of GPU time\n");
+	printf("      --layout <name>       views: single, dual (with front) or quad (front, side, top) (default: single)\n");
+	printf("      --record <file>       record the window to .y4m, .rgba or, through ffmpeg, any other format\n");
+	printf("      --record-fps <n>      frame rate of the recording (default: %d)\n", VIDEO_DEFAULT_FPS);
+	printf("      --model <file>        draw an OBJ, glTF or STL model instead of the cube, cached as <file>%s\n", MESH_CACHE_SUFFIX);
+	printf("      --ghosts <n>          show n fading past orientations of the device and a trail of its tip (default: %d)\n", GHOST_DEFAULT_COUNT);
+	printf("      --ghost-span <s>      seconds of history the ghosts cover (default: %.0f)\n", GHOST_DEFAULT_SPAN);
+	printf("      --swarm <n>           draw n simulated bodies following the device instead of one cube\n");
+	printf("      --swarm-bench <n>     measure frame time of each draw path up to n bodies, then exit\n");
+	printf("      --fft <n>             FFT length of the spectrum view, a power of two (default: %d)\n", SPECTRUM_DEFAULT_SIZE);
+}
+
+enum {
+	OPT_INGEST_CPU = 256,
+	OPT_RENDER_CPU,
+	OPT_INGEST_PRIORITY,
+	OPT_MLOCK,
+	OPT_LOW_LATENCY,
+	OPT_LATENCY_TIMER,
+	OPT_PROBE,
+	OPT_INFO,
+	OPT_RATE,
+	OPT_BINARY,
+	OPT_AUTO_RATE,
+	OPT_CALIBRATION,
+	OPT_ALLAN,
+	OPT_ALLAN_RATE,
+	OPT_THREADS,
+	OPT_FFT,
+	OPT_FILTER,
+	OPT_RESAMPLE,
+	OPT_RESAMPLE_METHOD,
+	OPT_TRIGGER,
+	OPT_PRE,
+	OPT_POST,
+	OPT_CAPTURE_DIR,
+	OPT_REJECT,
+	OPT_REJECT_ACTION,
+	OPT_MAX_SPIN,
+	OPT_SKELETON,
+	OPT_DETECT,
+	OPT_EVENT_LOG,
+	OPT_EVENT_SOCKET,
+	OPT_SWARM,
+	OPT_SWARM_BENCH,
+	OPT_MODEL,
+	OPT_ON_DEMAND,
+	OPT_MAX_FPS,
+	OPT_LAYOUT,
+	OPT_RECORD,
+	OPT_RECORD_FPS,
+	OPT_SIZE,
+	OPT_FULLSCREEN,
+	OPT_DYNAMIC_RES,
+	OPT_GHOSTS,
+	OPT_GHOST_SPAN,
+};
+
+static const struct option long_options[] = {
+	{ "metrics", required_argument, NULL, 'm' },
+	{ "ingest-cpu", required_argument, NULL, OPT_INGEST_CPU },
+	{ "render-cpu", required_argument, NULL, OPT_RENDER_CPU },
+	{ "ingest-priority", required_argument, NULL, OPT_INGEST_PRIORITY },
+	{ "mlock", no_argument, NULL, OPT_MLOCK },
+	{ "low-latency", no_argument, NULL, OPT_LOW_LATENCY },
+	{ "latency-timer", required_argument, NULL, OPT_LATENCY_TIMER },
+	{ "probe", required_argument, NULL, OPT_PROBE },
+	{ "info", no_argument, NULL, OPT_INFO },
+	{ "rate", required_argument, NULL, OPT_RATE },
+	{ "binary", no_argument, NULL, OPT_BINARY },
+	{ "auto-rate", required_argument, NULL, OPT_AUTO_RATE },
+	{ "calibration", required_argument, NULL, OPT_CALIBRATION },
+	{ "allan", required_argument, NULL, OPT_ALLAN },
+	{ "allan-rate", required_argument, NULL, OPT_ALLAN_RATE },
+	{ "threads", required_argument, NULL, OPT_THREADS },
+	{ "fft", required_argument, NULL, OPT_FFT },
+	{ "filter", required_argument, NULL, OPT_FILTER },
+	{ "resample", required_argument, NULL, OPT_RESAMPLE },
+	{ "resample-method", required_argument, NULL, OPT_RESAMPLE_METHOD },
+	{ "trigger", required_argument, NULL, OPT_TRIGGER },
+	{ "pre", required_argument, NULL, OPT_PRE },
+	{ "post", required_argument, NULL, OPT_POST },
+	{ "capture-dir", required_argument, NULL, OPT_CAPTURE_DIR },
+	{ "reject", required_argument, NULL, OPT_REJECT },
+	{ "reject-action", required_argument, NULL, OPT_REJECT_ACTION },
+	{ "max-spin", required_argument, NULL, OPT_MAX_SPIN },
+	{ "skeleton", required_argument, NULL, OPT_SKELETON },
+	{ "detect", required_argument, NULL, OPT_DETECT },
+	{ "event-log", required_argument, NULL, OPT_EVENT_LOG },
+	{ "event-socket", required_argument, NULL, OPT_EVENT_SOCKET },
+	{ "swarm", required_argument, NULL, OPT_SWARM },
+	{ "swarm-bench", required_argument, NULL, OPT_SWARM_BENCH },
+	{ "model", required_argument, NULL, OPT_MODEL },
+	{ "on-demand", required_argument, NULL, OPT_ON_DEMAND },
+	{ "max-fps", required_argument, NULL, OPT_MAX_FPS },
+	{ "layout", required_argument, NULL, OPT_LAYOUT },
+	{ "record", required_argument, NULL, OPT_RECORD },
+	{ "record-fps", required_argument, NULL, OPT_RECORD_FPS },
+	{ "size", required_argument, NULL, OPT_SIZE },
+	{ "fullscreen", no_argument, NULL, OPT_FULLSCREEN },
+	{ "dynamic-res", required_argument, NULL, OPT_DYNAMIC_RES },
+	{ "ghosts", required_argument, NULL, OPT_GHOSTS },
+	{ "ghost-span", required_argument, NULL, OPT_GHOST_SPAN },
+	{ "help", no_argument, NULL, 'h' },
+	{ 0 },
+};
+
 int main(int argc, char** argv) {
+	rt_options_init(&rt);
+	filter_chain_init(&modem_filter);
+	outlier_init(&modem_outlier);
+	event_engine_init(&modem_events);
+
+	int opt = 0;
+	while ((opt = getopt_long(argc, argv, "m:h", long_options, NULL)) != -1) {
+		switch (opt) {
+		case 'm':
+			metrics_path = optarg;
+			break;
+		case OPT_INGEST_CPU:
+			rt.ingest_cpu = atoi(optarg);
+			break;
+		case OPT_RENDER_CPU:
+			rt.render_cpu = atoi(optarg);
+			break;
+		case OPT_INGEST_PRIORITY:
+			rt.ingest_priority = atoi(optarg);
+			break;
+		case OPT_MLOCK:
+			rt.lock_memory = true;
+			break;
+		case OPT_LOW_LATENCY:
+			low_latency = true;
+			break;
+		case OPT_LATENCY_TIMER:
+			latency_timer = atoi(optarg);
+			break;
+		case OPT_PROBE:
+			probe_seconds = atof(optarg);
+			break;
+		case OPT_INFO:
+			request_info = true;
+			break;
+		case OPT_RATE:
+			request_rate = atoi(optarg);
+			break;
+		case OPT_BINARY:
+			request_binary = true;
+			break;
+		case OPT_AUTO_RATE:
+			auto_rate_max = atoi(optarg);
+			break;
+		case OPT_CALIBRATION:
+			calibration_path = optarg;
+			break;
+		case OPT_ALLAN:
+			allan_log = optarg;
+			break;
+		case OPT_ALLAN_RATE:
+			allan_rate = atof(optarg);
+			break;
+		case OPT_THREADS:
+			allan_threads = atoi(optarg);
+			break;
+		case OPT_FFT:
+			spectrum_size = atoi(optarg);
+			break;
+		case OPT_RESAMPLE:
+			resample_rate = atof(optarg);
+			break;
+		case OPT_RESAMPLE_METHOD:
+			if (resampler_parse_method(optarg, &resample_kind) != 0) {
+				printf("Unknown resampling method: %s\n", optarg);
+				return 1;
+			}
+			break;
+		case OPT_TRIGGER:
+			if (trigger_count == CAPTURE_MAX_TRIGGERS) {
+				printf("At most %d triggers\n", CAPTURE_MAX_TRIGGERS);
+				return 1;
+			}
+			trigger_specs[trigger_count++] = optarg;
+			break;
+		case OPT_PRE:
+			capture_pre = atof(optarg);
+			break;
+		case OPT_POST:
+			capture_post = atof(optarg);
+			break;
+		case OPT_CAPTURE_DIR:
+			capture_dir = optarg;
+			break;
+		case OPT_REJECT:
+			if (outlier_parse(&modem_outlier, optarg) != 0) {
+				printf("Invalid outlier check: %s\n", optarg);
+				return 1;
+			}
+			break;
+		case OPT_REJECT_ACTION:
+			if (outlier_parse_action(optarg, &modem_outlier.action) != 0) {
+				printf("Unknown outlier action: %s\n", optarg);
+				return 1;
+			}
+			break;
+		case OPT_MAX_SPIN:
+			modem_outlier.max_spin = atof(optarg);
+			break;
+		case OPT_DETECT:
+			if (event_engine_add(&modem_events, optarg) != 0) {
+				printf("Invalid detector: %s\n", optarg);
+				return 1;
+			}
+			break;
+		case OPT_EVENT_LOG:
+			event_log_path = optarg;
+			break;
+		case OPT_EVENT_SOCKET:
+			event_socket_path = optarg;
+			break;
+		case OPT_SWARM:
+			swarm_count = atoi(optarg);
+			if (swarm_count < 1 || swarm_count > SWARM_MAX) {
+				printf("Swarm size must be from 1 to %d\n", SWARM_MAX);
+				return 1;
+			}
+			break;
+		case OPT_SWARM_BENCH:
+			swarm_bench = atoi(optarg);
+			break;
+		case OPT_SKELETON:
+			skeleton_path = optarg;
+			break;
+		case OPT_MODEL:
+			model_path = optarg;
+			break;
+		case OPT_ON_DEMAND:
+			on_demand = true;
+			wake_threshold = atof(optarg);
+			if (wake_threshold < 0.f) {
+				printf("Invalid wake threshold: %s\n", optarg);
+				return 1;
+			}
+			break;
+		case OPT_LAYOUT:
+			if (layout_parse(optarg, &layout) != 0) {
+				printf("Invalid layout: %s\n", optarg);
+				return 1;
+			}
+			break;
+		case OPT_MAX_FPS:
+			max_fps = atoi(optarg);
+			if (max_fps < 1) {
+				printf("Invalid frame rate cap: %s\n", optarg);
+				return 1;
+			}
+			break;
+		case OPT_RECORD:
+			record_path = optarg;
+			break;
+		case OPT_RECORD_FPS:
+			record_fps = atoi(optarg);
+			if (record_fps < 1) {
+				printf("Invalid recording frame rate: %s\n", optarg);
+				return 1;
+			}
+			break;
+		case OPT_SIZE:
+			if (sscanf(optarg, "%dx%d", &window_width, &window_height) != 2 || window_width < 1 || window_height < 1) {
+				printf("Invalid window size: %s\n", optarg);
+				return 1;
+			}
+			break;
+		case OPT_FULLSCREEN:
+			fullscreen = true;
+			break;
+		case OPT_DYNAMIC_RES:
+			resolution_target = atof(optarg);
+			if (resolution_target <= 0.f) {
+				printf("Invalid GPU time target: %s\n", optarg);
+				return 1;
+			}
+			break;
+		case OPT_GHOSTS:
+			ghost_count = atoi(optarg);
+			show_ghosts = true;
+			if (ghost_count < 1 || ghost_count > GHOST_MAX) {
+				printf("Ghost count must be from 1 to %d\n", GHOST_MAX);
+				return 1;
+			}
+			break;
+		case OPT_GHOST_SPAN:
+			ghost_span = atof(optarg);
+			if (ghost_span <= 0.0) {
+				printf("Invalid ghost span: %s\n", optarg);
+				return 1;
+			}
+			break;
+		case OPT_FILTER:
+			if (filter_chain_parse(&modem_filter, optarg) != 0) {
+				printf("Invalid filter: %s\n", optarg);
+				return 1;
+			}
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : 1;
+		}
+	}
+
+	// Offline analysis of a recording, on its own or alongside the live view
+	if (allan_log) {
+		int threads = allan_threads > 0 ? allan_threads : (int)sysconf(_SC_NPROCESSORS_ONLN);
+		double start = clock_monotonic();
+		if (allan_analyze_file(allan_log, allan_rate, threads, &allan_recorded) != 0)
+			return 1;
+		allan_print(stdout, &allan_recorded);
+		printf("Analyzed %s in %.2f s on %d threads\n", allan_log, clock_monotonic() - start, threads);
+		if (optind >= argc)
+			return 0;
+	}
+
+	// Renderer benchmark, in a window of its own without vsync
+	if (swarm_bench > 0) {
+		SetConfigFlags(FLAG_WINDOW_ALWAYS_RUN);
+		InitWindow(window_width > 0 ? window_width : 2560, window_height > 0 ? window_height : 1440,
+			"IMU Visualizer benchmark");
+		SetTargetFPS(0);
+		swarm_benchmark(stdout, swarm_bench);
+		CloseWindow();
+		return 0;
+	}
+
 	// Serial port setup
-	if (argc < 2) {
+	if (optind >= argc) {
 		printf("No serial port indicated\n");
 		return 0;
 	}
 
-	const char* modem_dev = argv[1];
-	modem_fd = open(modem_dev, O_RDWR | O_NOCTTY);
+	if (skeleton_path) {
+		if (skeleton_load(&body, skeleton_path) != 0)
+			return 1;
+		skeleton_print(stdout, &body);
+	}
+	if (argc - optind > MAX_DEVICES) {
+		printf("At most %d devices\n", MAX_DEVICES);
+		return 1;
+	}
+	if (skeleton_path && body.devices > argc - optind) {
+		printf("The skeleton uses %d devices but %d serial ports were given\n", body.devices, argc - optind);
+		return 1;
+	}
+
+	const char* modem_dev = argv[optind];
+	struct termios oldtio = { 0 };
+	modem_fd = serial_open(modem_dev, BAUDRATE, &oldtio);
 	if (modem_fd < 0) {
 		printf("Failed to open modem device: %s\n", modem_dev);
 		return 1;
 	}
 
-	struct termios oldtio = { 0 }, newtio = { 0 };
-	tcgetattr(modem_fd, &oldtio); // Save current serial port settings
-	newtio.c_cflag = BAUDRATE | CRTSCTS | CS8 | CLOCAL | CREAD;
-	newtio.c_iflag = IGNPAR | ICRNL;
-	newtio.c_oflag = 0;
-	newtio.c_lflag = ICANON;
-	newtio.c_cc[VINTR]	= 0;	/* Ctrl-c */ 
-	newtio.c_cc[VQUIT]	= 0;	/* Ctrl-\ */
-	newtio.c_cc[VERASE]	= 0;	/* del */
-	newtio.c_cc[VKILL]	= 0;	/* @ */
-	newtio.c_cc[VEOF]	= 4;	/* Ctrl-d */
-	newtio.c_cc[VTIME]	= 0;	/* inter-character timer unused */
-	newtio.c_cc[VMIN]	= 1;	/* blocking read until 1 character arrives */
-	newtio.c_cc[VSWTC]	= 0;	/* '\0' */
-	newtio.c_cc[VSTART]	= 0;	/* Ctrl-q */ 
-	newtio.c_cc[VSTOP]	= 0;	/* Ctrl-s */
-	newtio.c_cc[VSUSP]	= 0;	/* Ctrl-z */
-	newtio.c_cc[VEOL]	= 0;	/* '\0' */
-	newtio.c_cc[VREPRINT]	= 0;	/* Ctrl-r */
-	newtio.c_cc[VDISCARD]	= 0;	/* Ctrl-u */
-	newtio.c_cc[VWERASE]	= 0;	/* Ctrl-w */
-	newtio.c_cc[VLNEXT]	= 0;	/* Ctrl-v */
-	newtio.c_cc[VEOL2]	= 0;	/* '\0' */
-
-	// Clear modem line and activate new port settings
-	tcflush(modem_fd, TCIFLUSH);
-	tcsetattr(modem_fd, TCSANOW, &newtio);
+	// Reduce USB-serial buffering, measuring the batching before and after
+	serial_tuning_init(&tuning);
+	if (low_latency || latency_timer >= 0) {
+		burst_report report = { 0 };
+		if (probe_seconds > 0.0) {
+			serial_probe_bursts(modem_fd, probe_seconds, &report);
+			serial_print_bursts(stdout, "Before tuning", &report);
+		}
+		if (low_latency)
+			serial_tune_low_latency(modem_fd, &tuning);
+		if (latency_timer >= 0)
+			serial_tune_latency_timer(modem_dev, latency_timer, &tuning);
+		if (probe_seconds > 0.0) {
+			serial_probe_bursts(modem_fd, probe_seconds, &report);
+			serial_print_bursts(stdout, "After tuning", &report);
+		}
+	}
+
+	sample_history_init(&history);
+	render_wake_init(&modem_wake, on_demand, wake_threshold);
+	clock_sync_init(&modem_clock);
+	stream_stats_init(&modem_stats, modem_dev);
+	for (int i = optind + 1; i < argc; i++) {
+		if (imu_device_open(&extra_devices[extra_device_count], argv[i], BAUDRATE) != 0) {
+			printf("Failed to open modem device: %s\n", argv[i]);
+			return 1;
+		}
+		extra_devices[extra_device_count].events = &modem_events;
+		extra_devices[extra_device_count].wake = &modem_wake;
+		extra_devices[extra_device_count].index = extra_device_count + 1;
+		extra_device_count++;
+	}
+
+	// Globals (sample history, statistics) are resident from here on
+	if (rt.lock_memory)
+		rt_lock_memory();
+
+	// Per-device calibration from a previous session
+	char default_calibration[4096];
+	if (!calibration_path && calibration_default_path(modem_dev, default_calibration, sizeof(default_calibration)) == 0)
+		calibration_path = default_calibration;
+	calibration_identity(&modem_calibration);
+	if (calibration_path && calibration_load(&modem_calibration, calibration_path) == 0)
+		printf("Loaded calibration from %s\n", calibration_path);
+	calibrator_init(&modem_calibrator, &modem_calibration, calibration_path);
+	if (allan_live_init(&modem_allan) != 0)
+		printf("Not enough memory for the live Allan deviation\n");
+	resampler_init(&modem_resampler, resample_rate, resample_kind);
+	if (capture_init(&modem_capture, capture_dir, capture_pre, capture_post) != 0) {
+		printf("Capture windows must be 0 to %.0f s in total\n", CAPTURE_MAX_SPAN);
+		return 1;
+	}
+	for (int i = 0; i < trigger_count; i++) {
+		if (capture_add_trigger(&modem_capture, trigger_specs[i]) != 0) {
+			printf("Invalid trigger: %s\n", trigger_specs[i]);
+			return 1;
+		}
+	}
+	if (capture_start(&modem_capture) != 0) {
+		printf("Not enough memory for the capture buffers\n");
+		return 1;
+	}
+	channel_stats_init(&modem_channel_stats);
+	if (modem_events.detectors > 0 && event_engine_start(&modem_events, event_log_path, event_socket_path) != 0)
+		return 1;
+	if (spectrum_init(&modem_spectrum, spectrum_size) != 0) {
+		printf("FFT length must be a power of two from %d to %d\n", SPECTRUM_MIN_SIZE, SPECTRUM_MAX_SIZE);
+		return 1;
+	}
+
+	command_init(&modem_commands, modem_fd);
+	link_control_init(&modem_link, &modem_commands, LINE_BYTES_PER_SEC, auto_rate_max);
 
 	modem_thread_stop = false;
 	pthread_t thread_handle = { 0 };
-	pthread_create(&thread_handle, NULL, modem_thread, NULL);
+	int err = rt_thread_create(&thread_handle, modem_thread, NULL, rt.ingest_cpu, rt.ingest_priority);
+	if (err != 0) {
+		printf("Failed to start the ingest thread: %s\n", strerror(err));
+		return 1;
+	}
+	for (int i = 0; i < extra_device_count; i++)
+		imu_device_start(&extra_devices[i]);
+
+	pthread_t metrics_handle = { 0 };
+	if (metrics_path)
+		pthread_create(&metrics_handle, NULL, metrics_thread, NULL);
 
+	// Pin after spawning so the other threads don't inherit the render CPU
+	if (rt.render_cpu >= 0)
+		rt_pin_current(rt.render_cpu);
 	render_thread(NULL);
 
 	modem_thread_stop = true;
 	pthread_join(thread_handle, NULL);
+	for (int i = 0; i < extra_device_count; i++)
+		imu_device_close(&extra_devices[i]);
+	if (metrics_path)
+		pthread_join(metrics_handle, NULL);
+	calibrator_shutdown(&modem_calibrator);
+	capture_shutdown(&modem_capture);
+	event_engine_shutdown(&modem_events);
+
+	if (modem_clock.count > 0) {
+		printf("Clock sync: drift %+.1f ppm, jitter %.3f ms, %lu outliers rejected, %lu resets\n",
+			clock_sync_drift_ppm(&modem_clock), modem_clock.jitter * 1e3,
+			modem_clock.rejected, modem_clock.resets);
+	}
+	stream_stats_report(stdout, &modem_stats);
+	for (int i = 0; i < extra_device_count; i++)
+		stream_stats_report(stdout, &extra_devices[i].stats);
+	if (!outlier_empty(&modem_outlier))
+		outlier_report(stdout, &modem_outlier);
+	if (resample_rate > 0.0)
+		resampler_report(stdout, &modem_resampler);
+	if (!filter_chain_empty(&modem_filter))
+		filter_chain_report(stdout, &modem_filter);
+	capture_report(stdout, &modem_capture);
+	if (modem_events.detectors > 0)
+		event_engine_report(stdout, &modem_events);
+	render_usage_report(stdout, &render_cost, &modem_wake);
+	resolution_report(stdout, &resolution);
+	if (record_path && recorder.issued > 0)
+		video_report(stdout, &recorder);
+	render_wake_destroy(&modem_wake);
 
 	// Restore old port settings
+	serial_tune_restore(modem_fd, &tuning);
 	tcsetattr(modem_fd, TCSANOW, &oldtio);
 	close(modem_fd);
 
 	return 0;
 }
 
+// Samples decoded from the current read, processed together
+sample_block modem_block = { 0 };
+
+// Run the batch stages over a block and publish the samples
+static void modem_process_block(sample_block* b) {
+	// Calibration sees uncorrected data, then picks up any new solution
+	calibrator_collect(&modem_calibrator, b);
+	calibrator_latest(&modem_calibrator, &modem_calibration, &modem_calibration_version);
+	calibration_apply(&modem_calibration, b);
+	allan_live_push(&modem_allan, b);
+	spectrum_push(&modem_spectrum, b);
+	capture_push(&modem_capture, b);
+	channel_stats_push(&modem_channel_stats, b);
+	event_engine_push(&modem_events, 0, b);
+
+	// Analysis sees the full bandwidth, only the display is filtered
+	filter_chain_process(&modem_filter, b);
+
+	for (int i = 0; i < b->count; i++) {
+		imu_sample s;
+		sample_block_get(b, i, &s);
+		sample_history_push(&history, s);
+	}
+	render_wake_notify(&modem_wake, 0, b);
+}
+
+// Process the samples decoded so far
+static void modem_flush_block(void) {
+	sample_block* b = &modem_block;
+	if (b->count == 0)
+		return;
+
+	// Spikes are repaired before the resampler can smear them
+	outlier_process(&modem_outlier, b);
+	if (resample_rate > 0.0) {
+		resampler_push(&modem_resampler, b);
+		while (resampler_pull(&modem_resampler, &modem_resampled))
+			modem_process_block(&modem_resampled);
+	}
+	else
+		modem_process_block(b);
+	b->count = 0;
+}
+
+// Pass a decoded frame down the sample pipeline
+static void modem_frame(frame_status status, const imu_frame* frame, double arrival) {
+	// Device timestamp is optional, fall back to arrival time without it
+	double time = arrival;
+	if (status == FRAME_OK && frame->has_time)
+		time = clock_sync_update(&modem_clock, frame->ticks, arrival);
+	stream_stats_frame(&modem_stats, status, frame, time, arrival);
+
+	if (status == FRAME_OK) {
+		imu_sample s = { 0 };
+		s.time = time;
+		s.orientation = (Vector2) { (float)frame->ang_x, (float)frame->ang_y };
+		s.has_raw = frame->has_raw;
+		s.gyro = (Vector3) { frame->gyro[0], frame->gyro[1], frame->gyro[2] };
+		s.accel = (Vector3) { frame->accel[0], frame->accel[1], frame->accel[2] };
+		s.mag = (Vector3) { frame->mag[0], frame->mag[1], frame->mag[2] };
+		if (modem_block.count == SAMPLE_BLOCK_LEN)
+			modem_flush_block();
+		sample_block_append(&modem_block, &s);
+	}
+}
+
+// Carry out a command requested from the UI
+static void modem_ui_request(void) {
+	ui_request request = pending_ui_request;
+	if (request == UI_REQUEST_NONE)
+		return;
+	pending_ui_request = UI_REQUEST_NONE;
+
+	// Without an acknowledged rate, step from the measured one
+	int rate = modem_link.rate;
+	if (rate == 0) {
+		stream_stats s;
+		stream_stats_snapshot(&modem_stats, clock_monotonic(), &s);
+		stats_bucket window = { 0 };
+		stream_stats_window(&s, 10, &window);
+		rate = (int)(window.counts.frames / 10.0 + 0.5);
+	}
+
+	switch (request) {
+	case UI_REQUEST_INFO:
+		command_send(&modem_commands, "INFO", COMMAND_DEFAULT_TIMEOUT, command_print, NULL);
+		break;
+	case UI_REQUEST_RATE_UP:
+		link_control_set_rate(&modem_link, rate > 0 ? rate * 2 : LINK_MIN_RATE);
+		break;
+	case UI_REQUEST_RATE_DOWN:
+		if (rate / 2 >= LINK_MIN_RATE)
+			link_control_set_rate(&modem_link, rate / 2);
+		break;
+	case UI_REQUEST_TOGGLE_MODE:
+		link_control_set_binary(&modem_link, !modem_link.binary);
+		break;
+	case UI_REQUEST_CALIBRATE:
+		command_send(&modem_commands, "CAL START", COMMAND_DEFAULT_TIMEOUT, command_print, NULL);
+		break;
+	case UI_REQUEST_NONE:
+		break;
+	}
+}
+
 void* modem_thread(void* arg) {
 	const int buflen = 1024;
-	char buf[buflen];
+	unsigned char buf[buflen];
 	int res = 0;
+	if (rt.lock_memory)
+		rt_prefault_stack(RT_PREFAULT_STACK);
+
+	frame_decoder decoder;
+	frame_decoder_init(&decoder);
+
+	// Startup requests, sent from here since this thread owns the link state
+	if (request_info)
+		command_send(&modem_commands, "INFO", COMMAND_DEFAULT_TIMEOUT, command_print, NULL);
+	if (request_rate > 0)
+		link_control_set_rate(&modem_link, request_rate);
+	if (request_binary)
+		link_control_set_binary(&modem_link, true);
+
+	struct pollfd pfd = { .fd = modem_fd, .events = POLLIN };
 	while (!modem_thread_stop) {
+		// Wake up periodically to expire modem_commands and notice the stop flag
+		res = poll(&pfd, 1, 50);
+		double now = clock_monotonic();
+		command_poll_timeouts(&modem_commands, now);
+		link_control_update(&modem_link, &modem_stats, now);
+		modem_ui_request();
+		if (res == 0)
+			continue;
+
 		res = read(modem_fd, buf, buflen);
-		buf[res] = 0;
-		int x = 0, y = 0;
-		int conv = sscanf(buf, "Ang.x = %d\t\tAng.y = %d", &x, &y);
-		if (conv == 2) {
-			orientation = (Vector2) { (float)x, (float)y };
+		double arrival = clock_monotonic();
+		if (res <= 0) {
+			stream_stats_read_error(&modem_stats, arrival);
+			usleep(10000);
+			continue;
+		}
+		stream_stats_bytes(&modem_stats, res, arrival);
+
+		for (int i = 0; i < res; i++) {
+			imu_frame frame = { 0 };
+			frame_status status = FRAME_EMPTY;
+			switch (frame_decoder_feed(&decoder, buf[i])) {
+			case FRAME_EVENT_NONE:
+				continue;
+			case FRAME_EVENT_LINE:
+				if (command_handle_line(&modem_commands, decoder.line))
+					continue;
+				status = frame_parse(decoder.line, &frame);
+				break;
+			case FRAME_EVENT_BINARY:
+				status = frame_decode_binary(&decoder, &frame);
+				break;
+			case FRAME_EVENT_BAD_CRC:
+				status = FRAME_BAD_CHECKSUM;
+				break;
+			case FRAME_EVENT_OVERFLOW:
+				status = FRAME_MALFORMED;
+				break;
+			}
+			modem_frame(status, &frame, arrival);
 		}
+		modem_flush_block();
 	}
 	return NULL;
 }
 
+void* metrics_thread(void* arg) {
+	char tmp_path[4096];
+	snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", metrics_path);
+	stream_stats* streams[MAX_DEVICES] = { &modem_stats };
+	for (int i = 0; i < extra_device_count; i++)
+		streams[i + 1] = &extra_devices[i].stats;
+	while (!modem_thread_stop) {
+		// Write to a temporary file and rename so readers never see a partial file
+		FILE* f = fopen(tmp_path, "w");
+		if (f) {
+			stream_stats_export(f, streams, extra_device_count + 1, clock_monotonic());
+			fclose(f);
+			rename(tmp_path, metrics_path);
+		}
+		sleep(1);
+	}
+	return NULL;
+}
+
+// One line of the status block
+static void status_line(hud* text, const char* label, const char* value, int y) {
+	hud_line l;
+	hud_line_clear(&l);
+	hud_line_text(&l, label);
+	hud_line_text(&l, value);
+	hud_text(text, l.text, 10, y, 20, LIGHTGRAY);
+}
+
+// Tilt of the device about the horizontal axes, over the grid
+static Matrix device_pose(const imu_sample* s) {
+	float x_ang = DEG2RAD * s->orientation.x;
+	float y_ang = DEG2RAD * s->orientation.y;
+	Vector3 rotation_axis = { -x_ang, 0.f, y_ang };
+	float rotation_angle = Vector3Length(rotation_axis);
+	rotation_axis = Vector3Normalize(rotation_axis);
+	const Vector3 pos = DEVICE_POSITION;
+	return MatrixMultiply(MatrixRotate(rotation_axis, rotation_angle), MatrixTranslate(pos.x, pos.y, pos.z));
+}
+
 void* render_thread(void* arg) {
-	SetConfigFlags(FLAG_WINDOW_ALWAYS_RUN | FLAG_VSYNC_HINT);
-	InitWindow(2560, 1440, "IMU Visualizer");
-	SetTargetFPS(120);
+	SetConfigFlags(FLAG_WINDOW_ALWAYS_RUN | FLAG_VSYNC_HINT | FLAG_WINDOW_RESIZABLE | FLAG_WINDOW_HIGHDPI
+		| (fullscreen ? FLAG_FULLSCREEN_MODE : 0));
+	// Fullscreen at 0x0 takes the monitor's size
+	if (window_width == 0 && !fullscreen) {
+		window_width = 2560;
+		window_height = 1440;
+	}
+	InitWindow(window_width, window_height, "IMU Visualizer");
+	SetTargetFPS(max_fps);
+	resolution_init(&resolution, resolution_target > 0.f, resolution_target);
 
 	#ifdef RAYLIB_5_0
 	SetTextLineSpacing(40);
 	#endif
+
+	// Overlay text, with what it cost the frame before
+	hud text;
+	hud_init(&text);
+	int text_glyphs = 0;
+	int text_dropped = 0;
+	double text_ms = 0.0;
 	
 	Camera camera = { 0 };
 	camera.projection = CAMERA_PERSPECTIVE;
@@ -123,29 +974,329 @@ void* render_thread(void* arg) {
 	camera.up = (Vector3) { 0.f, 1.f, 0.f };
 
 	Model cube_model = LoadModelFromMesh(GenMeshCube(1.f, 1.f, 1.f));
+	// Faces and edges in one pass with the edge shader, or two with a
+	// wire pass
+	wireframe wire;
+	wireframe_init(&wire);
+	Model edged_cube = LoadModelFromMesh(wireframe_mesh(cube_model.meshes[0]));
+	edged_cube.materials[0].shader = wire.shader;
+	bool single_pass = true;
+	// Falls back to the cube if the model can't be loaded
+	cached_mesh device_model = { 0 };
+	if (model_path)
+		cached_mesh_load(&device_model, model_path);
+	bool show_stats = true;
+	bool show_allan = false;
+	allan_curve allan_live_curve_buf = { 0 };
+	bool show_spectrum = false;
+	bool show_channel_stats = false;
+	chstats_window stats_window = CHSTATS_1S;
+	spectrogram spectrum_view;
+	spectrogram_init(&spectrum_view, &modem_spectrum, CH_ANG_X);
+
+	// Floor, grid and axes uploaded once; per frame only the device frame
+	// moves
+	scene decor;
+	scene_init(&decor);
+	int floor_node = scene_add_floor(&decor, 10.f, (Color) { 24, 24, 24, 255 });
+	scene_add_grid(&decor, 10, 1.f);
+	int axes_node = scene_add_axes(&decor, 1.f);
+	int frame_node = scene_add_axes(&decor, 1.f);
+	int origin_node = -1;
+	if (skeleton_path) {
+		origin_node = scene_add_axes(&decor, 0.5f);
+		scene_set_transform(&decor, origin_node, MatrixTranslate(body.origin.x, body.origin.y, body.origin.z));
+	}
+	bool show_decor = true;
+
+	// Sampled from the history as time passes, so only new ghosts cost
+	// anything per frame
+	ghost_trail ghosts;
+	ghost_init(&ghosts, ghost_count, ghost_span);
+	ghosts.visible = show_ghosts;
+
+	// Back the camera off to see the whole swarm
+	swarm bodies = { 0 };
+	if (swarm_count > 0 && swarm_init(&bodies, swarm_count) == 0)
+		camera.position = Vector3Scale(camera.position, fmaxf(1.f, swarm_extent(&bodies) / 2.f));
 
+	if (record_path)
+		video_start(&recorder, record_path, record_fps);
+
+	render_usage_start(&render_cost);
+	bool drew = true;
+	double last_frame = 0.0;
 	while (!WindowShouldClose()) {
-		
+		// On demand, sleep until a device moves; EndDrawing polls input
+		// after a frame, otherwise it is polled here
+		bool moved = false;
+		if (on_demand) {
+			moved = render_wake_wait(&modem_wake, RENDER_WAKE_INPUT_POLL);
+			if (!drew)
+				PollInputEvents();
+		}
+
+		if (IsKeyPressed(KEY_F1))
+			show_stats = !show_stats;
+		if (IsKeyPressed(KEY_I))
+			pending_ui_request = UI_REQUEST_INFO;
+		if (IsKeyPressed(KEY_EQUAL))
+			pending_ui_request = UI_REQUEST_RATE_UP;
+		if (IsKeyPressed(KEY_MINUS))
+			pending_ui_request = UI_REQUEST_RATE_DOWN;
+		if (IsKeyPressed(KEY_B))
+			pending_ui_request = UI_REQUEST_TOGGLE_MODE;
+		if (IsKeyPressed(KEY_C))
+			pending_ui_request = UI_REQUEST_CALIBRATE;
+		if (IsKeyPressed(KEY_K))
+			calibrator_toggle(&modem_calibrator);
+		if (IsKeyPressed(KEY_L))
+			calibrator_level(&modem_calibrator);
+		if (IsKeyPressed(KEY_F2))
+			show_allan = !show_allan;
+		if (IsKeyPressed(KEY_R))
+			allan_live_reset(&modem_allan);
+		if (IsKeyPressed(KEY_F))
+			filter_chain_toggle(&modem_filter);
+		if (IsKeyPressed(KEY_T))
+			capture_trigger(&modem_capture);
+		if (IsKeyPressed(KEY_F3))
+			show_spectrum = !show_spectrum;
+		if (IsKeyPressed(KEY_F4))
+			show_channel_stats = !show_channel_stats;
+		if (IsKeyPressed(KEY_W))
+			stats_window = (stats_window + 1) % CHSTATS_WINDOWS;
+		if (IsKeyPressed(KEY_X))
+			channel_stats_reset(&modem_channel_stats);
+		if (IsKeyPressed(KEY_N))
+			bodies.instanced = !bodies.instanced;
+		if (IsKeyPressed(KEY_G)) {
+			show_decor = !show_decor;
+			scene_set_visible(&decor, floor_node, show_decor);
+			scene_set_visible(&decor, axes_node, show_decor);
+			scene_set_visible(&decor, origin_node, show_decor);
+		}
+		if (IsKeyPressed(KEY_H))
+			ghosts.visible = !ghosts.visible;
+		if (IsKeyPressed(KEY_V))
+			layout = (layout + 1) % LAYOUT_COUNT;
+		if (IsKeyPressed(KEY_E)) {
+			single_pass = !single_pass;
+			bodies.single_pass = single_pass;
+		}
+		if (IsKeyPressed(KEY_TAB)) {
+			int channel = spectrum_view.channel;
+			do
+				channel = (channel + 1) % CH_COUNT;
+			while (!spectrum_has_channel(&modem_spectrum, channel));
+			spectrogram_select(&spectrum_view, channel);
+		}
+
+		// The display trails the samples by RENDER_DELAY, so keep drawing a
+		// little after the last motion until it has caught up
+		if (on_demand) {
+			double now = clock_monotonic();
+			bool settling = now - render_wake_last_motion(&modem_wake) < 2 * RENDER_DELAY;
+			bool input = GetKeyPressed() != 0 || IsWindowResized()
+				|| IsMouseButtonDown(MOUSE_BUTTON_LEFT) || GetMouseWheelMove() != 0.f;
+			drew = moved || settling || input || now - last_frame >= RENDER_WAKE_IDLE_REFRESH;
+			if (!drew) {
+				render_cost.idle++;
+				continue;
+			}
+			last_frame = now;
+		}
+		render_cost.frames++;
+
 		// Rotate a cube corresponding to the IMU measurements
-		float x_ang = DEG2RAD * orientation.x;
-		float y_ang = DEG2RAD * orientation.y;
-		Vector3 rotation_axis = { -x_ang, 0.f, y_ang };
-		float rotation_angle = RAD2DEG * Vector3Length(rotation_axis);
-		rotation_axis = Vector3Normalize(rotation_axis);
-		Vector3 pos = { 0.f, 1.f, 0.f };
-		Vector3 scale = { 1.f, 1.f, 1.f };
+		double render_time = clock_monotonic() - RENDER_DELAY;
+		imu_sample sample = { 0 };
+		sample_history_at(&history, render_time, &sample);
+		Matrix transform = device_pose(&sample);
+		const Vector3 pos = DEVICE_POSITION;
+		if (bodies.count == 0 && !skeleton_path)
+			ghost_update(&ghosts, &history, render_time, device_pose);
+		scene_set_transform(&decor, frame_node, transform);
+		scene_set_visible(&decor, frame_node, show_decor && bodies.count == 0 && !skeleton_path);
+
+		// The scene is updated once, then drawn into each view
+		if (bodies.count > 0)
+			swarm_update(&bodies, skeleton_device_rotation(sample.orientation), GetTime());
+		else if (skeleton_path) {
+			// Every device sampled at the same host time, then one pass
+			// over the chain
+			Quaternion rotation[SKELETON_MAX_DEVICES];
+			rotation[0] = skeleton_device_rotation(sample.orientation);
+			for (int i = 1; i < body.devices; i++) {
+				imu_sample s = { 0 };
+				sample_history_at(&extra_devices[i - 1].history, render_time, &s);
+				rotation[i] = skeleton_device_rotation(s.orientation);
+			}
+			skeleton_update(&body, rotation);
+		}
+		viewport views[VIEWPORT_MAX];
+		int view_count = layout_viewports(layout, &camera, views);
+		viewport_orbit(&camera, views, view_count);
 
 		BeginDrawing();
-		ClearBackground(BLACK);
-		BeginMode3D(camera);
-		DrawGrid(10,1);
-		DrawModelEx(cube_model, pos, rotation_axis, rotation_angle, scale, RED);
-		DrawModelWiresEx(cube_model, pos, rotation_axis, rotation_angle, scale, BLACK);
-		EndMode3D();
+		resolution_begin(&resolution, BLACK);
+		for (int v = 0; v < view_count; v++) {
+			const frustum* f = &views[v].frustum;
+			viewport_begin(&views[v]);
+			scene_draw(&decor);
+			if (bodies.count > 0)
+				swarm_draw(&bodies, f);
+			else if (skeleton_path)
+				skeleton_draw(&body, f);
+			else if (frustum_sphere(f, pos, DEVICE_RADIUS)) {
+				if (device_model.indices > 0)
+					cached_mesh_draw(&device_model, transform, RED, single_pass);
+				else if (single_pass) {
+					edged_cube.transform = transform;
+					DrawModel(edged_cube, Vector3Zero(), 1.f, RED);
+				}
+				else {
+					cube_model.transform = transform;
+					DrawModel(cube_model, Vector3Zero(), 1.f, RED);
+					DrawModelWires(cube_model, Vector3Zero(), 1.f, BLACK);
+				}
+			}
+			if (bodies.count == 0 && !skeleton_path)
+				ghost_draw(&ghosts, RED, YELLOW);
+			viewport_end();
+		}
+		resolution_end(&resolution);
+		// Everything from here on at native resolution
+		resolution_present(&resolution);
+		// Text from here on is queued and drawn over the panels in one call
+		double text_start = clock_monotonic();
+		viewport_decorate(&text, views, view_count);
+		if (show_stats) {
+			int y = 20 + overlay_stream_stats(&text, &modem_stats, 10, 10);
+			// The displayed sample, and how far behind the newest it is
+			imu_sample newest = { 0 };
+			bool received = sample_history_at(&history, text_start, &newest) != 0;
+			hud_line l;
+			hud_line_clear(&l);
+			hud_line_text(&l, "Angles ");
+			hud_line_fixed(&l, sample.orientation.x, 1);
+			hud_line_text(&l, " ");
+			hud_line_fixed(&l, sample.orientation.y, 1);
+			hud_line_text(&l, " deg  gyro ");
+			hud_line_fixed(&l, sample.gyro.x, 1);
+			hud_line_text(&l, " ");
+			hud_line_fixed(&l, sample.gyro.y, 1);
+			hud_line_text(&l, " ");
+			hud_line_fixed(&l, sample.gyro.z, 1);
+			if (received) {
+				hud_line_text(&l, " deg/s  newest sample ");
+				hud_line_fixed(&l, (text_start - newest.time) * 1e3, 1);
+				hud_line_text(&l, " ms old");
+			}
+			else
+				hud_line_text(&l, " deg/s  no samples yet");
+			hud_text(&text, l.text, 10, y, 20, RAYWHITE);
+			y += 24;
+			char last[COMMAND_MAX_TEXT * 2];
+			command_last(&modem_commands, last, sizeof(last));
+			hud_text(&text, last, 10, y, 20, LIGHTGRAY);
+			y += 24;
+			char calib[128];
+			calibrator_status(&modem_calibrator, calib, sizeof(calib));
+			status_line(&text, "Calibration: ", calib, y);
+			y += 24;
+			char filter[128];
+			filter_chain_status(&modem_filter, filter, sizeof(filter));
+			status_line(&text, "Filter: ", filter, y);
+			y += 24;
+			char capture[256];
+			capture_status(&modem_capture, capture, sizeof(capture));
+			status_line(&text, "Capture: ", capture, y);
+			y += 24;
+			char outliers[128];
+			outlier_status(&modem_outlier, outliers, sizeof(outliers));
+			status_line(&text, "Outliers: ", outliers, y);
+			y += 24;
+			hud_line_clear(&l);
+			hud_line_text(&l, single_pass ? "one pass, " : "two passes, ");
+			hud_line_fixed(&l, GetFrameTime() * 1e3, 2);
+			hud_line_text(&l, " ms/frame");
+			status_line(&text, "Edges: ", l.text, y);
+			y += 24;
+			hud_line_clear(&l);
+			hud_line_uint(&l, (unsigned long)text_glyphs);
+			hud_line_text(&l, " glyphs in one draw, ");
+			hud_line_fixed(&l, text_ms, 3);
+			hud_line_text(&l, " ms");
+			if (text_dropped > 0) {
+				hud_line_text(&l, ", ");
+				hud_line_uint(&l, (unsigned long)text_dropped);
+				hud_line_text(&l, " over the limit left out");
+			}
+			status_line(&text, "Text: ", l.text, y);
+			y += 24;
+			char pixels[128];
+			resolution_status(&resolution, pixels, sizeof(pixels));
+			status_line(&text, "Resolution: ", pixels, y);
+			y += 24;
+			if (bodies.count > 0) {
+				hud_line_clear(&l);
+				hud_line_int(&l, bodies.count);
+				hud_line_text(&l, bodies.instanced ? " bodies, instanced" : " bodies, per body");
+				status_line(&text, "Swarm: ", l.text, y);
+				y += 24;
+			}
+			if (ghosts.visible && bodies.count == 0 && !skeleton_path) {
+				hud_line_clear(&l);
+				hud_line_int(&l, ghosts.count);
+				hud_line_text(&l, " over ");
+				hud_line_fixed(&l, ghost_span, 1);
+				hud_line_text(&l, " s");
+				status_line(&text, "Ghosts: ", l.text, y);
+				y += 24;
+			}
+			if (recorder.active) {
+				char video[PATH_MAX + 128];
+				video_status(&recorder, video, sizeof(video));
+				status_line(&text, "Recording: ", video, y);
+				y += 24;
+			}
+			if (skeleton_path)
+				overlay_skeleton(&text, &body, 10, y + 10);
+		}
+		if (show_allan) {
+			allan_live_curve(&modem_allan, &allan_live_curve_buf);
+			overlay_allan(&text, &allan_live_curve_buf, allan_log ? &allan_recorded : NULL,
+				GetScreenWidth() - 810, 10, 800, 500);
+		}
+		if (modem_events.detectors > 0)
+			overlay_events(&text, &modem_events, render_time, GetScreenWidth() / 2 - 200, 10);
+		if (show_channel_stats)
+			overlay_channel_stats(&text, &modem_channel_stats, stats_window, 10, GetScreenHeight() - 340);
+		if (show_spectrum) {
+			spectrogram_update(&spectrum_view, &modem_spectrum);
+			overlay_spectrum(&text, &spectrum_view, GetScreenWidth() - 810, GetScreenHeight() - 530, 800, 520);
+		}
+		text_glyphs = text.glyphs;
+		text_dropped = text.dropped;
+		hud_flush(&text);
+		text_ms = (clock_monotonic() - text_start) * 1e3;
+		video_frame(&recorder);
 		EndDrawing();
 
 	}
+	render_usage_stop(&render_cost);
+	spectrogram_unload(&spectrum_view);
+	swarm_unload(&bodies);
+	ghost_unload(&ghosts);
+	hud_unload(&text);
 	UnloadModel(cube_model);
+	UnloadModel(edged_cube);
+	wireframe_unload(&wire);
+	cached_mesh_unload(&device_model);
+	scene_unload(&decor);
+	video_stop(&recorder);
+	resolution_unload(&resolution);
 	CloseWindow();
 	return NULL;
 }
@@ -0,0 +1,647 @@
+//
+// Mesh cache
+// Device models loaded once from OBJ, glTF or STL, then mapped from a cache
+//
+// Copyright (c) 2023 Jonathan Tainer. Subject to the BSD 2-Clause License.
+//
+
+#define GL_GLEXT_PROTOTYPES
+#include "mesh_cache.h"
+#include "clock_sync.h"
+#include "wireframe.h"
+#include <raymath.h>
+#include <rlgl.h>
+#include <GL/gl.h>
+#include <GL/glext.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define CACHE_MAGIC "IMUM"
+#define CACHE_VERSION 1
+
+// Cache file: this header, the vertices, then the indices, all in host
+// byte order; a source of another size or time invalidates it
+typedef struct cache_header {
+	char magic[4];
+	uint32_t version;
+	uint64_t source_size;
+	int64_t source_mtime;	// Nanoseconds
+	uint32_t vertices;
+	uint32_t indices;
+	float center[3];
+	float scale;
+} cache_header;
+
+// Interleaved as uploaded, 16 bytes
+typedef struct packed_vertex {
+	float position[3];
+	int8_t normal[4];	// Signed normalized, w unused
+} packed_vertex;
+
+// Unindexed triangles as read from the source
+typedef struct triangle_soup {
+	float* position;
+	float* normal;
+	size_t count;	// Vertices
+	size_t capacity;
+} triangle_soup;
+
+static const char* mesh_vs =
+	"#version 330\n"
+	"in vec3 vertexPosition;\n"
+	"in vec3 vertexNormal;\n"
+	"uniform mat4 mvp;\n"
+	"uniform mat4 matModel;\n"
+	"out vec3 fragNormal;\n"
+	"void main() {\n"
+	"	fragNormal = mat3(matModel) * vertexNormal;\n"
+	"	gl_Position = mvp * vec4(vertexPosition, 1.0);\n"
+	"}\n";
+
+// Same light as the swarm
+static const char* mesh_fs =
+	"#version 330\n"
+	"in vec3 fragNormal;\n"
+	"uniform vec4 colDiffuse;\n"
+	"out vec4 finalColor;\n"
+	"void main() {\n"
+	"	float light = 0.6 + 0.4 * max(dot(normalize(fragNormal), normalize(vec3(-0.4, 1.0, -0.3))), 0.0);\n"
+	"	finalColor = vec4(colDiffuse.rgb * light, colDiffuse.a);\n"
+	"}\n";
+
+// Faces with their edges in one pass: the vertices are shared, so the
+// barycentric coordinates the wireframe shader reads from vertex colors
+// are made per triangle in a geometry shader instead. Every triangle edge
+// is drawn, as on the wire pass
+static const char* edged_vs =
+	"#version 330\n"
+	"in vec3 vertexPosition;\n"
+	"in vec3 vertexNormal;\n"
+	"uniform mat4 mvp;\n"
+	"uniform mat4 matModel;\n"
+	"out vec3 geomNormal;\n"
+	"void main() {\n"
+	"	geomNormal = mat3(matModel) * vertexNormal;\n"
+	"	gl_Position = mvp * vec4(vertexPosition, 1.0);\n"
+	"}\n";
+
+static const char* edged_gs =
+	"#version 330\n"
+	"layout(triangles) in;\n"
+	"layout(triangle_strip, max_vertices = 3) out;\n"
+	"in vec3 geomNormal[];\n"
+	"out vec3 fragNormal;\n"
+	"out vec3 fragBary;\n"
+	"void main() {\n"
+	"	for (int i = 0; i < 3; i++) {\n"
+	"		gl_Position = gl_in[i].gl_Position;\n"
+	"		fragNormal = geomNormal[i];\n"
+	"		fragBary = vec3(float(i == 0), float(i == 1), float(i == 2));\n"
+	"		EmitVertex();\n"
+	"	}\n"
+	"	EndPrimitive();\n"
+	"}\n";
+
+static const char* edged_fs =
+	"#version 330\n"
+	"in vec3 fragNormal;\n"
+	"in vec3 fragBary;\n"
+	"uniform vec4 colDiffuse;\n"
+	"uniform vec4 edgeColor;\n"
+	"uniform float edgeWidth;\n"
+	"out vec4 finalColor;\n"
+	"void main() {\n"
+	"	vec3 d = fwidth(fragBary);\n"
+	"	vec3 a = smoothstep(vec3(0.0), d * edgeWidth, fragBary);\n"
+	"	float edge = 1.0 - min(a.x, min(a.y, a.z));\n"
+	"	float light = 0.6 + 0.4 * max(dot(normalize(fragNormal), normalize(vec3(-0.4, 1.0, -0.3))), 0.0);\n"
+	"	finalColor = mix(vec4(colDiffuse.rgb * light, colDiffuse.a), edgeColor, edge);\n"
+	"}\n";
+
+static int soup_push(triangle_soup* s, const float* position, const float* normal) {
+	if (s->count == s->capacity) {
+		size_t capacity = s->capacity ? 2 * s->capacity : 3 * 1024;
+		float* p = realloc(s->position, capacity * 3 * sizeof(float));
+		if (p)
+			s->position = p;
+		float* n = realloc(s->normal, capacity * 3 * sizeof(float));
+		if (n)
+			s->normal = n;
+		if (!p || !n)
+			return -1;
+		s->capacity = capacity;
+	}
+	memcpy(&s->position[3 * s->count], position, 3 * sizeof(float));
+	memcpy(&s->normal[3 * s->count], normal, 3 * sizeof(float));
+	s->count++;
+	return 0;
+}
+
+static void soup_free(triangle_soup* s) {
+	free(s->position);
+	free(s->normal);
+	*s = (triangle_soup) { 0 };
+}
+
+static void face_normal(const float* a, const float* b, const float* c, float* out) {
+	Vector3 u = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+	Vector3 w = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+	Vector3 n = Vector3Normalize(Vector3CrossProduct(u, w));
+	out[0] = n.x;
+	out[1] = n.y;
+	out[2] = n.z;
+}
+
+// Binary if the size matches the facet count in the header, otherwise
+// ASCII; the facet normals are recomputed as exporters often leave them 0
+static int load_stl(const char* path, triangle_soup* s) {
+	FILE* f = fopen(path, "rb");
+	if (!f)
+		return -1;
+	unsigned char header[84];
+	struct stat st;
+	if (fstat(fileno(f), &st) != 0 || fread(header, 1, sizeof(header), f) != sizeof(header)) {
+		fclose(f);
+		return -1;
+	}
+	uint32_t facets;
+	memcpy(&facets, &header[80], sizeof(facets));
+	int result = 0;
+	if ((uint64_t)st.st_size == 84 + 50 * (uint64_t)facets) {
+		for (uint32_t i = 0; i < facets && result == 0; i++) {
+			unsigned char facet[50];
+			float v[12];
+			if (fread(facet, 1, sizeof(facet), f) != sizeof(facet)) {
+				result = -1;
+				break;
+			}
+			memcpy(v, facet, sizeof(v));
+			float n[3];
+			face_normal(&v[3], &v[6], &v[9], n);
+			for (int k = 1; k < 4 && result == 0; k++)
+				result = soup_push(s, &v[3 * k], n);
+		}
+	}
+	else {
+		rewind(f);
+		char line[256];
+		float v[9];
+		int corner = 0;
+		while (result == 0 && fgets(line, sizeof(line), f)) {
+			if (sscanf(line, " vertex %f %f %f", &v[3 * corner], &v[3 * corner + 1], &v[3 * corner + 2]) != 3)
+				continue;
+			if (++corner < 3)
+				continue;
+			float n[3];
+			face_normal(&v[0], &v[3], &v[6], n);
+			for (int k = 0; k < 3 && result == 0; k++)
+				result = soup_push(s, &v[3 * k], n);
+			corner = 0;
+		}
+	}
+	fclose(f);
+	return result == 0 && s->count > 0 ? 0 : -1;
+}
+
+// OBJ, glTF and anything else raylib reads; its meshes are 16-bit indexed,
+// so a glTF mesh over 65536 vertices loses triangles
+static int load_raylib(const char* path, triangle_soup* s) {
+	Model model = LoadModel(path);
+	int result = 0;
+	for (int i = 0; i < model.meshCount && result == 0; i++) {
+		const Mesh* mesh = &model.meshes[i];
+		const int triangles = mesh->indices ? mesh->triangleCount : mesh->vertexCount / 3;
+		for (int t = 0; t < triangles && result == 0; t++) {
+			const float* p[3];
+			for (int k = 0; k < 3; k++)
+				p[k] = &mesh->vertices[3 * (mesh->indices ? mesh->indices[3 * t + k] : 3 * t + k)];
+			float flat[3];
+			face_normal(p[0], p[1], p[2], flat);
+			for (int k = 0; k < 3 && result == 0; k++) {
+				int v = mesh->indices ? mesh->indices[3 * t + k] : 3 * t + k;
+				result = soup_push(s, p[k], mesh->normals ? &mesh->normals[3 * v] : flat);
+			}
+		}
+	}
+	UnloadModel(model);
+	return result == 0 && s->count > 0 ? 0 : -1;
+}
+
+static int8_t quantize(float x) {
+	return (int8_t)lrintf(Clamp(x, -1.f, 1.f) * 127.f);
+}
+
+static uint64_t vertex_hash(const packed_vertex* v) {
+	const unsigned char* b = (const unsigned char*)v;
+	uint64_t h = 1469598103934665603ull;
+	for (size_t i = 0; i < sizeof(*v); i++)
+		h = (h ^ b[i]) * 1099511628211ull;
+	return h;
+}
+
+// Merge vertices equal after quantizing the normal; returns the number
+// of distinct vertices, packed to the front of v
+static uint32_t weld(packed_vertex* v, uint32_t count, uint32_t* indices) {
+	size_t size = 1;
+	while (size < 2 * (size_t)count)
+		size *= 2;
+	uint32_t* table = calloc(size, sizeof(uint32_t));	// Vertex + 1, 0 empty
+	if (!table)
+		return 0;
+	uint32_t unique = 0;
+	for (uint32_t i = 0; i < count; i++) {
+		size_t slot = vertex_hash(&v[i]) & (size - 1);
+		while (table[slot] && memcmp(&v[table[slot] - 1], &v[i], sizeof(*v)) != 0)
+			slot = (slot + 1) & (size - 1);
+		if (!table[slot]) {
+			v[unique] = v[i];
+			table[slot] = ++unique;
+		}
+		indices[i] = table[slot] - 1;
+	}
+	free(table);
+	return unique;
+}
+
+// Next fanning vertex: the candidate that will still be in the cache
+// after its remaining triangles, oldest first, else the last dead end,
+// else the next vertex in order with triangles left
+static int64_t next_fan(const uint32_t* candidates, size_t n, const uint32_t* live, const uint32_t* stamp,
+	uint32_t time, uint32_t* dead, size_t* dead_top, uint32_t* cursor, uint32_t vertices) {
+	int64_t best = -1;
+	int64_t best_priority = -1;
+	for (size_t i = 0; i < n; i++) {
+		uint32_t v = candidates[i];
+		if (live[v] == 0)
+			continue;
+		int64_t priority = 0;
+		if (time - stamp[v] + 2 * live[v] <= MESH_CACHE_VERTEX_CACHE)
+			priority = time - stamp[v];
+		if (priority > best_priority) {
+			best = v;
+			best_priority = priority;
+		}
+	}
+	if (best >= 0)
+		return best;
+	while (*dead_top > 0) {
+		uint32_t v = dead[--*dead_top];
+		if (live[v] > 0)
+			return v;
+	}
+	for (; *cursor < vertices; (*cursor)++) {
+		if (live[*cursor] > 0)
+			return *cursor;
+	}
+	return -1;
+}
+
+// Reorder triangles for the post-transform vertex cache with Tipsify
+// (Sander, Nehab and Barczak 2007), linear in the triangle count
+static int optimize_order(uint32_t* indices, uint32_t count, uint32_t vertices) {
+	const uint32_t triangles = count / 3;
+	uint32_t* offset = calloc(vertices + 1, sizeof(uint32_t));
+	uint32_t* adjacency = malloc(count * sizeof(uint32_t));
+	uint32_t* live = calloc(vertices, sizeof(uint32_t));
+	uint32_t* stamp = calloc(vertices, sizeof(uint32_t));
+	uint32_t* dead = malloc(count * sizeof(uint32_t));
+	uint32_t* candidates = malloc(count * sizeof(uint32_t));
+	uint32_t* out = malloc(count * sizeof(uint32_t));
+	bool* emitted = calloc(triangles, sizeof(bool));
+	int result = -1;
+	if (!offset || !adjacency || !live || !stamp || !dead || !candidates || !out || !emitted)
+		goto done;
+
+	// Triangles around each vertex
+	for (uint32_t i = 0; i < count; i++)
+		live[indices[i]]++;
+	for (uint32_t v = 0; v < vertices; v++)
+		offset[v + 1] = offset[v] + live[v];
+	for (uint32_t i = 0; i < count; i++)
+		adjacency[offset[indices[i]]++] = i / 3;
+	for (uint32_t v = vertices; v > 0; v--)
+		offset[v] = offset[v - 1];
+	offset[0] = 0;
+
+	uint32_t time = MESH_CACHE_VERTEX_CACHE + 1;
+	uint32_t cursor = 0;
+	size_t dead_top = 0;
+	size_t emitted_count = 0;
+	int64_t fan = 0;
+	while (fan >= 0) {
+		size_t n = 0;
+		for (uint32_t k = offset[fan]; k < offset[fan + 1]; k++) {
+			uint32_t t = adjacency[k];
+			if (emitted[t])
+				continue;
+			for (int c = 0; c < 3; c++) {
+				uint32_t v = indices[3 * t + c];
+				out[emitted_count++] = v;
+				dead[dead_top++] = v;
+				candidates[n++] = v;
+				live[v]--;
+				if (time - stamp[v] > MESH_CACHE_VERTEX_CACHE)
+					stamp[v] = time++;
+			}
+			emitted[t] = true;
+		}
+		fan = next_fan(candidates, n, live, stamp, time, dead, &dead_top, &cursor, vertices);
+	}
+	memcpy(indices, out, count * sizeof(uint32_t));
+	result = 0;
+
+done:
+	free(offset);
+	free(adjacency);
+	free(live);
+	free(stamp);
+	free(dead);
+	free(candidates);
+	free(out);
+	free(emitted);
+	return result;
+}
+
+// Number the vertices in the order the triangles first use them, so
+// fetches walk the buffer forward
+static int optimize_fetch(packed_vertex* v, uint32_t vertices, uint32_t* indices, uint32_t count) {
+	uint32_t* remap = malloc(vertices * sizeof(uint32_t));
+	packed_vertex* copy = malloc(vertices * sizeof(packed_vertex));
+	if (!remap || !copy) {
+		free(remap);
+		free(copy);
+		return -1;
+	}
+	memcpy(copy, v, vertices * sizeof(packed_vertex));
+	memset(remap, 0xff, vertices * sizeof(uint32_t));
+	uint32_t next = 0;
+	for (uint32_t i = 0; i < count; i++) {
+		uint32_t old = indices[i];
+		if (remap[old] == UINT32_MAX) {
+			remap[old] = next;
+			v[next++] = copy[old];
+		}
+		indices[i] = remap[old];
+	}
+	free(remap);
+	free(copy);
+	return 0;
+}
+
+static void fit_bounds(cache_header* h, const packed_vertex* v) {
+	Vector3 lo = { INFINITY, INFINITY, INFINITY };
+	Vector3 hi = { -INFINITY, -INFINITY, -INFINITY };
+	for (uint32_t i = 0; i < h->vertices; i++) {
+		Vector3 p = { v[i].position[0], v[i].position[1], v[i].position[2] };
+		lo = Vector3Min(lo, p);
+		hi = Vector3Max(hi, p);
+	}
+	Vector3 size = Vector3Subtract(hi, lo);
+	float side = fmaxf(size.x, fmaxf(size.y, size.z));
+	h->center[0] = 0.5f * (lo.x + hi.x);
+	h->center[1] = 0.5f * (lo.y + hi.y);
+	h->center[2] = 0.5f * (lo.z + hi.z);
+	h->scale = side > 0.f ? 1.f / side : 1.f;
+}
+
+// Read the source and build the indexed, reordered buffers
+static int convert(const char* path, cache_header* h, packed_vertex** vertices, uint32_t** indices) {
+	triangle_soup s = { 0 };
+	int result = IsFileExtension(path, ".stl") ? load_stl(path, &s) : load_raylib(path, &s);
+	if (result != 0 || s.count > UINT32_MAX) {
+		soup_free(&s);
+		return -1;
+	}
+	const uint32_t count = (uint32_t)s.count;
+	packed_vertex* v = malloc(count * sizeof(packed_vertex));
+	uint32_t* idx = malloc(count * sizeof(uint32_t));
+	if (!v || !idx) {
+		free(v);
+		free(idx);
+		soup_free(&s);
+		return -1;
+	}
+	for (uint32_t i = 0; i < count; i++) {
+		memcpy(v[i].position, &s.position[3 * i], sizeof(v[i].position));
+		for (int k = 0; k < 3; k++)
+			v[i].normal[k] = quantize(s.normal[3 * i + k]);
+		v[i].normal[3] = 0;
+	}
+	soup_free(&s);
+
+	h->indices = count;
+	h->vertices = weld(v, count, idx);
+	if (h->vertices == 0 || optimize_order(idx, count, h->vertices) != 0
+		|| optimize_fetch(v, h->vertices, idx, count) != 0) {
+		free(v);
+		free(idx);
+		return -1;
+	}
+	fit_bounds(h, v);
+	*vertices = v;
+	*indices = idx;
+	return 0;
+}
+
+// Through a temporary file, so a reader never maps a partial cache
+static int write_cache(const char* cache_path, const cache_header* h, const packed_vertex* v, const uint32_t* idx) {
+	char tmp[PATH_MAX + 8];
+	snprintf(tmp, sizeof(tmp), "%s.tmp", cache_path);
+	FILE* f = fopen(tmp, "wb");
+	if (!f)
+		return -1;
+	bool ok = fwrite(h, sizeof(*h), 1, f) == 1
+		&& fwrite(v, sizeof(*v), h->vertices, f) == h->vertices
+		&& fwrite(idx, sizeof(*idx), h->indices, f) == h->indices;
+	ok = fclose(f) == 0 && ok;
+	if (!ok || rename(tmp, cache_path) != 0) {
+		unlink(tmp);
+		return -1;
+	}
+	return 0;
+}
+
+// Map a cache made from this exact source; NULL if there is none
+static const cache_header* map_cache(const char* cache_path, const struct stat* source, size_t* length) {
+	int fd = open(cache_path, O_RDONLY);
+	if (fd < 0)
+		return NULL;
+	struct stat st;
+	void* p = MAP_FAILED;
+	if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(cache_header))
+		p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+	close(fd);
+	if (p == MAP_FAILED)
+		return NULL;
+	const cache_header* h = p;
+	const int64_t mtime = (int64_t)source->st_mtim.tv_sec * 1000000000 + source->st_mtim.tv_nsec;
+	if (memcmp(h->magic, CACHE_MAGIC, 4) != 0 || h->version != CACHE_VERSION
+		|| h->source_size != (uint64_t)source->st_size || h->source_mtime != mtime
+		|| (uint64_t)st.st_size != sizeof(*h) + (uint64_t)h->vertices * sizeof(packed_vertex) + (uint64_t)h->indices * 4) {
+		munmap(p, st.st_size);
+		return NULL;
+	}
+	*length = st.st_size;
+	return h;
+}
+
+static void upload(cached_mesh* m, const cache_header* h, const packed_vertex* v, const uint32_t* idx) {
+	m->vertices = h->vertices;
+	m->indices = h->indices;
+	m->center = (Vector3) { h->center[0], h->center[1], h->center[2] };
+	m->scale = h->scale;
+
+	m->vao = rlLoadVertexArray();
+	rlEnableVertexArray(m->vao);
+	m->vbo = rlLoadVertexBuffer(v, h->vertices * sizeof(packed_vertex), false);
+	const int position = m->shader.locs[SHADER_LOC_VERTEX_POSITION];
+	const int normal = m->shader.locs[SHADER_LOC_VERTEX_NORMAL];
+	rlSetVertexAttribute(position, 3, GL_FLOAT, false, sizeof(packed_vertex), (void*)offsetof(packed_vertex, position));
+	rlEnableVertexAttribute(position);
+	rlSetVertexAttribute(normal, 3, GL_BYTE, true, sizeof(packed_vertex), (void*)offsetof(packed_vertex, normal));
+	rlEnableVertexAttribute(normal);
+	m->ebo = rlLoadVertexBufferElement(idx, h->indices * sizeof(uint32_t), false);
+	rlDisableVertexArray();
+}
+
+// raylib only links vertex and fragment shaders; 0 if geometry shaders
+// aren't available. The attributes take the slots of the face shader, so
+// both draw from the one vertex array
+static void load_edged(cached_mesh* m) {
+	const unsigned int vs = rlCompileShader(edged_vs, GL_VERTEX_SHADER);
+	const unsigned int gs = rlCompileShader(edged_gs, GL_GEOMETRY_SHADER);
+	const unsigned int fs = rlCompileShader(edged_fs, GL_FRAGMENT_SHADER);
+	unsigned int program = 0;
+	if (vs != 0 && gs != 0 && fs != 0) {
+		program = glCreateProgram();
+		glAttachShader(program, vs);
+		glAttachShader(program, gs);
+		glAttachShader(program, fs);
+		glBindAttribLocation(program, m->shader.locs[SHADER_LOC_VERTEX_POSITION], "vertexPosition");
+		glBindAttribLocation(program, m->shader.locs[SHADER_LOC_VERTEX_NORMAL], "vertexNormal");
+		glLinkProgram(program);
+		GLint linked = GL_FALSE;
+		glGetProgramiv(program, GL_LINK_STATUS, &linked);
+		if (linked != GL_TRUE) {
+			glDeleteProgram(program);
+			program = 0;
+		}
+	}
+	glDeleteShader(vs);
+	glDeleteShader(gs);
+	glDeleteShader(fs);
+	if (program == 0) {
+		printf("Model edges need a geometry shader, drawing them on a second pass\n");
+		return;
+	}
+
+	m->edged = program;
+	m->edged_mvp = rlGetLocationUniform(program, "mvp");
+	m->edged_model = rlGetLocationUniform(program, "matModel");
+	m->edged_color = rlGetLocationUniform(program, "colDiffuse");
+	const Vector4 edge = { 0.f, 0.f, 0.f, 1.f };
+	const float width = WIREFRAME_WIDTH;
+	rlEnableShader(program);
+	rlSetUniform(rlGetLocationUniform(program, "edgeColor"), &edge, SHADER_UNIFORM_VEC4, 1);
+	rlSetUniform(rlGetLocationUniform(program, "edgeWidth"), &width, SHADER_UNIFORM_FLOAT, 1);
+	rlDisableShader();
+}
+
+int cached_mesh_load(cached_mesh* m, const char* path) {
+	*m = (cached_mesh) { 0 };
+	double start = clock_monotonic();
+	struct stat source;
+	if (stat(path, &source) != 0) {
+		printf("Failed to open model %s\n", path);
+		return -1;
+	}
+	m->shader = LoadShaderFromMemory(mesh_vs, mesh_fs);
+
+	char cache_path[PATH_MAX];
+	snprintf(cache_path, sizeof(cache_path), "%s%s", path, MESH_CACHE_SUFFIX);
+	size_t length = 0;
+	const cache_header* mapped = map_cache(cache_path, &source, &length);
+	if (mapped) {
+		// Straight from the page cache to the driver
+		const packed_vertex* v = (const packed_vertex*)(mapped + 1);
+		upload(m, mapped, v, (const uint32_t*)(v + mapped->vertices));
+		munmap((void*)mapped, length);
+		m->from_cache = true;
+	}
+	else {
+		cache_header h = { .magic = CACHE_MAGIC, .version = CACHE_VERSION, .source_size = source.st_size,
+			.source_mtime = (int64_t)source.st_mtim.tv_sec * 1000000000 + source.st_mtim.tv_nsec };
+		packed_vertex* v;
+		uint32_t* idx;
+		if (convert(path, &h, &v, &idx) != 0) {
+			printf("Failed to load model %s\n", path);
+			UnloadShader(m->shader);
+			*m = (cached_mesh) { 0 };
+			return -1;
+		}
+		if (write_cache(cache_path, &h, v, idx) != 0)
+			printf("Failed to write model cache %s\n", cache_path);
+		upload(m, &h, v, idx);
+		free(v);
+		free(idx);
+	}
+	load_edged(m);
+	m->load_ms = (clock_monotonic() - start) * 1e3;
+	printf("Model %s: %u triangles, %u vertices, %s in %.0f ms\n", path, m->indices / 3, m->vertices,
+		m->from_cache ? "from cache" : "converted", m->load_ms);
+	return 0;
+}
+
+void cached_mesh_draw(const cached_mesh* m, Matrix transform, Color color, bool single_pass) {
+	// Anything batched so far goes first, then the mesh bypasses the batch
+	rlDrawRenderBatchActive();
+	Matrix fit = MatrixMultiply(MatrixTranslate(-m->center.x, -m->center.y, -m->center.z),
+		MatrixScale(m->scale, m->scale, m->scale));
+	Matrix model = MatrixMultiply(MatrixMultiply(fit, transform), rlGetMatrixTransform());
+	Matrix mvp = MatrixMultiply(MatrixMultiply(model, rlGetMatrixModelview()), rlGetMatrixProjection());
+	Vector4 face = ColorNormalize(color);
+	rlEnableVertexArray(m->vao);
+
+	if (single_pass && m->edged != 0) {
+		rlEnableShader(m->edged);
+		rlSetUniformMatrix(m->edged_mvp, mvp);
+		rlSetUniformMatrix(m->edged_model, model);
+		rlSetUniform(m->edged_color, &face, SHADER_UNIFORM_VEC4, 1);
+		// rlgl only draws 16-bit indices
+		glDrawElements(GL_TRIANGLES, m->indices, GL_UNSIGNED_INT, NULL);
+	}
+	else {
+		rlEnableShader(m->shader.id);
+		rlSetUniformMatrix(m->shader.locs[SHADER_LOC_MATRIX_MVP], mvp);
+		rlSetUniformMatrix(m->shader.locs[SHADER_LOC_MATRIX_MODEL], model);
+		rlSetUniform(m->shader.locs[SHADER_LOC_COLOR_DIFFUSE], &face, SHADER_UNIFORM_VEC4, 1);
+		glDrawElements(GL_TRIANGLES, m->indices, GL_UNSIGNED_INT, NULL);
+		const Vector4 edge = { 0.f, 0.f, 0.f, 1.f };
+		rlSetUniform(m->shader.locs[SHADER_LOC_COLOR_DIFFUSE], &edge, SHADER_UNIFORM_VEC4, 1);
+		rlEnableWireMode();
+		glDrawElements(GL_TRIANGLES, m->indices, GL_UNSIGNED_INT, NULL);
+		rlDisableWireMode();
+	}
+	rlDisableVertexArray();
+	rlDisableShader();
+}
+
+void cached_mesh_unload(cached_mesh* m) {
+	if (m->vao == 0)
+		return;
+	rlUnloadVertexArray(m->vao);
+	rlUnloadVertexBuffer(m->vbo);
+	rlUnloadVertexBuffer(m->ebo);
+	UnloadShader(m->shader);
+	if (m->edged != 0)
+		rlUnloadShaderProgram(m->edged);
+	*m = (cached_mesh) { 0 };
+}
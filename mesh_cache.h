@@ -0,0 +1,52 @@
+//
+// Mesh cache
+// Device models loaded once from OBJ, glTF or STL, then mapped from a cache
+//
+// Copyright (c) 2023 Jonathan Tainer. Subject to the BSD 2-Clause License.
+//
+
+#ifndef MESH_CACHE_H
+#define MESH_CACHE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <raylib.h>
+
+// Written next to the source file
+#define MESH_CACHE_SUFFIX ".imucache"
+
+// Post-transform cache entries the triangle order is optimized for
+#define MESH_CACHE_VERTEX_CACHE 16
+
+// Indexed triangles with 32-bit indices, drawn outside raylib's 16-bit
+// mesh path; centered and scaled so the largest side is 1
+typedef struct cached_mesh {
+	unsigned int vao;
+	unsigned int vbo;
+	unsigned int ebo;
+	uint32_t vertices;
+	uint32_t indices;
+	Vector3 center;
+	float scale;
+	Shader shader;	// Faces, and edges on a second pass
+	unsigned int edged;	// Faces and edges in one pass, 0 without geometry shaders
+	int edged_mvp;
+	int edged_model;
+	int edged_color;
+
+	bool from_cache;
+	double load_ms;
+} cached_mesh;
+
+// Needs a window; converts the source and writes the cache if it is
+// missing or older than the source. Returns -1 on failure
+int cached_mesh_load(cached_mesh* m, const char* path);
+
+// Lit faces in the given color with every triangle edge in black, in the
+// same pass if single_pass is set and the driver allows, otherwise on a
+// second, wireframe pass
+void cached_mesh_draw(const cached_mesh* m, Matrix transform, Color color, bool single_pass);
+
+void cached_mesh_unload(cached_mesh* m);
+
+#endif
@@ -0,0 +1,309 @@
+//
+// Outlier rejection
+// Detection and repair of corrupted samples before any other processing
+//
+// Copyright (c) 2023 Jonathan Tainer. Subject to the BSD 2-Clause License.
+//
+
+#include "outlier.h"
+#include "clock_sync.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+// Scales the median absolute deviation to a standard deviation for
+// normally distributed noise
+#define MAD_SCALE 1.4826f
+
+const char* outlier_check_names[OUTLIER_CHECKS] = { "hampel", "rate", "range", "spin" };
+
+static const char* action_names[] = {
+	[OUTLIER_REPLACE] = "replace",
+	[OUTLIER_DROP] = "drop",
+	[OUTLIER_FLAG] = "flag",
+};
+
+void outlier_init(outlier_filter* o) {
+	memset(o, 0, sizeof(*o));
+	pthread_mutex_init(&o->lock, NULL);
+	o->action = OUTLIER_REPLACE;
+}
+
+bool outlier_empty(const outlier_filter* o) {
+	if (o->max_spin > 0.f)
+		return false;
+	for (int c = 0; c < CH_COUNT; c++) {
+		const outlier_channel* ch = &o->ch[c];
+		if (ch->window > 0 || ch->rate > 0.f || ch->range > 0.f)
+			return false;
+	}
+	return true;
+}
+
+int outlier_parse_action(const char* name, outlier_action* action) {
+	for (int a = OUTLIER_REPLACE; a <= OUTLIER_FLAG; a++) {
+		if (strcmp(name, action_names[a]) == 0) {
+			*action = a;
+			return 0;
+		}
+	}
+	return -1;
+}
+
+// Apply one check to the selected channels
+static int parse_check(outlier_filter* o, char* text, const bool* mask) {
+	char* fields[4] = { 0 };
+	int n = 0;
+	for (char* p = strtok(text, ":"); p && n < 4; p = strtok(NULL, ":"))
+		fields[n++] = p;
+	if (n < 2)
+		return -1;
+
+	for (int c = 0; c < CH_COUNT; c++) {
+		if (!mask[c])
+			continue;
+		outlier_channel* ch = &o->ch[c];
+		if (strcmp(fields[0], "hampel") == 0) {
+			ch->window = atoi(fields[1]) | 1;
+			ch->sigmas = n > 2 ? atof(fields[2]) : OUTLIER_DEFAULT_SIGMAS;
+			ch->floor = n > 3 ? atof(fields[3]) : OUTLIER_DEFAULT_FLOOR;
+			if (ch->window < 3 || ch->window > OUTLIER_MAX_WINDOW || ch->sigmas <= 0.f || ch->floor < 0.f)
+				return -1;
+		}
+		else if (strcmp(fields[0], "rate") == 0 && n == 2) {
+			ch->rate = atof(fields[1]);
+			if (ch->rate <= 0.f)
+				return -1;
+		}
+		else if (strcmp(fields[0], "range") == 0 && n == 2) {
+			ch->range = atof(fields[1]);
+			if (ch->range <= 0.f)
+				return -1;
+		}
+		else
+			return -1;
+	}
+	return 0;
+}
+
+int outlier_parse(outlier_filter* o, const char* spec) {
+	char* copy = strdup(spec);
+	char* checks = strchr(copy, '=');
+	if (!checks) {
+		free(copy);
+		return -1;
+	}
+	*checks++ = '\0';
+
+	bool mask[CH_COUNT];
+	int result = channel_mask_parse(copy, mask);
+
+	// Split the check list first, strtok can't nest
+	char* list[OUTLIER_CHECKS + 1];
+	int count = 0;
+	for (char* p = strtok(checks, ","); p && result == 0; p = strtok(NULL, ",")) {
+		if (count == OUTLIER_CHECKS + 1)
+			result = -1;
+		else
+			list[count++] = p;
+	}
+
+	pthread_mutex_lock(&o->lock);
+	for (int i = 0; i < count && result == 0; i++)
+		result = parse_check(o, list[i], mask);
+	pthread_mutex_unlock(&o->lock);
+	free(copy);
+	return count > 0 ? result : -1;
+}
+
+// Insertion sort, the windows are tiny
+static void sort_small(float* v, int n) {
+	for (int j = 1; j < n; j++) {
+		float x = v[j];
+		int k = j;
+		for (; k > 0 && v[k - 1] > x; k--)
+			v[k] = v[k - 1];
+		v[k] = x;
+	}
+}
+
+// Hampel identifier against the previous inputs only, so it adds no delay
+// Returns true and the median if x is an outlier
+static bool hampel(outlier_channel* ch, float x, float* median) {
+	bool outlier = false;
+	const int n = ch->window;
+	if (ch->count == n) {
+		float sorted[OUTLIER_MAX_WINDOW];
+		memcpy(sorted, ch->history, n * sizeof(float));
+		sort_small(sorted, n);
+		float m = sorted[n / 2];
+		for (int k = 0; k < n; k++)
+			sorted[k] = fabsf(sorted[k] - m);
+		sort_small(sorted, n);
+		float spread = fmaxf(MAD_SCALE * sorted[n / 2], ch->floor);
+		outlier = fabsf(x - m) > ch->sigmas * spread;
+		*median = m;
+	}
+	else
+		ch->count++;
+
+	// The window keeps raw inputs, so a real step is accepted once it
+	// fills half of it
+	ch->history[ch->head] = x;
+	ch->head = (ch->head + 1) % n;
+	return outlier;
+}
+
+// Rate limit against the last accepted value, giving up after a few samples
+// in a row since the signal has then really moved
+static bool rate_exceeded(float change, double dt, float limit, int* run) {
+	if (change <= limit * fmax(dt, OUTLIER_MIN_DT) || *run >= OUTLIER_MAX_RUN) {
+		*run = 0;
+		return false;
+	}
+	(*run)++;
+	return true;
+}
+
+void outlier_process(outlier_filter* o, sample_block* b) {
+	if (b->count == 0 || outlier_empty(o))
+		return;
+	double start = clock_monotonic();
+	pthread_mutex_lock(&o->lock);
+
+	int kept = 0;
+	for (int i = 0; i < b->count; i++) {
+		const double t = b->time[i];
+		const int channels = b->has_raw[i] ? CH_COUNT : CH_GYR_X;
+		bool bad[CH_COUNT] = { 0 };
+		float fix[CH_COUNT];
+		bool any = false;
+
+		for (int c = 0; c < channels; c++) {
+			outlier_channel* ch = &o->ch[c];
+			float x = b->ch[c][i];
+			fix[c] = x;
+
+			int check = -1;
+			float median;
+			if (ch->window > 0 && hampel(ch, x, &median)) {
+				check = OUTLIER_HAMPEL;
+				fix[c] = median;
+			}
+			else if (ch->range > 0.f && fabsf(x) > ch->range) {
+				check = OUTLIER_RANGE;
+				fix[c] = ch->has_good ? ch->good : copysignf(ch->range, x);
+			}
+			else if (ch->rate > 0.f && ch->has_good && rate_exceeded(fabsf(x - ch->good), t - ch->good_time, ch->rate, &ch->run)) {
+				check = OUTLIER_RATE;
+				fix[c] = ch->good;
+			}
+			if (check >= 0) {
+				ch->rejected[check]++;
+				bad[c] = true;
+				any = true;
+			}
+		}
+
+		// Rotation rate as one vector, from the orientation change and from
+		// the gyros; both are repaired with the last accepted vector
+		if (o->max_spin > 0.f) {
+			float ax = b->ch[CH_ANG_X][i], ay = b->ch[CH_ANG_Y][i];
+			if (o->has_good_ang) {
+				float change = hypotf(ax - o->good_ang[0], ay - o->good_ang[1]);
+				if (rate_exceeded(change, t - o->good_ang_time, o->max_spin, &o->run_ang)) {
+					for (int c = CH_ANG_X; c <= CH_ANG_Y; c++) {
+						o->ch[c].rejected[OUTLIER_SPIN] += !bad[c];
+						bad[c] = true;
+						fix[c] = o->good_ang[c - CH_ANG_X];
+					}
+					any = true;
+				}
+			}
+			float gx = b->ch[CH_GYR_X][i], gy = b->ch[CH_GYR_Y][i], gz = b->ch[CH_GYR_Z][i];
+			if (channels > CH_GYR_X && sqrtf(gx * gx + gy * gy + gz * gz) > o->max_spin) {
+				for (int c = CH_GYR_X; c <= CH_GYR_Z; c++) {
+					o->ch[c].rejected[OUTLIER_SPIN] += !bad[c];
+					bad[c] = true;
+					fix[c] = o->good_gyr[c - CH_GYR_X];
+				}
+				any = true;
+			}
+		}
+
+		// Only accepted values become the reference for the next samples
+		for (int c = 0; c < channels; c++) {
+			outlier_channel* ch = &o->ch[c];
+			if (bad[c])
+				continue;
+			ch->good = b->ch[c][i];
+			ch->good_time = t;
+			ch->has_good = true;
+		}
+		if (!bad[CH_ANG_X] && !bad[CH_ANG_Y]) {
+			o->good_ang[0] = b->ch[CH_ANG_X][i];
+			o->good_ang[1] = b->ch[CH_ANG_Y][i];
+			o->good_ang_time = t;
+			o->has_good_ang = true;
+		}
+		if (channels > CH_GYR_X && !bad[CH_GYR_X] && !bad[CH_GYR_Y] && !bad[CH_GYR_Z]) {
+			for (int c = CH_GYR_X; c <= CH_GYR_Z; c++)
+				o->good_gyr[c - CH_GYR_X] = b->ch[c][i];
+		}
+
+		o->rejected += any;
+		if (any && o->action == OUTLIER_DROP) {
+			o->dropped++;
+			continue;
+		}
+		if (any && o->action == OUTLIER_REPLACE) {
+			for (int c = 0; c < channels; c++) {
+				if (bad[c])
+					b->ch[c][i] = fix[c];
+			}
+		}
+		if (kept != i) {
+			b->time[kept] = b->time[i];
+			b->has_raw[kept] = b->has_raw[i];
+			for (int c = 0; c < CH_COUNT; c++)
+				b->ch[c][kept] = b->ch[c][i];
+		}
+		kept++;
+	}
+
+	double ns = (clock_monotonic() - start) * 1e9 / b->count;
+	o->ns_per_sample = o->samples == 0 ? ns : o->ns_per_sample + (ns - o->ns_per_sample) / 64.0;
+	o->samples += b->count;
+	b->count = kept;
+	pthread_mutex_unlock(&o->lock);
+}
+
+void outlier_status(outlier_filter* o, char* out, int len) {
+	pthread_mutex_lock(&o->lock);
+	if (outlier_empty(o))
+		snprintf(out, len, "off");
+	else
+		snprintf(out, len, "%lu of %lu samples (%.3f%%) %s, %.0f ns/sample",
+			o->rejected, o->samples, o->samples > 0 ? 100.0 * o->rejected / o->samples : 0.0,
+			o->action == OUTLIER_DROP ? "dropped" : o->action == OUTLIER_FLAG ? "flagged" : "repaired",
+			o->ns_per_sample);
+	pthread_mutex_unlock(&o->lock);
+}
+
+void outlier_report(FILE* out, outlier_filter* o) {
+	pthread_mutex_lock(&o->lock);
+	fprintf(out, "Outliers: %lu of %lu samples, %lu dropped, %.0f ns/sample, action %s\n",
+		o->rejected, o->samples, o->dropped, o->ns_per_sample, action_names[o->action]);
+	for (int c = 0; c < CH_COUNT; c++) {
+		const outlier_channel* ch = &o->ch[c];
+		char counts[128] = "";
+		int used = 0;
+		for (int k = 0; k < OUTLIER_CHECKS && used < (int)sizeof(counts); k++) {
+			if (ch->rejected[k] > 0)
+				used += snprintf(counts + used, sizeof(counts) - used, " %s %lu", outlier_check_names[k], ch->rejected[k]);
+		}
+		if (used > 0)
+			fprintf(out, "  %s:%s\n", channel_names[c], counts);
+	}
+	pthread_mutex_unlock(&o->lock);
+}
@@ -0,0 +1,105 @@
+//
+// Outlier rejection
+// Detection and repair of corrupted samples before any other processing
+//
+// Copyright (c) 2023 Jonathan Tainer. Subject to the BSD 2-Clause License.
+//
+
+#ifndef OUTLIER_H
+#define OUTLIER_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include "sample.h"
+
+#define OUTLIER_MAX_WINDOW 15
+
+// Hampel threshold in robust standard deviations, and the least spread
+// assumed so a flat, quantized signal doesn't reject every change
+#define OUTLIER_DEFAULT_SIGMAS 3.0
+#define OUTLIER_DEFAULT_FLOOR 1.0
+
+// A value held this many samples in a row is a real change, not a spike
+#define OUTLIER_MAX_RUN 4
+
+// Shortest interval assumed between samples by the rate checks, seconds
+#define OUTLIER_MIN_DT 0.001
+
+typedef enum outlier_check {
+	OUTLIER_HAMPEL = 0,	// Far from the median of the previous samples
+	OUTLIER_RATE,		// Changed faster than a limit per second
+	OUTLIER_RANGE,		// Beyond a limit in magnitude
+	OUTLIER_SPIN,		// Orientation or gyro faster than any real rotation
+	OUTLIER_CHECKS,
+} outlier_check;
+
+extern const char* outlier_check_names[OUTLIER_CHECKS];
+
+typedef enum outlier_action {
+	OUTLIER_REPLACE = 0,	// Hampel median or last good value
+	OUTLIER_DROP,		// Remove the whole sample
+	OUTLIER_FLAG,		// Count only
+} outlier_action;
+
+typedef struct outlier_channel {
+	int window;	// Hampel, 0 if off
+	float sigmas;
+	float floor;
+	float rate;	// Per second, 0 if off
+	float range;	// 0 if off
+
+	// Previous inputs, for the Hampel median
+	float history[OUTLIER_MAX_WINDOW];
+	int count;
+	int head;
+
+	// Last accepted value, for the rate check and replacement
+	float good;
+	double good_time;
+	bool has_good;
+	int run;	// Consecutive rate rejections
+
+	unsigned long rejected[OUTLIER_CHECKS];
+} outlier_channel;
+
+typedef struct outlier_filter {
+	pthread_mutex_t lock;
+	outlier_action action;
+	float max_spin;	// Degrees per second, 0 if off
+	outlier_channel ch[CH_COUNT];
+
+	// Spin check state, orientation and gyro each as one vector
+	float good_ang[2];
+	double good_ang_time;
+	bool has_good_ang;
+	int run_ang;
+	float good_gyr[3];
+
+	unsigned long samples;
+	unsigned long rejected;	// Samples with any channel rejected
+	unsigned long dropped;
+	double ns_per_sample;
+} outlier_filter;
+
+void outlier_init(outlier_filter* o);
+
+// Add checks for some channels from a specification:
+//   <channels>=<check>[,<check>...]
+// with channels as for filters and checks hampel:<n>[:<sigmas>[:<floor>]],
+// rate:<per second> and range:<magnitude>
+// Returns -1 if the specification is invalid
+int outlier_parse(outlier_filter* o, const char* spec);
+
+// replace, drop or flag
+int outlier_parse_action(const char* name, outlier_action* action);
+
+bool outlier_empty(const outlier_filter* o);
+
+// Check a block in place, before calibration and resampling (modem thread)
+void outlier_process(outlier_filter* o, sample_block* b);
+
+void outlier_status(outlier_filter* o, char* out, int len);
+void outlier_report(FILE* out, outlier_filter* o);
+
+#endif
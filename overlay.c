@@ -0,0 +1,361 @@
+//
+// Overlays
+// Diagnostic panels drawn over the 3D view
+//
+// Copyright (c) 2023 Jonathan Tainer. Subject to the BSD 2-Clause License.
+//
+
+#include "overlay.h"
+#include "clock_sync.h"
+#include <raylib.h>
+#include <math.h>
+
+#define OVERLAY_FONT 20
+#define OVERLAY_LINE 24
+#define OVERLAY_CHART_HEIGHT 60
+#define OVERLAY_BAR_WIDTH 6
+
+static const Color overlay_bg = { 0, 0, 0, 160 };
+
+// Append "label n"
+static void line_count(hud_line* l, const char* label, unsigned long n) {
+	hud_line_text(l, label);
+	hud_line_uint(l, n);
+}
+
+// Append "label value" with the given decimals
+static void line_fixed(hud_line* l, const char* label, double value, int decimals) {
+	hud_line_text(l, label);
+	hud_line_fixed(l, value, decimals);
+}
+
+// Queue a single number
+static void number(hud* h, double value, int decimals, float x, float y, float size, Color color) {
+	hud_line l;
+	hud_line_clear(&l);
+	hud_line_fixed(&l, value, decimals);
+	hud_text(h, l.text, x, y, size, color);
+}
+
+// Decade labels of the log axes
+static void decade(hud* h, double exponent, float x, float y) {
+	hud_line l;
+	hud_line_clear(&l);
+	hud_line_general(&l, pow(10.0, exponent), 6);
+	hud_text(h, l.text, x, y, 14, LIGHTGRAY);
+}
+
+int overlay_stream_stats(hud* h, stream_stats* stats, int x, int y) {
+	stream_stats s;
+	stream_stats_snapshot(stats, clock_monotonic(), &s);
+
+	stats_bucket last = { 0 };
+	stream_stats_window(&s, 10, &last);
+
+	const int width = (STATS_HISTORY_SECONDS - 1) * OVERLAY_BAR_WIDTH + 20;
+	const int height = 3 * OVERLAY_LINE + 2 * OVERLAY_CHART_HEIGHT + 30;
+	DrawRectangle(x, y, width, height, overlay_bg);
+	x += 10;
+	y += 6;
+
+	hud_line l;
+	hud_line_clear(&l);
+	hud_line_text(&l, s.name);
+	line_fixed(&l, "  ", last.counts.frames / 10.0, 1);
+	line_fixed(&l, " Hz  jitter ", stream_stats_jitter(&s) * 1e3, 2);
+	line_fixed(&l, " ms  max ", s.interval_max * 1e3, 1);
+	hud_line_text(&l, " ms");
+	hud_text(h, l.text, x, y, OVERLAY_FONT, RAYWHITE);
+	y += OVERLAY_LINE;
+	hud_line_clear(&l);
+	line_count(&l, "frames ", s.total.counts.frames);
+	line_count(&l, "  dropped ", s.total.counts.dropped);
+	line_count(&l, "  crc ", s.total.counts.crc_errors);
+	line_count(&l, "  malformed ", s.total.counts.malformed);
+	line_count(&l, "  read errors ", s.total.counts.read_errors);
+	hud_text(h, l.text, x, y, OVERLAY_FONT, RAYWHITE);
+	y += OVERLAY_LINE;
+	hud_line_clear(&l);
+	line_count(&l, "last 10 s: dropped ", last.counts.dropped);
+	line_count(&l, "  crc ", last.counts.crc_errors);
+	line_count(&l, "  malformed ", last.counts.malformed);
+	line_fixed(&l, "  ", last.counts.bytes / 10.0, 0);
+	hud_line_text(&l, " B/s");
+	hud_text(h, l.text, x, y, OVERLAY_FONT, LIGHTGRAY);
+	y += OVERLAY_LINE + 4;
+
+	// Per-second history, oldest on the left: frame count in gray,
+	// drops and errors stacked in red on top
+	unsigned long peak = 1;
+	for (int i = 0; i < STATS_HISTORY_SECONDS; i++) {
+		const stats_counters* c = &s.buckets[i].counts;
+		unsigned long n = c->frames + c->dropped + c->crc_errors + c->malformed;
+		if (n > peak)
+			peak = n;
+	}
+	for (int i = STATS_HISTORY_SECONDS - 1; i >= 1; i--) {
+		const stats_counters* c = &s.buckets[(s.second - i) % STATS_HISTORY_SECONDS].counts;
+		unsigned long bad = c->dropped + c->crc_errors + c->malformed;
+		int good_h = (int)(OVERLAY_CHART_HEIGHT * c->frames / peak);
+		int bad_h = (int)(OVERLAY_CHART_HEIGHT * bad / peak);
+		if (bad > 0 && bad_h < 2)
+			bad_h = 2;
+		int bx = x + (STATS_HISTORY_SECONDS - 1 - i) * OVERLAY_BAR_WIDTH;
+		int base = y + OVERLAY_CHART_HEIGHT;
+		DrawRectangle(bx, base - good_h, OVERLAY_BAR_WIDTH - 1, good_h, GRAY);
+		DrawRectangle(bx, base - good_h - bad_h, OVERLAY_BAR_WIDTH - 1, bad_h, RED);
+	}
+	y += OVERLAY_CHART_HEIGHT + 8;
+
+	// Inter-arrival histogram over the last 10 seconds, log2 bins
+	unsigned long hist_peak = 1;
+	for (int j = 0; j < STATS_HIST_BINS; j++)
+		if (last.hist[j] > hist_peak)
+			hist_peak = last.hist[j];
+	const int bin_width = (width - 20) / STATS_HIST_BINS;
+	double edge = STATS_HIST_MIN;
+	for (int j = 0; j < STATS_HIST_BINS; j++, edge *= 2.0) {
+		int bar = (int)((OVERLAY_CHART_HEIGHT - 16) * last.hist[j] / hist_peak);
+		int bx = x + j * bin_width;
+		DrawRectangle(bx, y + OVERLAY_CHART_HEIGHT - 16 - bar, bin_width - 2, bar, SKYBLUE);
+		hud_line_clear(&l);
+		hud_line_general(&l, edge * 1e3, 6);
+		hud_text(h, l.text, bx, y + OVERLAY_CHART_HEIGHT - 14, 10, LIGHTGRAY);
+	}
+
+	return height;
+}
+
+static const Color allan_colors[ALLAN_CHANNELS] = {
+	{ 255, 120, 120, 255 }, { 120, 255, 120, 255 },
+	{ 255, 200, 80, 255 }, { 80, 200, 255, 255 }, { 220, 120, 255, 255 },
+};
+
+// Extend the decade range to cover a curve
+static void allan_bounds(const allan_curve* c, double* lo_tau, double* hi_tau, double* lo_dev, double* hi_dev) {
+	for (int ch = 0; c && ch < ALLAN_CHANNELS; ch++) {
+		if (!c->valid[ch])
+			continue;
+		for (int p = 0; p < c->points; p++) {
+			if (c->adev[ch][p] <= 0.0)
+				continue;
+			*lo_tau = fmin(*lo_tau, c->tau[p]);
+			*hi_tau = fmax(*hi_tau, c->tau[p]);
+			*lo_dev = fmin(*lo_dev, c->adev[ch][p]);
+			*hi_dev = fmax(*hi_dev, c->adev[ch][p]);
+		}
+	}
+}
+
+static void allan_draw_curve(const allan_curve* c, Rectangle area, double t0, double t1, double d0, double d1, bool dashed) {
+	for (int ch = 0; c && ch < ALLAN_CHANNELS; ch++) {
+		if (!c->valid[ch])
+			continue;
+		Vector2 prev = { 0 };
+		bool have_prev = false;
+		for (int p = 0; p < c->points; p++) {
+			if (c->adev[ch][p] <= 0.0) {
+				have_prev = false;
+				continue;
+			}
+			Vector2 pt = {
+				area.x + area.width * (float)((log10(c->tau[p]) - t0) / (t1 - t0)),
+				area.y + area.height * (float)(1.0 - (log10(c->adev[ch][p]) - d0) / (d1 - d0)),
+			};
+			if (have_prev && (!dashed || p % 2 == 0))
+				DrawLineV(prev, pt, allan_colors[ch]);
+			prev = pt;
+			have_prev = true;
+		}
+	}
+}
+
+void overlay_allan(hud* h, const allan_curve* live, const allan_curve* recorded, int x, int y, int width, int height) {
+	DrawRectangle(x, y, width, height, overlay_bg);
+	hud_text(h, "Allan deviation (solid: live, dashed: recording)", x + 10, y + 6, OVERLAY_FONT, RAYWHITE);
+
+	double lo_tau = INFINITY, hi_tau = 0.0, lo_dev = INFINITY, hi_dev = 0.0;
+	allan_bounds(live, &lo_tau, &hi_tau, &lo_dev, &hi_dev);
+	allan_bounds(recorded, &lo_tau, &hi_tau, &lo_dev, &hi_dev);
+	if (hi_tau <= 0.0) {
+		hud_text(h, "waiting for samples", x + 10, y + 6 + OVERLAY_LINE, OVERLAY_FONT, LIGHTGRAY);
+		return;
+	}
+
+	// Whole decades on both axes
+	double t0 = floor(log10(lo_tau)), t1 = fmax(ceil(log10(hi_tau)), t0 + 1.0);
+	double d0 = floor(log10(lo_dev)), d1 = fmax(ceil(log10(hi_dev)), d0 + 1.0);
+	Rectangle area = { (float)x + 60, (float)y + 40, (float)width - 80, (float)height - 80 };
+
+	for (double t = t0; t <= t1; t += 1.0) {
+		int gx = (int)(area.x + area.width * (t - t0) / (t1 - t0));
+		DrawLine(gx, (int)area.y, gx, (int)(area.y + area.height), DARKGRAY);
+		decade(h, t, gx - 8, (int)(area.y + area.height) + 4);
+	}
+	for (double d = d0; d <= d1; d += 1.0) {
+		int gy = (int)(area.y + area.height * (1.0 - (d - d0) / (d1 - d0)));
+		DrawLine((int)area.x, gy, (int)(area.x + area.width), gy, DARKGRAY);
+		decade(h, d, x + 6, gy - 7);
+	}
+	hud_text(h, "tau (s)", (int)(area.x + area.width) - 50, (int)(area.y + area.height) + 20, 14, LIGHTGRAY);
+
+	allan_draw_curve(live, area, t0, t1, d0, d1, false);
+	allan_draw_curve(recorded, area, t0, t1, d0, d1, true);
+
+	// Legend
+	int lx = (int)area.x + 10;
+	for (int ch = 0; ch < ALLAN_CHANNELS; ch++) {
+		bool shown = (live && live->valid[ch]) || (recorded && recorded->valid[ch]);
+		if (!shown)
+			continue;
+		hud_text(h, channel_names[allan_channels[ch]], lx, (int)area.y + 4, 16, allan_colors[ch]);
+		lx += 70;
+	}
+}
+
+void overlay_spectrum(hud* h, const spectrogram* view, int x, int y, int width, int height) {
+	DrawRectangle(x, y, width, height, overlay_bg);
+	hud_line l;
+	hud_line_clear(&l);
+	hud_line_text(&l, channel_names[view->channel]);
+	line_count(&l, " spectrum  ", 2 * (view->bins - 1));
+	line_fixed(&l, "-point FFT  ", view->rate, 0);
+	line_fixed(&l, " Hz  ", view->frame_cost * 1e6, 1);
+	hud_line_text(&l, " us/frame");
+	hud_text(h, l.text, x + 10, y + 6, OVERLAY_FONT, RAYWHITE);
+
+	const double nyquist = view->rate / 2.0;
+	const int plot_height = (height - 2 * OVERLAY_LINE - 20) / 2;
+	Rectangle area = { (float)x + 50, (float)y + OVERLAY_LINE + 10, (float)width - 60, (float)plot_height };
+
+	// Averaged spectrum in dB, the top SPECTRUM_RANGE_DB below the reference
+	for (int d = 0; d <= (int)SPECTRUM_RANGE_DB; d += 20) {
+		int gy = (int)(area.y + area.height * d / SPECTRUM_RANGE_DB);
+		DrawLine((int)area.x, gy, (int)(area.x + area.width), gy, DARKGRAY);
+		number(h, view->reference - d, 0, x + 6, gy - 7, 14, LIGHTGRAY);
+	}
+	Vector2 prev = { 0 };
+	for (int k = 0; k < view->bins; k++) {
+		float db = 10.f * log10f(view->average[k] + 1e-30f);
+		float level = fminf(fmaxf((view->reference - db) / SPECTRUM_RANGE_DB, 0.f), 1.f);
+		Vector2 pt = {
+			area.x + area.width * k / (view->bins - 1),
+			area.y + area.height * level,
+		};
+		if (k > 0)
+			DrawLineV(prev, pt, YELLOW);
+		prev = pt;
+	}
+
+	// Spectrogram, oldest frame on the left; the texture is a ring of
+	// columns so it is drawn in two parts split at the oldest column
+	Rectangle waterfall = { area.x, area.y + area.height + 10, area.width, (float)plot_height };
+	int oldest = (int)(view->frames % SPECTRUM_COLUMNS);
+	float split = waterfall.width * (SPECTRUM_COLUMNS - oldest) / SPECTRUM_COLUMNS;
+	DrawTexturePro(view->texture, (Rectangle) { (float)oldest, 0.f, (float)(SPECTRUM_COLUMNS - oldest), (float)view->bins },
+		(Rectangle) { waterfall.x, waterfall.y, split, waterfall.height }, (Vector2) { 0 }, 0.f, WHITE);
+	if (oldest > 0)
+		DrawTexturePro(view->texture, (Rectangle) { 0.f, 0.f, (float)oldest, (float)view->bins },
+			(Rectangle) { waterfall.x + split, waterfall.y, waterfall.width - split, waterfall.height }, (Vector2) { 0 }, 0.f, WHITE);
+
+	// Frequency axis shared by both plots
+	for (int i = 0; i <= 4; i++) {
+		int gx = (int)(area.x + area.width * i / 4);
+		number(h, nyquist * i / 4, 0, gx - 10, (int)(waterfall.y + waterfall.height) + 4, 14, LIGHTGRAY);
+	}
+	hud_text(h, "Hz", (int)(area.x + area.width) - 20, (int)(waterfall.y + waterfall.height) + 18, 14, LIGHTGRAY);
+	number(h, nyquist, 0, x + 6, (int)waterfall.y, 14, LIGHTGRAY);
+	hud_text(h, "0", x + 6, (int)(waterfall.y + waterfall.height) - 14, 14, LIGHTGRAY);
+}
+
+int overlay_channel_stats(hud* h, channel_stats* cs, chstats_window window, int x, int y) {
+	chstats_summary s[CH_COUNT];
+	channel_stats_summary(cs, window, s);
+
+	static const char* headers[] = { "", "n", "mean", "sd", "min", "max", "p50", "p99" };
+	const int columns = sizeof(headers) / sizeof(headers[0]);
+	const int column_width = 90;
+	int rows = 0;
+	for (int c = 0; c < CH_COUNT; c++)
+		rows += s[c].n > 0;
+	const int height = (rows + 2) * OVERLAY_LINE + 12;
+	DrawRectangle(x, y, columns * column_width + 20, height, overlay_bg);
+	x += 10;
+	y += 6;
+
+	hud_line l;
+	hud_line_clear(&l);
+	hud_line_text(&l, "Channel statistics, ");
+	hud_line_text(&l, chstats_window_names[window]);
+	if (window != CHSTATS_SESSION)
+		hud_line_text(&l, " (quantiles of the last full window)");
+	hud_text(h, l.text, x, y, OVERLAY_FONT, RAYWHITE);
+	y += OVERLAY_LINE;
+	for (int k = 1; k < columns; k++)
+		hud_text(h, headers[k], x + k * column_width, y, OVERLAY_FONT, LIGHTGRAY);
+	y += OVERLAY_LINE;
+
+	for (int c = 0; c < CH_COUNT; c++) {
+		if (s[c].n == 0)
+			continue;
+		const double values[] = { s[c].mean, s[c].stddev, s[c].min, s[c].max, s[c].p50, s[c].p99 };
+		hud_text(h, channel_names[c], x, y, OVERLAY_FONT, LIGHTGRAY);
+		hud_line_clear(&l);
+		hud_line_uint(&l, s[c].n);
+		hud_text(h, l.text, x + column_width, y, OVERLAY_FONT, RAYWHITE);
+		for (int k = 0; k < 6; k++) {
+			hud_line_clear(&l);
+			hud_line_general(&l, values[k], 4);
+			hud_text(h, l.text, x + (k + 2) * column_width, y, OVERLAY_FONT, RAYWHITE);
+		}
+		y += OVERLAY_LINE;
+	}
+	return height;
+}
+
+int overlay_skeleton(hud* h, const skeleton* sk, int x, int y) {
+	const int height = (sk->segments + 1) * OVERLAY_LINE + 12;
+	DrawRectangle(x, y, 480, height, overlay_bg);
+	x += 10;
+	y += 6;
+	hud_text(h, "Joint angles (x, y, z)", x, y, OVERLAY_FONT, RAYWHITE);
+	for (int i = 0; i < sk->segments; i++) {
+		y += OVERLAY_LINE;
+		hud_text(h, sk->name[i], x, y, OVERLAY_FONT, LIGHTGRAY);
+		const float angles[3] = { sk->joint[i].x, sk->joint[i].y, sk->joint[i].z };
+		hud_line l;
+		hud_line_clear(&l);
+		for (int k = 0; k < 3; k++) {
+			if (k > 0)
+				hud_line_text(&l, " ");
+			int start = l.length;
+			hud_line_fixed(&l, angles[k], 1);
+			hud_line_pad(&l, start, 7);
+		}
+		hud_text(h, l.text, x + 200, y, OVERLAY_FONT, RAYWHITE);
+	}
+	return height;
+}
+
+void overlay_events(hud* h, event_engine* e, double now, int x, int y) {
+	event recent[EVENT_RECENT];
+	int n = event_engine_recent(e, recent, EVENT_RECENT);
+	for (int i = 0; i < n; i++) {
+		double age = now - recent[i].time;
+		if (age > EVENT_DISPLAY_TIME)
+			break;
+		// Fade out over the display time
+		Color color = Fade(YELLOW, 1.f - (float)(age / EVENT_DISPLAY_TIME));
+		const detector* d = &e->detector[recent[i].detector];
+		hud_line l;
+		hud_line_clear(&l);
+		hud_line_text(&l, "device ");
+		hud_line_int(&l, recent[i].device);
+		hud_line_text(&l, ": ");
+		hud_line_text(&l, d->text);
+		line_fixed(&l, " (", recent[i].value, 1);
+		hud_line_text(&l, ")");
+		hud_text(h, l.text, x, y, OVERLAY_FONT, color);
+		y += OVERLAY_LINE;
+	}
+}
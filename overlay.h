@@ -0,0 +1,41 @@
+//
+// Overlays
+// Diagnostic panels drawn over the 3D view
+//
+// Copyright (c) 2023 Jonathan Tainer. Subject to the BSD 2-Clause License.
+//
+
+#ifndef OVERLAY_H
+#define OVERLAY_H
+
+#include "stream_stats.h"
+#include "allan.h"
+#include "spectrum.h"
+#include "channel_stats.h"
+#include "skeleton.h"
+#include "event.h"
+#include "hud.h"
+
+// Panels are drawn straight away and their text queued on the HUD, which
+// draws it over them when flushed
+
+// Counters, timing and a rolling per-second error chart for one stream
+// Returns the height of the panel in pixels
+int overlay_stream_stats(hud* h, stream_stats* stats, int x, int y);
+
+// Log-log Allan deviation plot of the live stream and optionally a recording
+void overlay_allan(hud* h, const allan_curve* live, const allan_curve* recorded, int x, int y, int width, int height);
+
+// Averaged spectrum above the scrolling spectrogram of the selected channel
+void overlay_spectrum(hud* h, const spectrogram* view, int x, int y, int width, int height);
+
+// Table of per-channel statistics over one window, returns its height
+int overlay_channel_stats(hud* h, channel_stats* cs, chstats_window window, int x, int y);
+
+// Joint angles of every segment relative to its parent, returns the height
+int overlay_skeleton(hud* h, const skeleton* sk, int x, int y);
+
+// Events of the last few seconds, newest first
+void overlay_events(hud* h, event_engine* e, double now, int x, int y);
+
+#endif
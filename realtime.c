@@ -0,0 +1,113 @@
+//
+// Real-time scheduling
+// CPU pinning, SCHED_FIFO and memory locking for latency sensitive threads
+//
+// Copyright (c) 2023 Jonathan Tainer. Subject to the BSD 2-Clause License.
+//
+
+#define _GNU_SOURCE
+#include "realtime.h"
+#include <sched.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+
+// CPUs the process could run on before rt_pin_current narrowed them, and
+// the CPU it pinned to
+static cpu_set_t process_cpus;
+static int pinned_cpu = -1;
+
+void rt_options_init(rt_options* opt) {
+	opt->ingest_cpu = -1;
+	opt->render_cpu = -1;
+	opt->ingest_priority = 0;
+	opt->lock_memory = false;
+}
+
+static int create(pthread_t* thread, void* (*fn)(void*), void* arg, int cpu, int priority) {
+	pthread_attr_t attr;
+	pthread_attr_init(&attr);
+
+	if (cpu >= 0) {
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		CPU_SET(cpu, &set);
+		pthread_attr_setaffinity_np(&attr, sizeof(set), &set);
+	}
+
+	if (priority > 0) {
+		struct sched_param param = { 0 };
+		param.sched_priority = priority;
+		pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+		pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+		pthread_attr_setschedparam(&attr, &param);
+	}
+
+	int err = pthread_create(thread, &attr, fn, arg);
+	pthread_attr_destroy(&attr);
+	return err;
+}
+
+int rt_thread_create(pthread_t* thread, void* (*fn)(void*), void* arg, int cpu, int priority) {
+	int err = create(thread, fn, arg, cpu, priority);
+	// Drop one setting at a time, so a refused priority keeps the pinning
+	if (err != 0 && priority > 0) {
+		printf("Failed to set SCHED_FIFO priority %d (%s), using the default policy\n", priority, strerror(err));
+		err = create(thread, fn, arg, cpu, 0);
+	}
+	if (err != 0 && cpu >= 0) {
+		printf("Failed to pin thread to CPU %d (%s), leaving it unpinned\n", cpu, strerror(err));
+		err = create(thread, fn, arg, -1, 0);
+	}
+	return err;
+}
+
+int rt_pin_current(int cpu) {
+	cpu_set_t before;
+	bool known = pthread_getaffinity_np(pthread_self(), sizeof(before), &before) == 0;
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	int err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+	if (err != 0)
+		printf("Failed to pin thread to CPU %d: %s\n", cpu, strerror(err));
+	else if (known) {
+		process_cpus = before;
+		pinned_cpu = cpu;
+	}
+	return err;
+}
+
+int rt_thread_create_elsewhere(pthread_t* thread, void* (*fn)(void*), void* arg) {
+	if (pinned_cpu < 0)
+		return pthread_create(thread, NULL, fn, arg);
+	// Leave the pinned CPU out, unless it is the only one there is
+	cpu_set_t set = process_cpus;
+	CPU_CLR(pinned_cpu, &set);
+	if (CPU_COUNT(&set) == 0)
+		set = process_cpus;
+	pthread_attr_t attr;
+	pthread_attr_init(&attr);
+	pthread_attr_setaffinity_np(&attr, sizeof(set), &set);
+	int err = pthread_create(thread, &attr, fn, arg);
+	pthread_attr_destroy(&attr);
+	if (err != 0) {
+		printf("Failed to move thread off CPU %d (%s), leaving it there\n", pinned_cpu, strerror(err));
+		err = pthread_create(thread, NULL, fn, arg);
+	}
+	return err;
+}
+
+int rt_lock_memory(void) {
+	if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+		perror("mlockall");
+		return -1;
+	}
+	return 0;
+}
+
+void rt_prefault_stack(size_t bytes) {
+	unsigned char stack[bytes];
+	memset(stack, 0, bytes);
+	__asm__ volatile("" : : "r"(stack) : "memory");
+}
@@ -0,0 +1,46 @@
+//
+// Real-time scheduling
+// CPU pinning, SCHED_FIFO and memory locking for latency sensitive threads
+//
+// Copyright (c) 2023 Jonathan Tainer. Subject to the BSD 2-Clause License.
+//
+
+#ifndef REALTIME_H
+#define REALTIME_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Stack pre-faulted by threads running with locked memory
+#define RT_PREFAULT_STACK (256 * 1024)
+
+typedef struct rt_options {
+	int ingest_cpu;		// -1 to leave unpinned
+	int render_cpu;		// -1 to leave unpinned
+	int ingest_priority;	// SCHED_FIFO priority, 0 for the default policy
+	bool lock_memory;
+} rt_options;
+
+void rt_options_init(rt_options* opt);
+
+// Create a thread pinned to a CPU and running under SCHED_FIFO as requested
+// If the priority is refused, e.g. without CAP_SYS_NICE or an RLIMIT_RTPRIO
+// grant, it is dropped with a warning and the pinning kept; then likewise
+// the pinning. Returns the error of the last attempt
+int rt_thread_create(pthread_t* thread, void* (*fn)(void*), void* arg, int cpu, int priority);
+
+// Pin the calling thread to a CPU
+int rt_pin_current(int cpu);
+
+// Create a thread from a pinned one on the CPUs the process had before the
+// pinning, less the pinned CPU, rather than inheriting the pin
+int rt_thread_create_elsewhere(pthread_t* thread, void* (*fn)(void*), void* arg);
+
+// Lock current and future pages into memory
+int rt_lock_memory(void);
+
+// Touch a region of the calling thread's stack so later growth never faults
+void rt_prefault_stack(size_t bytes);
+
+#endif
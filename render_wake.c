@@ -0,0 +1,128 @@
+//
+// Render wake
+// Redraw only when a device moves, and what the render thread costs
+//
+// Copyright (c) 2023 Jonathan Tainer. Subject to the BSD 2-Clause License.
+//
+
+#define _GNU_SOURCE
+#include "render_wake.h"
+#include "clock_sync.h"
+#include <math.h>
+#include <time.h>
+#include <glob.h>
+#include <sys/resource.h>
+
+void render_wake_init(render_wake* w, bool enabled, float threshold) {
+	*w = (render_wake) { 0 };
+	pthread_mutex_init(&w->lock, NULL);
+	pthread_cond_init(&w->wake, NULL);
+	w->enabled = enabled;
+	w->threshold = threshold;
+}
+
+void render_wake_destroy(render_wake* w) {
+	pthread_mutex_destroy(&w->lock);
+	pthread_cond_destroy(&w->wake);
+}
+
+void render_wake_notify(render_wake* w, int device, const sample_block* b) {
+	if (!w->enabled || b->count == 0)
+		return;
+	Vector2* last = &w->published[device];
+	bool moved = !w->has_published[device];
+	for (int i = 0; i < b->count && !moved; i++) {
+		moved = fabsf(b->ch[CH_ANG_X][i] - last->x) > w->threshold
+			|| fabsf(b->ch[CH_ANG_Y][i] - last->y) > w->threshold;
+	}
+	if (!moved)
+		return;
+	const int i = b->count - 1;
+	*last = (Vector2) { b->ch[CH_ANG_X][i], b->ch[CH_ANG_Y][i] };
+	w->has_published[device] = true;
+
+	pthread_mutex_lock(&w->lock);
+	w->pending = true;
+	w->last_motion = b->time[i];
+	w->signals++;
+	pthread_cond_signal(&w->wake);
+	pthread_mutex_unlock(&w->lock);
+}
+
+bool render_wake_wait(render_wake* w, double timeout) {
+	struct timespec deadline;
+	clock_gettime(CLOCK_REALTIME, &deadline);
+	long ns = deadline.tv_nsec + (long)(timeout * 1e9);
+	deadline.tv_sec += ns / 1000000000;
+	deadline.tv_nsec = ns % 1000000000;
+
+	pthread_mutex_lock(&w->lock);
+	while (!w->pending) {
+		if (pthread_cond_timedwait(&w->wake, &w->lock, &deadline) != 0)
+			break;
+	}
+	bool moved = w->pending;
+	w->pending = false;
+	pthread_mutex_unlock(&w->lock);
+	return moved;
+}
+
+double render_wake_last_motion(render_wake* w) {
+	pthread_mutex_lock(&w->lock);
+	double t = w->last_motion;
+	pthread_mutex_unlock(&w->lock);
+	return t;
+}
+
+static double thread_cpu(void) {
+	struct rusage ru;
+	if (getrusage(RUSAGE_THREAD, &ru) != 0)
+		return 0.0;
+	return ru.ru_utime.tv_sec + ru.ru_utime.tv_usec * 1e-6 + ru.ru_stime.tv_sec + ru.ru_stime.tv_usec * 1e-6;
+}
+
+// Remaining energy of all batteries in Wh, or -1 without any
+static double battery_energy(void) {
+	glob_t g;
+	if (glob("/sys/class/power_supply/BAT*/energy_now", 0, NULL, &g) != 0)
+		return -1.0;
+	double total = 0.0;
+	for (size_t i = 0; i < g.gl_pathc; i++) {
+		FILE* f = fopen(g.gl_pathv[i], "r");
+		long uwh = 0;
+		if (f && fscanf(f, "%ld", &uwh) == 1)
+			total += uwh * 1e-6;
+		if (f)
+			fclose(f);
+	}
+	globfree(&g);
+	return total;
+}
+
+void render_usage_start(render_usage* u) {
+	*u = (render_usage) { 0 };
+	u->start = clock_monotonic();
+	u->cpu = thread_cpu();
+	u->energy_start = battery_energy();
+}
+
+void render_usage_stop(render_usage* u) {
+	u->stop = clock_monotonic();
+	u->cpu = thread_cpu() - u->cpu;
+	double now = battery_energy();
+	u->energy = u->energy_start >= 0.0 && now >= 0.0 ? u->energy_start - now : -1.0;
+}
+
+void render_usage_report(FILE* f, const render_usage* u, const render_wake* w) {
+	double wall = u->stop - u->start;
+	if (wall <= 0.0)
+		return;
+	fprintf(f, "Render: %lu frames in %.1f s (%.1f fps), %.2f s CPU (%.1f%% of a core)",
+		u->frames, wall, u->frames / wall, u->cpu, 100.0 * u->cpu / wall);
+	if (w->enabled)
+		fprintf(f, ", on demand: %lu motion signals above %.2f deg, %lu idle polls", w->signals, w->threshold, u->idle);
+	fprintf(f, "\n");
+	// The whole system's draw, only comparable between runs under the same load
+	if (u->energy >= 0.0)
+		fprintf(f, "  battery: %.3f Wh used, %.2f W average\n", u->energy, u->energy * 3600.0 / wall);
+}
@@ -0,0 +1,71 @@
+//
+// Render wake
+// Redraw only when a device moves, and what the render thread costs
+//
+// Copyright (c) 2023 Jonathan Tainer. Subject to the BSD 2-Clause License.
+//
+
+#ifndef RENDER_WAKE_H
+#define RENDER_WAKE_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "sample.h"
+#include "device.h"
+
+// Longest the render loop sleeps without checking for input
+#define RENDER_WAKE_INPUT_POLL 0.02
+
+// Redraw at least this often while idle, for the status text
+#define RENDER_WAKE_IDLE_REFRESH 1.0
+
+// Ingest threads signal the render thread when the orientation of a device
+// has moved by more than the threshold since it last signalled
+typedef struct render_wake {
+	pthread_mutex_t lock;
+	pthread_cond_t wake;
+	bool enabled;
+	float threshold;	// Degrees
+	bool pending;
+	double last_motion;	// Host time of the last signal
+	uint64_t signals;
+
+	// Per device, only touched by that device's ingest thread
+	Vector2 published[MAX_DEVICES];
+	bool has_published[MAX_DEVICES];
+} render_wake;
+
+void render_wake_init(render_wake* w, bool enabled, float threshold);
+
+void render_wake_destroy(render_wake* w);
+
+// Called after a device's samples reach its history
+void render_wake_notify(render_wake* w, int device, const sample_block* b);
+
+// Sleep until a device moves or the timeout passes; true if it moved
+bool render_wake_wait(render_wake* w, double timeout);
+
+// Host time of the last signal
+double render_wake_last_motion(render_wake* w);
+
+// CPU time of the render thread and battery energy over the session
+typedef struct render_usage {
+	double start;
+	double stop;
+	double cpu;	// Seconds, user and system
+	uint64_t frames;
+	uint64_t idle;	// Loop turns that drew nothing
+	double energy_start;	// Wh, negative without a battery
+	double energy;
+} render_usage;
+
+void render_usage_start(render_usage* u);
+
+// On the render thread, as the usage is that thread's
+void render_usage_stop(render_usage* u);
+
+void render_usage_report(FILE* f, const render_usage* u, const render_wake* w);
+
+#endif
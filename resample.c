@@ -0,0 +1,296 @@
+//
+// Resampling
+// Converts the irregularly timed sample stream to a fixed output rate
+//
+// Copyright (c) 2023 Jonathan Tainer. Subject to the BSD 2-Clause License.
+//
+
+#include "resample.h"
+#include <string.h>
+#include <math.h>
+
+#define RESAMPLE_MASK (RESAMPLE_RING - 1)
+
+// Arrival times closer than this belong to the same transfer
+#define RESAMPLE_BATCH_EPSILON 50e-6
+
+// Kernel is redesigned when the input period drifts by this fraction
+#define RESAMPLE_PERIOD_TOLERANCE 0.05
+
+static const char* method_names[] = {
+	[RESAMPLE_LINEAR] = "linear",
+	[RESAMPLE_CUBIC] = "cubic",
+	[RESAMPLE_SINC] = "sinc",
+};
+
+void resampler_init(resampler* r, double rate, resample_method method) {
+	memset(r, 0, sizeof(*r));
+	r->rate = rate;
+	r->method = method;
+}
+
+int resampler_parse_method(const char* name, resample_method* method) {
+	for (int m = RESAMPLE_LINEAR; m <= RESAMPLE_SINC; m++) {
+		if (strcmp(name, method_names[m]) == 0) {
+			*method = m;
+			return 0;
+		}
+	}
+	return -1;
+}
+
+// Blackman windowed sinc, tabulated at RESAMPLE_PHASES + 1 fractional
+// offsets so the kernel for any offset is a blend of two neighbours
+// Tap k of phase p weighs input sample cursor + k - (RESAMPLE_TAPS / 2 - 1)
+static void resampler_design(resampler* r) {
+	// Cut off below the lower of the two Nyquist frequencies, as a fraction
+	// of the input's; the output's is rate * period of it
+	double cutoff = fmin(1.0, r->rate * r->period) * 0.9;
+	const int half = RESAMPLE_TAPS / 2;
+	for (int p = 0; p <= RESAMPLE_PHASES; p++) {
+		double frac = (double)p / RESAMPLE_PHASES;
+		double sum = 0.0;
+		double h[RESAMPLE_TAPS];
+		for (int k = 0; k < RESAMPLE_TAPS; k++) {
+			double x = k - (half - 1) - frac;
+			double s = x == 0.0 ? 1.0 : sin(PI * cutoff * x) / (PI * cutoff * x);
+			double w = (x + half) / RESAMPLE_TAPS;
+			w = 0.42 - 0.5 * cos(2.0 * PI * w) + 0.08 * cos(4.0 * PI * w);
+			h[k] = s * w;
+			sum += h[k];
+		}
+		for (int k = 0; k < RESAMPLE_TAPS; k++)
+			r->kernel[p][k] = (float)(h[k] / sum);
+	}
+	r->design_period = r->period;
+}
+
+static void resampler_restart(resampler* r) {
+	r->first = r->count;
+	r->started = false;
+	r->restarts++;
+}
+
+void resampler_push(resampler* r, const sample_block* in) {
+	int i = 0;
+	while (i < in->count) {
+		// Find the run of samples sharing this arrival time
+		int end = i + 1;
+		while (end < in->count && in->time[end] - in->time[i] < RESAMPLE_BATCH_EPSILON)
+			end++;
+		const int run = end - i;
+		double arrival = in->time[end - 1];
+
+		// Large steps either way (gaps, clock resets) restart the grid,
+		// small reorderings are pushed just past the previous sample
+		bool have_prev = r->count > r->first;
+		double prev = have_prev ? r->time[(r->count - 1) & RESAMPLE_MASK] : 0.0;
+		if (have_prev && fabs(arrival - prev) > RESAMPLE_MAX_GAP) {
+			resampler_restart(r);
+			have_prev = false;
+		}
+		if (have_prev && arrival <= prev)
+			arrival = prev + run * RESAMPLE_BATCH_EPSILON;
+
+		// The last sample of a transfer arrived last; the others were
+		// produced one period apart before it, but not before the previous one
+		double step = r->period;
+		if (have_prev && run > 0)
+			step = fmin(step > 0.0 ? step : INFINITY, (arrival - prev) / run);
+		if (run > 1)
+			r->batches++;
+
+		for (int j = i; j < end; j++) {
+			unsigned long n = r->count++ & RESAMPLE_MASK;
+			r->time[n] = arrival - (end - 1 - j) * step;
+			r->has_raw[n] = in->has_raw[j];
+			for (int c = 0; c < CH_COUNT; c++)
+				r->ch[c][n] = in->ch[c][j];
+		}
+
+		// Input period from arrivals over at least half a second
+		r->period_count += run;
+		if (r->period_time == 0.0) {
+			r->period_time = arrival;
+			r->period_count = 0;
+		}
+		else if (arrival - r->period_time >= 0.5 && arrival - r->period_time < RESAMPLE_MAX_GAP * 4) {
+			double period = (arrival - r->period_time) / r->period_count;
+			r->period = r->period > 0.0 ? r->period + (period - r->period) / 4.0 : period;
+			r->period_time = arrival;
+			r->period_count = 0;
+		}
+		else if (arrival - r->period_time >= RESAMPLE_MAX_GAP * 4) {
+			r->period_time = arrival;
+			r->period_count = 0;
+		}
+		i = end;
+	}
+}
+
+// Orientation as the quaternion the renderer builds: rotation about
+// (-x, 0, y) by the length of that vector
+static void orientation_to_quat(float x, float y, double q[4]) {
+	double ax = -x * DEG2RAD, az = y * DEG2RAD;
+	double angle = sqrt(ax * ax + az * az);
+	double s = angle > 1e-12 ? sin(angle / 2.0) / angle : 0.5;
+	q[0] = ax * s;
+	q[1] = 0.0;
+	q[2] = az * s;
+	q[3] = cos(angle / 2.0);
+}
+
+static void quat_to_orientation(const double q[4], float* x, float* y) {
+	double len = sqrt(q[0] * q[0] + q[2] * q[2]);
+	double angle = 2.0 * atan2(len, q[3]);
+	double s = len > 1e-12 ? angle / len : 2.0;
+	*x = (float)(-q[0] * s * RAD2DEG);
+	*y = (float)(q[2] * s * RAD2DEG);
+}
+
+static void slerp(const double a[4], const double b_in[4], double u, double out[4]) {
+	double b[4] = { b_in[0], b_in[1], b_in[2], b_in[3] };
+	double dot = a[0] * b[0] + a[1] * b[1] + a[2] * b[2] + a[3] * b[3];
+	if (dot < 0.0) {
+		for (int k = 0; k < 4; k++)
+			b[k] = -b[k];
+		dot = -dot;
+	}
+	double wa = 1.0 - u, wb = u;
+	if (dot < 0.9995) {
+		double theta = acos(dot);
+		wa = sin((1.0 - u) * theta) / sin(theta);
+		wb = sin(u * theta) / sin(theta);
+	}
+	double norm = 0.0;
+	for (int k = 0; k < 4; k++) {
+		out[k] = wa * a[k] + wb * b[k];
+		norm += out[k] * out[k];
+	}
+	norm = sqrt(norm);
+	for (int k = 0; k < 4; k++)
+		out[k] /= norm;
+}
+
+// Ring slot of input sample n, held at the ends of the valid range
+static unsigned long resampler_slot(const resampler* r, long n) {
+	long lo = (long)r->first;
+	if ((long)r->count - RESAMPLE_RING > lo)
+		lo = (long)r->count - RESAMPLE_RING;
+	long hi = (long)r->count - 1;
+	n = n < lo ? lo : n > hi ? hi : n;
+	return (unsigned long)n & RESAMPLE_MASK;
+}
+
+// Samples needed after the cursor by each method
+static int resampler_lookahead(const resampler* r) {
+	switch (r->method) {
+	case RESAMPLE_CUBIC:
+		return 2;
+	case RESAMPLE_SINC:
+		return RESAMPLE_TAPS / 2;
+	default:
+		return 1;
+	}
+}
+
+static void resampler_output(resampler* r, double t, sample_block* out) {
+	const long j = (long)r->cursor;
+	const unsigned long s0 = resampler_slot(r, j), s1 = resampler_slot(r, j + 1);
+	const double t0 = r->time[s0], t1 = r->time[s1];
+	const double u = t1 > t0 ? (t - t0) / (t1 - t0) : 0.0;
+	const int i = out->count++;
+	out->time[i] = t;
+	out->has_raw[i] = r->has_raw[s0] && r->has_raw[s1];
+
+	if (r->method == RESAMPLE_LINEAR) {
+		for (int c = 0; c < CH_COUNT; c++)
+			out->ch[c][i] = r->ch[c][s0] + (float)u * (r->ch[c][s1] - r->ch[c][s0]);
+	}
+	else if (r->method == RESAMPLE_CUBIC) {
+		// Cubic Hermite between the two samples, with tangents from the
+		// neighbours on their actual times; falls back to the secant where
+		// a neighbour is missing or coincides
+		const unsigned long sp = resampler_slot(r, j - 1), sn = resampler_slot(r, j + 2);
+		const double h = t1 - t0;
+		const double dp = r->time[s1] - r->time[sp], dn = r->time[sn] - t0;
+		const double u2 = u * u, u3 = u2 * u;
+		const double h00 = 2.0 * u3 - 3.0 * u2 + 1.0, h10 = u3 - 2.0 * u2 + u;
+		const double h01 = -2.0 * u3 + 3.0 * u2, h11 = u3 - u2;
+		for (int c = 0; c < CH_COUNT; c++) {
+			double v0 = r->ch[c][s0], v1 = r->ch[c][s1];
+			double secant = h > 0.0 ? (v1 - v0) / h : 0.0;
+			double m0 = sp != s0 && dp > h ? (v1 - r->ch[c][sp]) / dp : secant;
+			double m1 = sn != s1 && dn > h ? (r->ch[c][sn] - v0) / dn : secant;
+			out->ch[c][i] = (float)(h00 * v0 + h10 * h * m0 + h01 * v1 + h11 * h * m1);
+		}
+	}
+	else {
+		// Blend the two tabulated phases around the fractional offset
+		double phase = u * RESAMPLE_PHASES;
+		int p = (int)phase;
+		if (p >= RESAMPLE_PHASES)
+			p = RESAMPLE_PHASES - 1;
+		float f = (float)(phase - p);
+		float kernel[RESAMPLE_TAPS];
+		unsigned long s[RESAMPLE_TAPS];
+		for (int k = 0; k < RESAMPLE_TAPS; k++) {
+			kernel[k] = r->kernel[p][k] + f * (r->kernel[p + 1][k] - r->kernel[p][k]);
+			s[k] = resampler_slot(r, j + k - (RESAMPLE_TAPS / 2 - 1));
+		}
+		for (int c = 0; c < CH_COUNT; c++) {
+			float v = 0.f;
+			for (int k = 0; k < RESAMPLE_TAPS; k++)
+				v += kernel[k] * r->ch[c][s[k]];
+			out->ch[c][i] = v;
+		}
+	}
+
+	double qa[4], qb[4], q[4];
+	orientation_to_quat(r->ch[CH_ANG_X][s0], r->ch[CH_ANG_Y][s0], qa);
+	orientation_to_quat(r->ch[CH_ANG_X][s1], r->ch[CH_ANG_Y][s1], qb);
+	slerp(qa, qb, u, q);
+	quat_to_orientation(q, &out->ch[CH_ANG_X][i], &out->ch[CH_ANG_Y][i]);
+}
+
+bool resampler_pull(resampler* r, sample_block* out) {
+	out->count = 0;
+	if (r->count == r->first)
+		return false;
+	if (r->method == RESAMPLE_SINC && r->period > 0.0 &&
+		(r->design_period == 0.0 || fabs(r->period / r->design_period - 1.0) > RESAMPLE_PERIOD_TOLERANCE))
+		resampler_design(r);
+
+	// The grid is aligned to multiples of the output period so restarts
+	// keep the same phase
+	if (!r->started) {
+		r->grid_start = ceil(r->time[r->first & RESAMPLE_MASK] * r->rate) / r->rate;
+		r->grid_index = 0;
+		r->cursor = r->first;
+		r->started = true;
+	}
+
+	// The band-limited kernel needs the input period, until then interpolate
+	resample_method method = r->method;
+	if (method == RESAMPLE_SINC && r->design_period == 0.0)
+		r->method = RESAMPLE_CUBIC;
+	const unsigned long ahead = resampler_lookahead(r);
+	while (out->count < SAMPLE_BLOCK_LEN) {
+		double t = r->grid_start + r->grid_index / r->rate;
+		while (r->cursor + 1 < r->count && r->time[(r->cursor + 1) & RESAMPLE_MASK] <= t)
+			r->cursor++;
+		if (r->cursor + ahead >= r->count)
+			break;
+		resampler_output(r, t, out);
+		r->grid_index++;
+	}
+	r->method = method;
+	r->produced += out->count;
+	return out->count > 0;
+}
+
+void resampler_report(FILE* out, const resampler* r) {
+	fprintf(out, "Resampled to %.1f Hz (%s) from %.1f Hz: %lu samples, %lu restarts, %lu batched transfers\n",
+		r->rate, method_names[r->method], r->period > 0.0 ? 1.0 / r->period : 0.0,
+		r->produced, r->restarts, r->batches);
+}
@@ -0,0 +1,81 @@
+//
+// Resampling
+// Converts the irregularly timed sample stream to a fixed output rate
+//
+// Copyright (c) 2023 Jonathan Tainer. Subject to the BSD 2-Clause License.
+//
+
+#ifndef RESAMPLE_H
+#define RESAMPLE_H
+
+#include <stdbool.h>
+#include <stdio.h>
+#include "sample.h"
+
+// Input samples kept for interpolation
+#define RESAMPLE_RING 256
+
+// Band-limited interpolation kernel: taps and tabulated fractional phases
+#define RESAMPLE_TAPS 16
+#define RESAMPLE_PHASES 64
+
+// Gaps longer than this (seconds) restart the output grid instead of
+// interpolating across them
+#define RESAMPLE_MAX_GAP 0.25
+
+typedef enum resample_method {
+	RESAMPLE_LINEAR = 0,
+	RESAMPLE_CUBIC,
+	RESAMPLE_SINC,
+} resample_method;
+
+// Scalar channels are interpolated with the chosen method; the orientation
+// is converted to the quaternion the renderer draws and interpolated with
+// slerp, whatever the method
+typedef struct resampler {
+	double rate;
+	resample_method method;
+
+	// Input ring, structure of arrays like sample_block
+	double time[RESAMPLE_RING];
+	bool has_raw[RESAMPLE_RING];
+	float ch[CH_COUNT][RESAMPLE_RING];
+	unsigned long count;	// Samples pushed
+	unsigned long first;	// First sample since the last restart
+
+	// Input period, estimated over windows of at least half a second
+	double period;
+	double period_time;
+	unsigned long period_count;
+
+	// Output grid: sample k is at grid_start + k / rate
+	bool started;
+	double grid_start;
+	unsigned long grid_index;
+	unsigned long cursor;	// Last input sample at or before the next output
+
+	// Kernel for the current input period
+	double design_period;
+	float kernel[RESAMPLE_PHASES + 1][RESAMPLE_TAPS];
+
+	unsigned long produced;
+	unsigned long restarts;
+	unsigned long batches;	// Runs of samples sharing one arrival time
+} resampler;
+
+void resampler_init(resampler* r, double rate, resample_method method);
+
+// Returns -1 for an unknown method name
+int resampler_parse_method(const char* name, resample_method* method);
+
+// Add input samples; runs of samples stamped with the same arrival time
+// (one USB transfer) are spread back over the input period
+void resampler_push(resampler* r, const sample_block* in);
+
+// Fill a block with the output samples the input now covers
+// Returns false when no more can be produced until the next push
+bool resampler_pull(resampler* r, sample_block* out);
+
+void resampler_report(FILE* out, const resampler* r);
+
+#endif
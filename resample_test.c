@@ -0,0 +1,68 @@
+//
+// Resampling test
+// Checks that the sinc resampler passes tones below the output Nyquist
+// frequency and stops those above it
+//
+// Copyright (c) 2023 Jonathan Tainer. Subject to the BSD 2-Clause License.
+//
+
+#include "resample.h"
+#include <stdio.h>
+#include <math.h>
+
+#define INPUT_RATE 200.0
+#define OUTPUT_RATE 50.0
+#define SECONDS 4.0
+#define SETTLE 1.0	// Before the input period is known and the kernel designed
+
+static int failures = 0;
+
+// RMS of a unit sine at the frequency after resampling, once settled
+static double resampled_rms(double frequency) {
+	static resampler r;
+	resampler_init(&r, OUTPUT_RATE, RESAMPLE_SINC);
+	sample_block in = { 0 };
+	sample_block out;
+	double sum = 0.0;
+	int count = 0;
+	const int samples = (int)(SECONDS * INPUT_RATE);
+	for (int n = 0; n < samples; n++) {
+		const double t = 1.0 + n / INPUT_RATE;
+		const int i = in.count++;
+		in.time[i] = t;
+		in.has_raw[i] = true;
+		for (int c = 0; c < CH_COUNT; c++)
+			in.ch[c][i] = 0.f;
+		in.ch[CH_ACC_X][i] = (float)sin(2.0 * PI * frequency * t);
+		if (in.count < 8 && n < samples - 1)
+			continue;
+		resampler_push(&r, &in);
+		in.count = 0;
+		while (resampler_pull(&r, &out)) {
+			for (int k = 0; k < out.count; k++) {
+				if (out.time[k] < 1.0 + SETTLE)
+					continue;
+				sum += out.ch[CH_ACC_X][k] * out.ch[CH_ACC_X][k];
+				count++;
+			}
+		}
+	}
+	return count > 0 ? sqrt(sum / count) : 0.0;
+}
+
+static void expect(double frequency, double lo, double hi) {
+	const double rms = resampled_rms(frequency);
+	const bool ok = rms >= lo && rms <= hi;
+	printf("%5.1f Hz from %.0f to %.0f Hz: rms %.4f, expected %.4f to %.4f%s\n", frequency, INPUT_RATE,
+		OUTPUT_RATE, rms, lo, hi, ok ? "" : " FAILED");
+	failures += !ok;
+}
+
+int main(void) {
+	// A unit sine has an RMS of 0.707
+	expect(2.0, 0.65, 0.75);
+	// Above the output Nyquist frequency of 25 Hz, which would alias
+	expect(60.0, 0.0, 0.05);
+	expect(80.0, 0.0, 0.05);
+	return failures == 0 ? 0 : 1;
+}
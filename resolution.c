@@ -0,0 +1,138 @@
+//
+// Resolution
+// 3D views rendered at a scale of the window adjusted to hold a GPU time
+//
+// Copyright (c) 2023 Jonathan Tainer. Subject to the BSD 2-Clause License.
+//
+
+#define GL_GLEXT_PROTOTYPES
+#include "resolution.h"
+#include <rlgl.h>
+#include <GL/gl.h>
+#include <GL/glext.h>
+#include <math.h>
+
+// Weight of each new GPU time in the smoothed one
+#define RESOLUTION_SMOOTHING 0.1f
+
+void resolution_init(dynamic_resolution* r, bool enabled, float target_ms) {
+	*r = (dynamic_resolution) { 0 };
+	r->enabled = enabled;
+	r->target_ms = target_ms;
+	r->scale = 1.f;
+	r->gpu_ms = -1.f;
+	if (enabled)
+		glGenQueries(RESOLUTION_QUERIES, r->query);
+}
+
+void resolution_unload(dynamic_resolution* r) {
+	if (!r->enabled)
+		return;
+	if (r->target.id != 0)
+		UnloadRenderTexture(r->target);
+	glDeleteQueries(RESOLUTION_QUERIES, r->query);
+}
+
+// Reallocate the target when the window or the scale has changed
+static void fit_target(dynamic_resolution* r) {
+	const int width = GetRenderWidth();
+	const int height = GetRenderHeight();
+	const int w = (int)(width * r->scale);
+	const int h = (int)(height * r->scale);
+	if (r->target.id != 0 && width == r->window_width && height == r->window_height
+		&& r->target.texture.width == w && r->target.texture.height == h)
+		return;
+	if (r->target.id != 0)
+		UnloadRenderTexture(r->target);
+	r->target = LoadRenderTexture(w > 0 ? w : 1, h > 0 ? h : 1);
+	SetTextureFilter(r->target.texture, TEXTURE_FILTER_BILINEAR);
+	r->window_width = width;
+	r->window_height = height;
+}
+
+void resolution_begin(dynamic_resolution* r, Color color) {
+	if (!r->enabled) {
+		ClearBackground(color);
+		return;
+	}
+	fit_target(r);
+	// The viewports follow the target through the framebuffer size
+	BeginTextureMode(r->target);
+	ClearBackground(color);
+	glBeginQuery(GL_TIME_ELAPSED, r->query[r->issued % RESOLUTION_QUERIES]);
+}
+
+// Pixels scale with the square of the scale, so aim for the target in one
+// step when over it, then creep back up while there is room
+static void adjust(dynamic_resolution* r) {
+	if (r->gpu_ms < 0.f || --r->settle > 0)
+		return;
+	float scale = r->scale;
+	if (r->gpu_ms > r->target_ms)
+		scale = floorf(scale * sqrtf(r->target_ms / r->gpu_ms) / RESOLUTION_STEP) * RESOLUTION_STEP;
+	else if (r->gpu_ms < RESOLUTION_HEADROOM * r->target_ms)
+		scale += RESOLUTION_STEP;
+	scale = fminf(fmaxf(scale, RESOLUTION_MIN_SCALE), 1.f);
+	if (scale != r->scale) {
+		r->scale = scale;
+		r->changes++;
+		r->settle = RESOLUTION_SETTLE;
+	}
+}
+
+void resolution_end(dynamic_resolution* r) {
+	if (!r->enabled)
+		return;
+	rlDrawRenderBatchActive();
+	glEndQuery(GL_TIME_ELAPSED);
+	EndTextureMode();
+	r->issued++;
+	r->frames++;
+	r->scale_sum += r->scale;
+
+	// The oldest query, if the GPU has got to it; never wait
+	if (r->issued >= RESOLUTION_QUERIES) {
+		const unsigned int query = r->query[r->issued % RESOLUTION_QUERIES];
+		GLint available = 0;
+		glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+		if (available) {
+			GLuint64 ns = 0;
+			glGetQueryObjectui64v(query, GL_QUERY_RESULT, &ns);
+			const float ms = ns * 1e-6f;
+			r->gpu_ms = r->gpu_ms < 0.f ? ms : r->gpu_ms + RESOLUTION_SMOOTHING * (ms - r->gpu_ms);
+		}
+	}
+	adjust(r);
+}
+
+void resolution_present(dynamic_resolution* r) {
+	if (!r->enabled)
+		return;
+	const Texture2D t = r->target.texture;
+	// Render textures are upside down
+	DrawTexturePro(t, (Rectangle) { 0.f, 0.f, (float)t.width, (float)-t.height },
+		(Rectangle) { 0.f, 0.f, (float)GetScreenWidth(), (float)GetScreenHeight() },
+		(Vector2) { 0.f, 0.f }, 0.f, WHITE);
+}
+
+void resolution_status(const dynamic_resolution* r, char* buf, size_t len) {
+	if (!r->enabled)
+		snprintf(buf, len, "%dx%d, native", GetRenderWidth(), GetRenderHeight());
+	else if (r->gpu_ms < 0.f)
+		snprintf(buf, len, "%dx%d (%.0f%%), no GPU time yet", r->target.texture.width, r->target.texture.height,
+			100.f * r->scale);
+	else
+		snprintf(buf, len, "%dx%d (%.0f%%), 3D %.2f ms of %.2f", r->target.texture.width, r->target.texture.height,
+			100.f * r->scale, r->gpu_ms, r->target_ms);
+}
+
+void resolution_report(FILE* f, const dynamic_resolution* r) {
+	if (!r->enabled || r->frames == 0)
+		return;
+	fprintf(f, "Resolution: mean scale %.0f%% over %lu frames, %lu changes, 3D pass ", 100.0 * r->scale_sum / r->frames,
+		r->frames, r->changes);
+	if (r->gpu_ms < 0.f)
+		fprintf(f, "not timed (no query results)\n");
+	else
+		fprintf(f, "%.2f ms against a target of %.2f ms\n", r->gpu_ms, r->target_ms);
+}
@@ -0,0 +1,67 @@
+//
+// Resolution
+// 3D views rendered at a scale of the window adjusted to hold a GPU time
+//
+// Copyright (c) 2023 Jonathan Tainer. Subject to the BSD 2-Clause License.
+//
+
+#ifndef RESOLUTION_H
+#define RESOLUTION_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <raylib.h>
+
+// Timer queries in flight; a result is read this many frames after it was
+// issued, when it is ready without waiting
+#define RESOLUTION_QUERIES 4
+
+// Scales are multiples of this, so small changes in load don't reallocate
+// the target every frame
+#define RESOLUTION_STEP (1.f / 16.f)
+
+#define RESOLUTION_MIN_SCALE 0.25f
+
+// Frames between changes of scale, for the smoothed time to follow
+#define RESOLUTION_SETTLE 15
+
+// Scale back up once the 3D pass takes less than this fraction of the target
+#define RESOLUTION_HEADROOM 0.7f
+
+typedef struct dynamic_resolution {
+	bool enabled;
+	float target_ms;	// GPU time of the 3D pass
+	float scale;	// Of the render size, per axis
+	RenderTexture2D target;
+	int window_width;	// Render size the target was made for
+	int window_height;
+
+	unsigned int query[RESOLUTION_QUERIES];
+	uint64_t issued;
+	float gpu_ms;	// Smoothed, negative until the first result
+	int settle;
+
+	uint64_t frames;
+	double scale_sum;
+	uint64_t changes;
+} dynamic_resolution;
+
+// Needs a window; disabled, the views are drawn straight to the window
+void resolution_init(dynamic_resolution* r, bool enabled, float target_ms);
+
+void resolution_unload(dynamic_resolution* r);
+
+// Around the 3D views, inside BeginDrawing; clears the target to color
+void resolution_begin(dynamic_resolution* r, Color color);
+void resolution_end(dynamic_resolution* r);
+
+// Stretch the views over the window, before anything drawn at native
+// resolution
+void resolution_present(dynamic_resolution* r);
+
+void resolution_status(const dynamic_resolution* r, char* buf, size_t len);
+
+void resolution_report(FILE* f, const dynamic_resolution* r);
+
+#endif
@@ -0,0 +1,106 @@
+//
+// Sample history
+// Timestamped orientation samples shared between the modem and render threads
+//
+// Copyright (c) 2023 Jonathan Tainer. Subject to the BSD 2-Clause License.
+//
+
+#include "sample.h"
+#include <string.h>
+
+const char* channel_names[CH_COUNT] = {
+	"ang.x", "ang.y",
+	"gyr.x", "gyr.y", "gyr.z",
+	"acc.x", "acc.y", "acc.z",
+	"mag.x", "mag.y", "mag.z",
+};
+
+int channel_mask_parse(char* list, bool mask[CH_COUNT]) {
+	memset(mask, 0, CH_COUNT * sizeof(bool));
+	for (char* name = strtok(list, "+"); name; name = strtok(NULL, "+")) {
+		bool found = false;
+		size_t len = strlen(name);
+		for (int c = 0; c < CH_COUNT; c++) {
+			bool group = strncmp(channel_names[c], name, len) == 0 && channel_names[c][len] == '.';
+			if (strcmp(name, "all") == 0 || group || strcmp(channel_names[c], name) == 0) {
+				mask[c] = true;
+				found = true;
+			}
+		}
+		if (!found)
+			return -1;
+	}
+	return 0;
+}
+
+bool sample_block_append(sample_block* b, const imu_sample* s) {
+	if (b->count >= SAMPLE_BLOCK_LEN)
+		return false;
+	int i = b->count++;
+	b->time[i] = s->time;
+	b->has_raw[i] = s->has_raw;
+	b->ch[CH_ANG_X][i] = s->orientation.x;
+	b->ch[CH_ANG_Y][i] = s->orientation.y;
+	b->ch[CH_GYR_X][i] = s->gyro.x;
+	b->ch[CH_GYR_Y][i] = s->gyro.y;
+	b->ch[CH_GYR_Z][i] = s->gyro.z;
+	b->ch[CH_ACC_X][i] = s->accel.x;
+	b->ch[CH_ACC_Y][i] = s->accel.y;
+	b->ch[CH_ACC_Z][i] = s->accel.z;
+	b->ch[CH_MAG_X][i] = s->mag.x;
+	b->ch[CH_MAG_Y][i] = s->mag.y;
+	b->ch[CH_MAG_Z][i] = s->mag.z;
+	return true;
+}
+
+void sample_block_get(const sample_block* b, int i, imu_sample* s) {
+	s->time = b->time[i];
+	s->has_raw = b->has_raw[i];
+	s->orientation = (Vector2) { b->ch[CH_ANG_X][i], b->ch[CH_ANG_Y][i] };
+	s->gyro = (Vector3) { b->ch[CH_GYR_X][i], b->ch[CH_GYR_Y][i], b->ch[CH_GYR_Z][i] };
+	s->accel = (Vector3) { b->ch[CH_ACC_X][i], b->ch[CH_ACC_Y][i], b->ch[CH_ACC_Z][i] };
+	s->mag = (Vector3) { b->ch[CH_MAG_X][i], b->ch[CH_MAG_Y][i], b->ch[CH_MAG_Z][i] };
+}
+
+void sample_history_init(sample_history* h) {
+	memset(h, 0, sizeof(*h));
+	pthread_mutex_init(&h->lock, NULL);
+}
+
+void sample_history_push(sample_history* h, imu_sample s) {
+	pthread_mutex_lock(&h->lock);
+	h->buf[h->count % SAMPLE_HISTORY_LEN] = s;
+	h->count++;
+	pthread_mutex_unlock(&h->lock);
+}
+
+int sample_history_at(sample_history* h, double time, imu_sample* out) {
+	pthread_mutex_lock(&h->lock);
+	if (h->count == 0) {
+		pthread_mutex_unlock(&h->lock);
+		return 0;
+	}
+
+	unsigned long newest = h->count - 1;
+	unsigned long oldest = h->count > SAMPLE_HISTORY_LEN ? h->count - SAMPLE_HISTORY_LEN : 0;
+
+	// Walk back from the newest sample to find the pair bracketing the time
+	unsigned long i = newest;
+	while (i > oldest && h->buf[i % SAMPLE_HISTORY_LEN].time > time)
+		i--;
+
+	imu_sample a = h->buf[i % SAMPLE_HISTORY_LEN];
+	if (i == newest || a.time > time) {
+		*out = a;
+	}
+	else {
+		imu_sample b = h->buf[(i + 1) % SAMPLE_HISTORY_LEN];
+		float t = (b.time > a.time) ? (float)((time - a.time) / (b.time - a.time)) : 1.f;
+		*out = b;
+		out->time = time;
+		out->orientation.x = a.orientation.x + (b.orientation.x - a.orientation.x) * t;
+		out->orientation.y = a.orientation.y + (b.orientation.y - a.orientation.y) * t;
+	}
+	pthread_mutex_unlock(&h->lock);
+	return 1;
+}
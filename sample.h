@@ -0,0 +1,82 @@
+//
+// Sample history
+// Timestamped orientation samples shared between the modem and render threads
+//
+// Copyright (c) 2023 Jonathan Tainer. Subject to the BSD 2-Clause License.
+//
+
+#ifndef SAMPLE_H
+#define SAMPLE_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <raylib.h>
+
+#define SAMPLE_HISTORY_LEN 256
+
+// Samples are processed in blocks of at most this many
+#define SAMPLE_BLOCK_LEN 64
+
+typedef struct imu_sample {
+	double time; // Host CLOCK_MONOTONIC seconds
+	Vector2 orientation;
+
+	// Raw sensor readings, only valid if the frame carried them
+	bool has_raw;
+	Vector3 gyro;
+	Vector3 accel;
+	Vector3 mag;
+} imu_sample;
+
+// Channel index of each scalar in a sample
+typedef enum imu_channel {
+	CH_ANG_X = 0,
+	CH_ANG_Y,
+	CH_GYR_X,
+	CH_GYR_Y,
+	CH_GYR_Z,
+	CH_ACC_X,
+	CH_ACC_Y,
+	CH_ACC_Z,
+	CH_MAG_X,
+	CH_MAG_Y,
+	CH_MAG_Z,
+	CH_COUNT,
+} imu_channel;
+
+extern const char* channel_names[CH_COUNT];
+
+// Select channels from a '+' separated list of names, groups ("ang", "gyr",
+// "acc", "mag") or "all"; modifies the list, returns -1 for an unknown name
+int channel_mask_parse(char* list, bool mask[CH_COUNT]);
+
+// Structure-of-arrays block of consecutive samples for batch processing
+typedef struct sample_block {
+	int count;
+	double time[SAMPLE_BLOCK_LEN];
+	bool has_raw[SAMPLE_BLOCK_LEN];
+	float ch[CH_COUNT][SAMPLE_BLOCK_LEN];
+} sample_block;
+
+// Returns false if the block is full
+bool sample_block_append(sample_block* b, const imu_sample* s);
+
+void sample_block_get(const sample_block* b, int i, imu_sample* s);
+
+// Ring of the most recent samples, written by one thread and read by others
+typedef struct sample_history {
+	pthread_mutex_t lock;
+	imu_sample buf[SAMPLE_HISTORY_LEN];
+	unsigned long count;
+} sample_history;
+
+void sample_history_init(sample_history* h);
+
+void sample_history_push(sample_history* h, imu_sample s);
+
+// Sample interpolated at the given host time
+// Holds the oldest/newest sample outside the stored range
+// Returns 0 if no samples have been received yet
+int sample_history_at(sample_history* h, double time, imu_sample* out);
+
+#endif
@@ -0,0 +1,159 @@
+//
+// Scene
+// Static geometry baked into vertex buffers once and drawn by reference
+//
+// Copyright (c) 2023 Jonathan Tainer. Subject to the BSD 2-Clause License.
+//
+
+#include "scene.h"
+#include <raymath.h>
+#include <rlgl.h>
+#include <GL/gl.h>
+#include <stddef.h>
+#include <stdlib.h>
+
+// Vertex colors only, no lighting
+static const char* scene_vs =
+	"#version 330\n"
+	"in vec3 vertexPosition;\n"
+	"in vec4 vertexColor;\n"
+	"uniform mat4 mvp;\n"
+	"out vec4 fragColor;\n"
+	"void main() {\n"
+	"	fragColor = vertexColor;\n"
+	"	gl_Position = mvp * vec4(vertexPosition, 1.0);\n"
+	"}\n";
+
+static const char* scene_fs =
+	"#version 330\n"
+	"in vec4 fragColor;\n"
+	"out vec4 finalColor;\n"
+	"void main() {\n"
+	"	finalColor = fragColor;\n"
+	"}\n";
+
+void scene_init(scene* s) {
+	*s = (scene) { 0 };
+	s->shader = LoadShaderFromMemory(scene_vs, scene_fs);
+}
+
+void scene_unload(scene* s) {
+	for (int i = 0; i < s->count; i++) {
+		rlUnloadVertexArray(s->nodes[i].vao);
+		rlUnloadVertexBuffer(s->nodes[i].vbo);
+	}
+	UnloadShader(s->shader);
+	free(s->build);
+	*s = (scene) { 0 };
+}
+
+void scene_begin(scene* s) {
+	s->build_count = 0;
+}
+
+static void push_vertex(scene* s, Vector3 p, Color color) {
+	if (s->build_count == s->build_capacity) {
+		int capacity = s->build_capacity ? 2 * s->build_capacity : 256;
+		scene_vertex* build = realloc(s->build, capacity * sizeof(scene_vertex));
+		if (!build)
+			return;
+		s->build = build;
+		s->build_capacity = capacity;
+	}
+	s->build[s->build_count++] = (scene_vertex) { { p.x, p.y, p.z }, { color.r, color.g, color.b, color.a } };
+}
+
+void scene_line(scene* s, Vector3 a, Vector3 b, Color color) {
+	push_vertex(s, a, color);
+	push_vertex(s, b, color);
+}
+
+void scene_triangle(scene* s, Vector3 a, Vector3 b, Vector3 c, Color color) {
+	push_vertex(s, a, color);
+	push_vertex(s, b, color);
+	push_vertex(s, c, color);
+}
+
+int scene_end(scene* s, bool triangles) {
+	if (s->count == SCENE_MAX_NODES || s->build_count == 0)
+		return -1;
+	scene_node* n = &s->nodes[s->count];
+	n->count = s->build_count;
+	n->primitive = triangles ? GL_TRIANGLES : GL_LINES;
+	n->transform = MatrixIdentity();
+	n->visible = true;
+
+	n->vao = rlLoadVertexArray();
+	rlEnableVertexArray(n->vao);
+	n->vbo = rlLoadVertexBuffer(s->build, s->build_count * sizeof(scene_vertex), false);
+	const int position = s->shader.locs[SHADER_LOC_VERTEX_POSITION];
+	const int color = s->shader.locs[SHADER_LOC_VERTEX_COLOR];
+	rlSetVertexAttribute(position, 3, GL_FLOAT, false, sizeof(scene_vertex), (void*)offsetof(scene_vertex, position));
+	rlEnableVertexAttribute(position);
+	rlSetVertexAttribute(color, 4, GL_UNSIGNED_BYTE, true, sizeof(scene_vertex), (void*)offsetof(scene_vertex, color));
+	rlEnableVertexAttribute(color);
+	rlDisableVertexArray();
+	s->build_count = 0;
+	return s->count++;
+}
+
+int scene_add_grid(scene* s, int slices, float spacing) {
+	const float half = 0.5f * slices * spacing;
+	scene_begin(s);
+	for (int i = 0; i <= slices; i++) {
+		// DrawGrid darkens the line through the origin each way
+		Color color = 2 * i == slices ? (Color) { 128, 128, 128, 255 } : (Color) { 191, 191, 191, 255 };
+		float d = -half + i * spacing;
+		scene_line(s, (Vector3) { d, 0.f, -half }, (Vector3) { d, 0.f, half }, color);
+		scene_line(s, (Vector3) { -half, 0.f, d }, (Vector3) { half, 0.f, d }, color);
+	}
+	return scene_end(s, false);
+}
+
+int scene_add_axes(scene* s, float length) {
+	scene_begin(s);
+	scene_line(s, Vector3Zero(), (Vector3) { length, 0.f, 0.f }, RED);
+	scene_line(s, Vector3Zero(), (Vector3) { 0.f, length, 0.f }, GREEN);
+	scene_line(s, Vector3Zero(), (Vector3) { 0.f, 0.f, length }, BLUE);
+	return scene_end(s, false);
+}
+
+int scene_add_floor(scene* s, float size, Color color) {
+	const float h = 0.5f * size;
+	const float y = -0.01f;	// Below the grid lines
+	Vector3 a = { -h, y, -h };
+	Vector3 b = { -h, y, h };
+	Vector3 c = { h, y, h };
+	Vector3 d = { h, y, -h };
+	scene_begin(s);
+	scene_triangle(s, a, b, c, color);
+	scene_triangle(s, a, c, d, color);
+	return scene_end(s, true);
+}
+
+void scene_set_transform(scene* s, int node, Matrix transform) {
+	if (node >= 0 && node < s->count)
+		s->nodes[node].transform = transform;
+}
+
+void scene_set_visible(scene* s, int node, bool visible) {
+	if (node >= 0 && node < s->count)
+		s->nodes[node].visible = visible;
+}
+
+void scene_draw(const scene* s) {
+	// Anything batched so far goes first, then the nodes bypass the batch
+	rlDrawRenderBatchActive();
+	const Matrix view = MatrixMultiply(MatrixMultiply(rlGetMatrixTransform(), rlGetMatrixModelview()), rlGetMatrixProjection());
+	rlEnableShader(s->shader.id);
+	for (int i = 0; i < s->count; i++) {
+		const scene_node* n = &s->nodes[i];
+		if (!n->visible)
+			continue;
+		rlSetUniformMatrix(s->shader.locs[SHADER_LOC_MATRIX_MVP], MatrixMultiply(n->transform, view));
+		rlEnableVertexArray(n->vao);
+		glDrawArrays(n->primitive, 0, n->count);
+	}
+	rlDisableVertexArray();
+	rlDisableShader();
+}
@@ -0,0 +1,72 @@
+//
+// Scene
+// Static geometry baked into vertex buffers once and drawn by reference
+//
+// Copyright (c) 2023 Jonathan Tainer. Subject to the BSD 2-Clause License.
+//
+
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <stdbool.h>
+#include <raylib.h>
+
+#define SCENE_MAX_NODES 32
+
+typedef struct scene_vertex {
+	float position[3];
+	unsigned char color[4];
+} scene_vertex;
+
+// Geometry uploaded once; only the transform and visibility change after
+typedef struct scene_node {
+	unsigned int vao;
+	unsigned int vbo;
+	int count;	// Vertices
+	int primitive;	// GL_LINES or GL_TRIANGLES
+	Matrix transform;
+	bool visible;
+} scene_node;
+
+// Retained list drawn in insertion order, one draw call per node; nodes
+// are built between scene_begin and scene_end
+typedef struct scene {
+	scene_node nodes[SCENE_MAX_NODES];
+	int count;
+	Shader shader;
+
+	scene_vertex* build;
+	int build_count;
+	int build_capacity;
+} scene;
+
+// Needs a window
+void scene_init(scene* s);
+
+void scene_unload(scene* s);
+
+void scene_begin(scene* s);
+
+void scene_line(scene* s, Vector3 a, Vector3 b, Color color);
+
+void scene_triangle(scene* s, Vector3 a, Vector3 b, Vector3 c, Color color);
+
+// Upload what was built as lines or triangles; returns the node or -1
+int scene_end(scene* s, bool triangles);
+
+// Square grid of lines on the floor as raylib's DrawGrid
+int scene_add_grid(scene* s, int slices, float spacing);
+
+// X, Y and Z in red, green and blue
+int scene_add_axes(scene* s, float length);
+
+// Square under the grid
+int scene_add_floor(scene* s, float size, Color color);
+
+void scene_set_transform(scene* s, int node, Matrix transform);
+
+void scene_set_visible(scene* s, int node, bool visible);
+
+void scene_draw(const scene* s);
+
+#endif
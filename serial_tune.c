@@ -0,0 +1,169 @@
+//
+// Serial tuning
+// Low latency settings for USB-serial adapters and burst timing measurement
+//
+// Copyright (c) 2023 Jonathan Tainer. Subject to the BSD 2-Clause License.
+//
+
+#include "serial_tune.h"
+#include "clock_sync.h"
+#include <stdlib.h>
+#include <string.h>
+#include <libgen.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+
+int serial_open(const char* dev, speed_t baud, struct termios* saved) {
+	int fd = open(dev, O_RDWR | O_NOCTTY);
+	if (fd < 0)
+		return -1;
+
+	struct termios newtio = { 0 };
+	tcgetattr(fd, saved); // Save current serial port settings
+	newtio.c_cflag = baud | CRTSCTS | CS8 | CLOCAL | CREAD;
+	// Raw input: lines and binary frames are split by the frame decoder
+	newtio.c_iflag = IGNPAR;
+	newtio.c_oflag = 0;
+	newtio.c_lflag = 0;
+	newtio.c_cc[VINTR]	= 0;	/* Ctrl-c */
+	newtio.c_cc[VQUIT]	= 0;	/* Ctrl-\ */
+	newtio.c_cc[VERASE]	= 0;	/* del */
+	newtio.c_cc[VKILL]	= 0;	/* @ */
+	newtio.c_cc[VEOF]	= 4;	/* Ctrl-d */
+	newtio.c_cc[VTIME]	= 0;	/* inter-character timer unused */
+	newtio.c_cc[VMIN]	= 1;	/* blocking read until 1 character arrives */
+	newtio.c_cc[VSWTC]	= 0;	/* '\0' */
+	newtio.c_cc[VSTART]	= 0;	/* Ctrl-q */
+	newtio.c_cc[VSTOP]	= 0;	/* Ctrl-s */
+	newtio.c_cc[VSUSP]	= 0;	/* Ctrl-z */
+	newtio.c_cc[VEOL]	= 0;	/* '\0' */
+	newtio.c_cc[VREPRINT]	= 0;	/* Ctrl-r */
+	newtio.c_cc[VDISCARD]	= 0;	/* Ctrl-u */
+	newtio.c_cc[VWERASE]	= 0;	/* Ctrl-w */
+	newtio.c_cc[VLNEXT]	= 0;	/* Ctrl-v */
+	newtio.c_cc[VEOL2]	= 0;	/* '\0' */
+
+	// Clear modem line and activate new port settings
+	tcflush(fd, TCIFLUSH);
+	tcsetattr(fd, TCSANOW, &newtio);
+	return fd;
+}
+
+void serial_tuning_init(serial_tuning* t) {
+	memset(t, 0, sizeof(*t));
+	t->saved_latency_timer = -1;
+}
+
+int serial_tune_low_latency(int fd, serial_tuning* t) {
+	struct serial_struct ss;
+	if (ioctl(fd, TIOCGSERIAL, &ss) != 0) {
+		perror("TIOCGSERIAL");
+		return -1;
+	}
+	t->saved_serial = ss;
+	ss.flags |= ASYNC_LOW_LATENCY;
+	if (ioctl(fd, TIOCSSERIAL, &ss) != 0) {
+		perror("TIOCSSERIAL");
+		return -1;
+	}
+	t->low_latency_set = true;
+	return 0;
+}
+
+static int read_int_file(const char* path) {
+	FILE* f = fopen(path, "r");
+	if (!f)
+		return -1;
+	int value = -1;
+	if (fscanf(f, "%d", &value) != 1)
+		value = -1;
+	fclose(f);
+	return value;
+}
+
+static int write_int_file(const char* path, int value) {
+	FILE* f = fopen(path, "w");
+	if (!f)
+		return -1;
+	int ok = fprintf(f, "%d\n", value) > 0;
+	return (fclose(f) == 0 && ok) ? 0 : -1;
+}
+
+int serial_tune_latency_timer(const char* dev, int ms, serial_tuning* t) {
+	// Resolve symlinks such as /dev/serial/by-id/... to the tty name
+	char real[PATH_MAX];
+	if (!realpath(dev, real)) {
+		perror(dev);
+		return -1;
+	}
+	snprintf(t->latency_path, sizeof(t->latency_path), "/sys/class/tty/%s/device/latency_timer", basename(real));
+
+	int old = read_int_file(t->latency_path);
+	if (old < 0) {
+		printf("No latency_timer for %s (not an FTDI adapter?)\n", dev);
+		return -1;
+	}
+	if (write_int_file(t->latency_path, ms) != 0) {
+		perror(t->latency_path);
+		return -1;
+	}
+	t->saved_latency_timer = old;
+	printf("latency_timer %d ms -> %d ms\n", old, ms);
+	return 0;
+}
+
+void serial_tune_restore(int fd, serial_tuning* t) {
+	if (t->low_latency_set) {
+		ioctl(fd, TIOCSSERIAL, &t->saved_serial);
+		t->low_latency_set = false;
+	}
+	if (t->saved_latency_timer >= 0) {
+		write_int_file(t->latency_path, t->saved_latency_timer);
+		t->saved_latency_timer = -1;
+	}
+}
+
+void serial_probe_bursts(int fd, double seconds, burst_report* out) {
+	memset(out, 0, sizeof(*out));
+	char buf[1024];
+	double start = clock_monotonic();
+	double last_read = 0.0, last_burst = 0.0, interval_sum = 0.0;
+	struct pollfd pfd = { .fd = fd, .events = POLLIN };
+
+	for (double now = start; now - start < seconds; now = clock_monotonic()) {
+		int wait_ms = (int)((seconds - (now - start)) * 1e3) + 1;
+		if (poll(&pfd, 1, wait_ms) <= 0)
+			continue;
+		int res = read(fd, buf, sizeof(buf));
+		double arrival = clock_monotonic();
+		if (res <= 0)
+			break;
+		out->reads++;
+		out->bytes += res;
+
+		if (last_read == 0.0 || arrival - last_read > SERIAL_BURST_GAP) {
+			if (last_burst > 0.0) {
+				double interval = arrival - last_burst;
+				interval_sum += interval;
+				if (interval > out->max_interval)
+					out->max_interval = interval;
+			}
+			last_burst = arrival;
+			out->bursts++;
+		}
+		last_read = arrival;
+	}
+
+	out->duration = clock_monotonic() - start;
+	if (out->bursts > 1)
+		out->mean_interval = interval_sum / (double)(out->bursts - 1);
+}
+
+void serial_print_bursts(FILE* f, const char* label, const burst_report* r) {
+	fprintf(f, "%s: %lu reads in %lu bursts over %.1f s, %.1f B/burst, interval mean %.2f ms max %.2f ms\n",
+		label, r->reads, r->bursts, r->duration,
+		r->bursts ? (double)r->bytes / r->bursts : 0.0,
+		r->mean_interval * 1e3, r->max_interval * 1e3);
+}
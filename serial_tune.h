@@ -0,0 +1,58 @@
+//
+// Serial tuning
+// Low latency settings for USB-serial adapters and burst timing measurement
+//
+// Copyright (c) 2023 Jonathan Tainer. Subject to the BSD 2-Clause License.
+//
+
+#ifndef SERIAL_TUNE_H
+#define SERIAL_TUNE_H
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <limits.h>
+#include <termios.h>
+#include <linux/serial.h>
+
+// Reads closer together than this are counted as one USB transfer
+#define SERIAL_BURST_GAP 0.0005
+
+// Original settings, restored on exit
+typedef struct serial_tuning {
+	bool low_latency_set;
+	struct serial_struct saved_serial;
+
+	int saved_latency_timer;	// -1 if untouched
+	char latency_path[PATH_MAX];
+} serial_tuning;
+
+typedef struct burst_report {
+	unsigned long reads;
+	unsigned long bursts;
+	unsigned long bytes;
+	double mean_interval;	// Seconds between the starts of consecutive bursts
+	double max_interval;
+	double duration;
+} burst_report;
+
+// Open a port for raw 8N1 input at the given speed, saving its settings
+// for the caller to restore; returns the descriptor or -1
+int serial_open(const char* dev, speed_t baud, struct termios* saved);
+
+void serial_tuning_init(serial_tuning* t);
+
+// Set ASYNC_LOW_LATENCY on the port via TIOCSSERIAL
+int serial_tune_low_latency(int fd, serial_tuning* t);
+
+// Write the FTDI latency_timer (ms) in sysfs for the tty behind dev
+int serial_tune_latency_timer(const char* dev, int ms, serial_tuning* t);
+
+void serial_tune_restore(int fd, serial_tuning* t);
+
+// Read from the port for a while and measure how the data is batched
+// The data read is discarded
+void serial_probe_bursts(int fd, double seconds, burst_report* out);
+
+void serial_print_bursts(FILE* f, const char* label, const burst_report* r);
+
+#endif
@@ -0,0 +1,120 @@
+//
+// Skeleton
+// Kinematic chain of rigid segments, each following one IMU
+//
+// Copyright (c) 2023 Jonathan Tainer. Subject to the BSD 2-Clause License.
+//
+
+#include "skeleton.h"
+#include <string.h>
+#include <math.h>
+
+static const Color device_colors[SKELETON_MAX_DEVICES] = {
+	RED, ORANGE, GOLD, LIME, SKYBLUE, VIOLET, PINK, BEIGE,
+};
+
+static int find_segment(const skeleton* sk, const char* name) {
+	for (int i = 0; i < sk->segments; i++) {
+		if (strcmp(sk->name[i], name) == 0)
+			return i;
+	}
+	return -1;
+}
+
+static int parse_segment(skeleton* sk, const char* line) {
+	char name[32], parent[32];
+	int device;
+	float length;
+	Vector3 mount = { 0 };
+	int n = sscanf(line, "segment %31s %31s %d %f %f %f %f", name, parent, &device, &length, &mount.x, &mount.y, &mount.z);
+	if (n != 4 && n != 7)
+		return -1;
+	if (sk->segments == SKELETON_MAX_SEGMENTS || device < 0 || device >= SKELETON_MAX_DEVICES || length <= 0.f)
+		return -1;
+	if (find_segment(sk, name) >= 0)
+		return -1;
+
+	// Parents must come first, which also rules out cycles
+	int p = -1;
+	if (strcmp(parent, "-") != 0 && (p = find_segment(sk, parent)) < 0)
+		return -1;
+
+	int i = sk->segments++;
+	snprintf(sk->name[i], sizeof(sk->name[i]), "%s", name);
+	sk->parent[i] = p;
+	sk->device[i] = device;
+	sk->length[i] = length;
+	sk->radius[i] = 0.1f * length;
+	sk->mount[i] = QuaternionFromEuler(mount.x * DEG2RAD, mount.y * DEG2RAD, mount.z * DEG2RAD);
+	if (device >= sk->devices)
+		sk->devices = device + 1;
+	return 0;
+}
+
+int skeleton_load(skeleton* sk, const char* path) {
+	memset(sk, 0, sizeof(*sk));
+	FILE* f = fopen(path, "r");
+	if (!f) {
+		printf("Failed to open skeleton %s\n", path);
+		return -1;
+	}
+	char line[256];
+	int number = 0;
+	int result = 0;
+	while (result == 0 && fgets(line, sizeof(line), f)) {
+		number++;
+		char word[16] = "";
+		if (sscanf(line, "%15s", word) != 1 || word[0] == '#')
+			continue;
+		if (strcmp(word, "origin") == 0)
+			result = sscanf(line, "origin %f %f %f", &sk->origin.x, &sk->origin.y, &sk->origin.z) == 3 ? 0 : -1;
+		else
+			result = parse_segment(sk, line);
+		if (result != 0)
+			printf("%s:%d: invalid line: %s", path, number, line);
+	}
+	fclose(f);
+	if (result == 0 && sk->segments == 0) {
+		printf("%s: no segments\n", path);
+		result = -1;
+	}
+	return result;
+}
+
+Quaternion skeleton_device_rotation(Vector2 orientation) {
+	Vector3 axis = { -DEG2RAD * orientation.x, 0.f, DEG2RAD * orientation.y };
+	return QuaternionFromAxisAngle(axis, Vector3Length(axis));
+}
+
+void skeleton_update(skeleton* sk, const Quaternion* device) {
+	const Vector3 up = { 0.f, 1.f, 0.f };
+	for (int i = 0; i < sk->segments; i++) {
+		const int p = sk->parent[i];
+		Quaternion q = QuaternionMultiply(device[sk->device[i]], sk->mount[i]);
+		Quaternion relative = p < 0 ? q : QuaternionMultiply(QuaternionInvert(sk->rotation[p]), q);
+		sk->rotation[i] = q;
+		sk->joint[i] = Vector3Scale(QuaternionToEuler(relative), RAD2DEG);
+		sk->base[i] = p < 0 ? sk->origin : sk->tip[p];
+		sk->tip[i] = Vector3Add(sk->base[i], Vector3Scale(Vector3RotateByQuaternion(up, q), sk->length[i]));
+	}
+}
+
+void skeleton_draw(const skeleton* sk, const frustum* f) {
+	for (int i = 0; i < sk->segments; i++) {
+		Vector3 middle = Vector3Lerp(sk->base[i], sk->tip[i], 0.5f);
+		if (f && !frustum_sphere(f, middle, 0.5f * sk->length[i] + 1.2f * sk->radius[i]))
+			continue;
+		Color color = device_colors[sk->device[i]];
+		DrawCylinderEx(sk->base[i], sk->tip[i], sk->radius[i], 0.7f * sk->radius[i], 12, color);
+		DrawCylinderWiresEx(sk->base[i], sk->tip[i], sk->radius[i], 0.7f * sk->radius[i], 12, BLACK);
+		DrawSphere(sk->base[i], 1.2f * sk->radius[i], LIGHTGRAY);
+	}
+}
+
+void skeleton_print(FILE* out, const skeleton* sk) {
+	fprintf(out, "Skeleton: %d segments on %d devices\n", sk->segments, sk->devices);
+	for (int i = 0; i < sk->segments; i++) {
+		fprintf(out, "  %s: device %d, length %g, parent %s\n", sk->name[i], sk->device[i], sk->length[i],
+			sk->parent[i] < 0 ? "none" : sk->name[sk->parent[i]]);
+	}
+}
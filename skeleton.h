@@ -0,0 +1,60 @@
+//
+// Skeleton
+// Kinematic chain of rigid segments, each following one IMU
+//
+// Copyright (c) 2023 Jonathan Tainer. Subject to the BSD 2-Clause License.
+//
+
+#ifndef SKELETON_H
+#define SKELETON_H
+
+#include <stdio.h>
+#include <raylib.h>
+#include <raymath.h>
+#include "viewport.h"
+
+#define SKELETON_MAX_SEGMENTS 16
+#define SKELETON_MAX_DEVICES 8
+
+// Segments are stored parents first, so one pass in order sees every
+// parent before its children
+typedef struct skeleton {
+	int segments;
+	int devices;	// Highest device index used plus one
+	Vector3 origin;	// Base of the root segments
+
+	// Configuration
+	char name[SKELETON_MAX_SEGMENTS][32];
+	int parent[SKELETON_MAX_SEGMENTS];	// -1 for a root
+	int device[SKELETON_MAX_SEGMENTS];
+	float length[SKELETON_MAX_SEGMENTS];
+	float radius[SKELETON_MAX_SEGMENTS];
+	Quaternion mount[SKELETON_MAX_SEGMENTS];	// Segment axes in the sensor frame
+
+	// Pose, recomputed every frame
+	Quaternion rotation[SKELETON_MAX_SEGMENTS];	// World
+	Vector3 base[SKELETON_MAX_SEGMENTS];
+	Vector3 tip[SKELETON_MAX_SEGMENTS];
+	Vector3 joint[SKELETON_MAX_SEGMENTS];	// Relative to the parent, degrees
+} skeleton;
+
+// Read segments from a file with one per line:
+//   segment <name> <parent or -> <device> <length> [<roll> <pitch> <yaw>]
+// the angles being how the sensor is mounted on the segment, in degrees,
+// and optionally
+//   origin <x> <y> <z>
+// Returns -1 if the file can't be read or is invalid
+int skeleton_load(skeleton* sk, const char* path);
+
+// Rotation of a device from its two reported angles, as the cube view uses
+Quaternion skeleton_device_rotation(Vector2 orientation);
+
+// Forward kinematics and joint angles from one rotation per device
+void skeleton_update(skeleton* sk, const Quaternion* device);
+
+// Segments outside the frustum are skipped, unless it is NULL
+void skeleton_draw(const skeleton* sk, const frustum* f);
+
+void skeleton_print(FILE* out, const skeleton* sk);
+
+#endif
@@ -0,0 +1,342 @@
+//
+// Spectrum
+// Streaming windowed FFT of every channel with a scrolling spectrogram
+//
+// Copyright (c) 2023 Jonathan Tainer. Subject to the BSD 2-Clause License.
+//
+
+#include "spectrum.h"
+#include "clock_sync.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+int spectrum_init(spectrum* s, int size) {
+	memset(s, 0, sizeof(*s));
+	if (size < SPECTRUM_MIN_SIZE || size > SPECTRUM_MAX_SIZE || (size & (size - 1)) != 0)
+		return -1;
+	pthread_mutex_init(&s->lock, NULL);
+	s->size = size;
+	s->bins = size / 2 + 1;
+	s->hop = size / 2;
+
+	s->window = malloc(size * sizeof(float));
+	s->bitrev = malloc(size * sizeof(int));
+	s->twiddle_re = malloc(size * sizeof(float));
+	s->twiddle_im = malloc(size * sizeof(float));
+	s->re = malloc(size * sizeof(float));
+	s->im = malloc(size * sizeof(float));
+	s->columns = calloc((size_t)CH_COUNT * SPECTRUM_COLUMNS * s->bins, 1);
+	bool ok = s->window && s->bitrev && s->twiddle_re && s->twiddle_im && s->re && s->im && s->columns;
+	for (int c = 0; c < CH_COUNT; c++) {
+		s->input[c] = calloc(size, sizeof(float));
+		s->average[c] = calloc(s->bins, sizeof(float));
+		s->power[c] = calloc(s->bins, sizeof(float));
+		ok = ok && s->input[c] && s->average[c] && s->power[c];
+	}
+	if (!ok) {
+		spectrum_free(s);
+		return -1;
+	}
+
+	int bits = 0;
+	while ((1 << bits) < size)
+		bits++;
+	for (int i = 0; i < size; i++) {
+		s->window[i] = 0.5f - 0.5f * cosf(2.f * PI * i / size);
+		s->window_sum += s->window[i];
+		int r = 0;
+		for (int b = 0; b < bits; b++)
+			r |= ((i >> b) & 1) << (bits - 1 - b);
+		s->bitrev[i] = r;
+	}
+
+	// Stage with butterfly span h uses twiddles h .. 2h - 1
+	for (int h = 1; h < size; h <<= 1) {
+		for (int j = 0; j < h; j++) {
+			double a = -PI * j / h;
+			s->twiddle_re[h + j] = (float)cos(a);
+			s->twiddle_im[h + j] = (float)sin(a);
+		}
+	}
+	return 0;
+}
+
+void spectrum_free(spectrum* s) {
+	free(s->window);
+	free(s->bitrev);
+	free(s->twiddle_re);
+	free(s->twiddle_im);
+	free(s->re);
+	free(s->im);
+	free(s->columns);
+	for (int c = 0; c < CH_COUNT; c++) {
+		free(s->input[c]);
+		free(s->average[c]);
+		free(s->power[c]);
+	}
+	memset(s, 0, sizeof(*s));
+}
+
+// Four floats processed together, lowered to SSE/NEON by the compiler
+typedef float v4sf __attribute__((vector_size(16)));
+
+static inline v4sf load4(const float* p) {
+	v4sf v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static inline void store4(float* p, v4sf v) {
+	memcpy(p, &v, sizeof(v));
+}
+
+// In place complex FFT of bit reversed input
+// The first two stages are fused into radix-4 butterflies that need no
+// multiplications; the remaining radix-2 stages have spans that are a
+// multiple of four and run four butterflies at a time on the split
+// real/imaginary arrays
+static void fft(int n, float* re, float* im, const float* twr, const float* twi) {
+	for (int g = 0; g < n; g += 4) {
+		float r0 = re[g] + re[g + 1], i0 = im[g] + im[g + 1];
+		float r1 = re[g] - re[g + 1], i1 = im[g] - im[g + 1];
+		float r2 = re[g + 2] + re[g + 3], i2 = im[g + 2] + im[g + 3];
+		float r3 = re[g + 2] - re[g + 3], i3 = im[g + 2] - im[g + 3];
+		re[g] = r0 + r2;
+		im[g] = i0 + i2;
+		re[g + 2] = r0 - r2;
+		im[g + 2] = i0 - i2;
+		re[g + 1] = r1 + i3;
+		im[g + 1] = i1 - r3;
+		re[g + 3] = r1 - i3;
+		im[g + 3] = i1 + r3;
+	}
+
+	for (int h = 4; h < n; h <<= 1) {
+		for (int g = 0; g < n; g += 2 * h) {
+			for (int j = 0; j < h; j += 4) {
+				int a = g + j, b = g + h + j;
+				v4sf wr = load4(twr + h + j), wi = load4(twi + h + j);
+				v4sf br = load4(re + b), bi = load4(im + b);
+				v4sf ar = load4(re + a), ai = load4(im + a);
+				v4sf tr = br * wr - bi * wi;
+				v4sf ti = br * wi + bi * wr;
+				store4(re + b, ar - tr);
+				store4(im + b, ai - ti);
+				store4(re + a, ar + tr);
+				store4(im + a, ai + ti);
+			}
+		}
+	}
+}
+
+// Map power to a spectrogram level relative to the channel reference
+static unsigned char spectrum_level(float power, float reference) {
+	float db = 10.f * log10f(power + 1e-30f);
+	float level = 255.f * (db - reference + SPECTRUM_RANGE_DB) / SPECTRUM_RANGE_DB;
+	return (unsigned char)fminf(fmaxf(level, 0.f), 255.f);
+}
+
+// Transform the last size samples of two channels (b may be -1)
+static void spectrum_pair(spectrum* s, int a, int b, float* power_a, float* power_b) {
+	const int n = s->size;
+	const unsigned long mask = n - 1;
+	const unsigned long start = s->samples & mask;
+
+	// Remove the mean so the offset of the angles doesn't leak into low bins
+	float mean_a = 0.f, mean_b = 0.f;
+	for (int i = 0; i < n; i++) {
+		mean_a += s->input[a][i];
+		mean_b += b >= 0 ? s->input[b][i] : 0.f;
+	}
+	mean_a /= n;
+	mean_b /= n;
+
+	for (int i = 0; i < n; i++) {
+		unsigned long k = (start + i) & mask;
+		int r = s->bitrev[i];
+		s->re[r] = s->window[i] * (s->input[a][k] - mean_a);
+		s->im[r] = b >= 0 ? s->window[i] * (s->input[b][k] - mean_b) : 0.f;
+	}
+	fft(n, s->re, s->im, s->twiddle_re, s->twiddle_im);
+
+	// Separate the two real spectra: A = (Z[k] + Z*[n-k]) / 2 and
+	// B = (Z[k] - Z*[n-k]) / 2i, scaled so a sinusoid of amplitude 1 reads 1
+	const float scale = 1.f / (s->window_sum * s->window_sum);
+	for (int k = 0; k < s->bins; k++) {
+		int nk = (n - k) & (int)mask;
+		float ar = s->re[k] + s->re[nk], ai = s->im[k] - s->im[nk];
+		float br = s->im[k] + s->im[nk], bi = s->re[nk] - s->re[k];
+		power_a[k] = (ar * ar + ai * ai) * scale;
+		if (b >= 0)
+			power_b[k] = (br * br + bi * bi) * scale;
+	}
+}
+
+// Transform all channels and publish a frame
+static void spectrum_frame(spectrum* s) {
+	float** power = s->power;
+	double start = clock_monotonic();
+
+	// The raw channels are skipped until the stream carries them
+	int channels = s->seen_raw ? CH_COUNT : CH_GYR_X;
+	for (int c = 0; c < channels; c += 2) {
+		int other = c + 1 < channels ? c + 1 : -1;
+		spectrum_pair(s, c, other, power[c], other >= 0 ? power[other] : NULL);
+	}
+
+	pthread_mutex_lock(&s->lock);
+	const float alpha = 1.f / SPECTRUM_AVERAGE;
+	unsigned long column = s->frames % SPECTRUM_COLUMNS;
+	for (int c = 0; c < channels; c++) {
+		float peak = 0.f;
+		for (int k = 0; k < s->bins; k++) {
+			s->average[c][k] += (power[c][k] - s->average[c][k]) * alpha;
+			peak = fmaxf(peak, power[c][k]);
+		}
+
+		// Reference follows the loudest bin up at once and decays slowly
+		float peak_db = 10.f * log10f(peak + 1e-30f);
+		if (s->frames == 0 || peak_db > s->reference[c])
+			s->reference[c] = peak_db;
+		else
+			s->reference[c] -= 0.05f;
+
+		unsigned char* levels = s->columns + ((size_t)c * SPECTRUM_COLUMNS + column) * s->bins;
+		for (int k = 0; k < s->bins; k++)
+			levels[k] = spectrum_level(power[c][k], s->reference[c]);
+	}
+	s->frames++;
+	s->frame_cost += (clock_monotonic() - start - s->frame_cost) * alpha;
+	pthread_mutex_unlock(&s->lock);
+}
+
+void spectrum_push(spectrum* s, const sample_block* b) {
+	if (s->size == 0)
+		return;
+	const unsigned long mask = s->size - 1;
+	int i = 0;
+	while (i < b->count) {
+		// Copy up to the next hop boundary, channel by channel
+		int n = b->count - i;
+		if (n > s->hop - s->since_hop)
+			n = s->hop - s->since_hop;
+		for (int c = 0; c < CH_COUNT; c++) {
+			for (int j = 0; j < n; j++)
+				s->input[c][(s->samples + j) & mask] = b->ch[c][i + j];
+		}
+		for (int j = 0; j < n; j++)
+			s->seen_raw |= b->has_raw[i + j];
+		s->samples += n;
+		s->since_hop += n;
+		i += n;
+
+		if (s->since_hop < s->hop)
+			break;
+		s->since_hop = 0;
+
+		// Sample rate from the time taken by the last hop
+		double now = b->time[i - 1];
+		if (s->hop_time > 0.0 && now > s->hop_time) {
+			double rate = s->hop / (now - s->hop_time);
+			pthread_mutex_lock(&s->lock);
+			s->rate = s->rate > 0.0 ? s->rate + (rate - s->rate) / SPECTRUM_AVERAGE : rate;
+			pthread_mutex_unlock(&s->lock);
+		}
+		s->hop_time = now;
+
+		if (s->samples >= (unsigned long)s->size)
+			spectrum_frame(s);
+	}
+}
+
+bool spectrum_has_channel(spectrum* s, int channel) {
+	pthread_mutex_lock(&s->lock);
+	bool has = channel < CH_GYR_X || s->seen_raw;
+	pthread_mutex_unlock(&s->lock);
+	return has;
+}
+
+// Colormap stops from quiet to loud
+static const Color spectrum_stops[] = {
+	{ 0, 0, 0, 255 }, { 40, 0, 120, 255 }, { 200, 30, 60, 255 }, { 255, 160, 0, 255 }, { 255, 255, 200, 255 },
+};
+
+void spectrogram_init(spectrogram* view, const spectrum* s, int channel) {
+	memset(view, 0, sizeof(*view));
+	view->channel = channel;
+	view->bins = s->bins;
+	view->levels = calloc((size_t)SPECTRUM_COLUMNS * s->bins, 1);
+	view->stale = true;
+	Image image = GenImageColor(SPECTRUM_COLUMNS, s->bins, BLACK);
+	view->texture = LoadTextureFromImage(image);
+	UnloadImage(image);
+
+	const int segments = sizeof(spectrum_stops) / sizeof(spectrum_stops[0]) - 1;
+	for (int i = 0; i < 256; i++) {
+		float t = i / 255.f * segments;
+		int k = (int)fminf(t, segments - 1);
+		float f = t - k;
+		const Color* a = &spectrum_stops[k];
+		const Color* b = &spectrum_stops[k + 1];
+		view->colormap[i] = (Color) {
+			(unsigned char)(a->r + (b->r - a->r) * f),
+			(unsigned char)(a->g + (b->g - a->g) * f),
+			(unsigned char)(a->b + (b->b - a->b) * f),
+			255,
+		};
+	}
+}
+
+void spectrogram_unload(spectrogram* view) {
+	UnloadTexture(view->texture);
+	free(view->levels);
+	view->levels = NULL;
+}
+
+void spectrogram_select(spectrogram* view, int channel) {
+	view->channel = channel;
+	view->stale = true;
+}
+
+void spectrogram_update(spectrogram* view, spectrum* s) {
+	static Color pixels[SPECTRUM_MAX_BINS];
+	if (!view->levels)
+		return;
+
+	// Copy the columns written since last time, or the whole history after
+	// a channel change or if rendering fell behind
+	pthread_mutex_lock(&s->lock);
+	memcpy(view->average, s->average[view->channel], s->bins * sizeof(float));
+	view->reference = s->reference[view->channel];
+	view->rate = s->rate;
+	view->frame_cost = s->frame_cost;
+	unsigned long first = view->frames;
+	unsigned long last = s->frames;
+	bool full = view->stale || last - first > SPECTRUM_COLUMNS;
+	const unsigned char* history = s->columns + (size_t)view->channel * SPECTRUM_COLUMNS * s->bins;
+	if (full)
+		memcpy(view->levels, history, (size_t)SPECTRUM_COLUMNS * s->bins);
+	else {
+		for (unsigned long f = first; f < last; f++) {
+			size_t offset = (f % SPECTRUM_COLUMNS) * s->bins;
+			memcpy(view->levels + offset, history + offset, s->bins);
+		}
+	}
+	view->frames = last;
+	view->stale = false;
+	pthread_mutex_unlock(&s->lock);
+
+	// Upload one column per frame, highest frequency at the top
+	if (full) {
+		first = 0;
+		last = SPECTRUM_COLUMNS;
+	}
+	for (unsigned long f = first; f < last; f++) {
+		int column = (int)(f % SPECTRUM_COLUMNS);
+		const unsigned char* levels = view->levels + (size_t)column * view->bins;
+		for (int k = 0; k < view->bins; k++)
+			pixels[view->bins - 1 - k] = view->colormap[levels[k]];
+		UpdateTextureRec(view->texture, (Rectangle) { (float)column, 0.f, 1.f, (float)view->bins }, pixels);
+	}
+}
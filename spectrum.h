@@ -0,0 +1,105 @@
+//
+// Spectrum
+// Streaming windowed FFT of every channel with a scrolling spectrogram
+//
+// Copyright (c) 2023 Jonathan Tainer. Subject to the BSD 2-Clause License.
+//
+
+#ifndef SPECTRUM_H
+#define SPECTRUM_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <raylib.h>
+#include "sample.h"
+
+// Transform length, a power of two; frames overlap by half
+#define SPECTRUM_DEFAULT_SIZE 256
+#define SPECTRUM_MIN_SIZE 64
+#define SPECTRUM_MAX_SIZE 4096
+#define SPECTRUM_MAX_BINS (SPECTRUM_MAX_SIZE / 2 + 1)
+
+// Spectrogram history in frames
+#define SPECTRUM_COLUMNS 512
+
+// Frames in the exponential average of the spectrum
+#define SPECTRUM_AVERAGE 8
+
+// Spectrogram levels span this many dB below the loudest recent bin
+#define SPECTRUM_RANGE_DB 80.f
+
+// Analysis state, fed by the modem thread
+// Channels are transformed in pairs, one as the real and one as the imaginary
+// part of a single complex FFT, and separated afterwards
+typedef struct spectrum {
+	pthread_mutex_t lock;
+	int size;
+	int bins;
+	int hop;
+
+	// Plan: Hann window, bit reversal permutation and per-stage twiddles
+	float* window;
+	float window_sum;
+	int* bitrev;
+	float* twiddle_re;
+	float* twiddle_im;
+
+	// Input rings and work buffers (modem thread only)
+	float* input[CH_COUNT];
+	float* re;
+	float* im;
+	float* power[CH_COUNT];
+	unsigned long samples;
+	int since_hop;
+	double hop_time;
+	bool seen_raw;
+
+	// Results, shared under the lock
+	// Amplitude squared of a sinusoid at each bin, in channel units
+	float* average[CH_COUNT];
+	// Spectrogram levels 0-255, [channel][column][bin]
+	unsigned char* columns;
+	float reference[CH_COUNT];
+	unsigned long frames;
+	double rate;
+	double frame_cost;	// Seconds of CPU per frame, all channels
+} spectrum;
+
+// Returns -1 if size is not a supported power of two or allocation fails
+int spectrum_init(spectrum* s, int size);
+void spectrum_free(spectrum* s);
+
+// Add samples (modem thread), transforming every hop samples
+void spectrum_push(spectrum* s, const sample_block* b);
+
+// True if the channel has carried data
+bool spectrum_has_channel(spectrum* s, int channel);
+
+// Render side copy of one channel with the spectrogram in a texture
+// New frames are uploaded a column at a time, so the texture scrolls
+// without being rebuilt
+typedef struct spectrogram {
+	int channel;
+	int bins;
+	double rate;
+	double frame_cost;
+	float average[SPECTRUM_MAX_BINS];
+	float reference;
+	Texture2D texture;
+	unsigned long frames;	// Frames uploaded, the oldest column is frames % SPECTRUM_COLUMNS
+	bool stale;		// Whole texture needs uploading
+	unsigned char* levels;	// Staging copy of the columns, uploaded outside the lock
+	Color colormap[256];
+} spectrogram;
+
+// Needs a window (GL context)
+void spectrogram_init(spectrogram* view, const spectrum* s, int channel);
+void spectrogram_unload(spectrogram* view);
+
+// Show another channel, reuploading its history
+void spectrogram_select(spectrogram* view, int channel);
+
+// Copy the average and upload frames since the last call
+void spectrogram_update(spectrogram* view, spectrum* s);
+
+#endif
@@ -0,0 +1,238 @@
+//
+// Stream statistics
+// Counts dropped, corrupt and malformed frames and tracks arrival timing
+//
+// Copyright (c) 2023 Jonathan Tainer. Subject to the BSD 2-Clause License.
+//
+
+#include "stream_stats.h"
+#include <string.h>
+#include <math.h>
+#include <stddef.h>
+
+// Sequence jumps larger than this are treated as a device restart, not loss
+#define STATS_MAX_GAP 100000
+
+void stream_stats_init(stream_stats* s, const char* name) {
+	memset(s, 0, sizeof(*s));
+	pthread_mutex_init(&s->lock, NULL);
+	s->name = name;
+}
+
+// Rotate the rolling history forward to the current second
+static stats_bucket* stream_stats_advance(stream_stats* s, double now) {
+	long second = (long)floor(now);
+	if (second > s->second) {
+		long steps = second - s->second;
+		if (steps > STATS_HISTORY_SECONDS || s->second == 0)
+			steps = STATS_HISTORY_SECONDS;
+		for (long i = 0; i < steps; i++)
+			memset(&s->buckets[(second - i) % STATS_HISTORY_SECONDS], 0, sizeof(stats_bucket));
+		s->second = second;
+	}
+	return &s->buckets[s->second % STATS_HISTORY_SECONDS];
+}
+
+static void stats_add(stats_counters* c, const stats_counters* d) {
+	c->frames += d->frames;
+	c->malformed += d->malformed;
+	c->crc_errors += d->crc_errors;
+	c->dropped += d->dropped;
+	c->read_errors += d->read_errors;
+	c->bytes += d->bytes;
+}
+
+static int stats_hist_bin(double interval) {
+	int bin = 0;
+	for (double edge = STATS_HIST_MIN * 2.0; interval >= edge && bin < STATS_HIST_BINS - 1; edge *= 2.0)
+		bin++;
+	return bin;
+}
+
+static unsigned long stream_stats_gap(stream_stats* s, const imu_frame* frame, double time) {
+	unsigned long dropped = 0;
+	if (frame->has_seq) {
+		uint32_t gap = frame->seq - s->last_seq - 1;
+		if (s->have_seq && gap > 0 && gap < STATS_MAX_GAP)
+			dropped = gap;
+		s->have_seq = true;
+		s->last_seq = frame->seq;
+	}
+	else if (frame->has_time) {
+		// Estimate the nominal period from intervals that don't look like gaps
+		double dt = time - s->last_time;
+		if (s->last_time > 0.0 && dt > 0.0) {
+			if (s->period > 0.0 && dt > 1.5 * s->period)
+				dropped = (unsigned long)lround(dt / s->period) - 1;
+			else if (s->period > 0.0)
+				s->period += (dt - s->period) * 0.05;
+			else
+				s->period = dt;
+		}
+		s->last_time = time;
+	}
+	return dropped;
+}
+
+void stream_stats_frame(stream_stats* s, frame_status status, const imu_frame* frame, double time, double arrival) {
+	pthread_mutex_lock(&s->lock);
+	stats_bucket* b = stream_stats_advance(s, arrival);
+	stats_counters d = { 0 };
+
+	switch (status) {
+	case FRAME_OK:
+		d.frames = 1;
+		d.dropped = stream_stats_gap(s, frame, time);
+		break;
+	case FRAME_MALFORMED:
+		d.malformed = 1;
+		break;
+	case FRAME_BAD_CHECKSUM:
+		d.crc_errors = 1;
+		break;
+	case FRAME_EMPTY:
+		break;
+	}
+	stats_add(&b->counts, &d);
+	stats_add(&s->total.counts, &d);
+
+	if (status == FRAME_OK) {
+		if (s->last_arrival > 0.0) {
+			double interval = arrival - s->last_arrival;
+			s->intervals++;
+			double delta = interval - s->interval_mean;
+			s->interval_mean += delta / (double)s->intervals;
+			s->interval_m2 += delta * (interval - s->interval_mean);
+			if (interval > s->interval_max)
+				s->interval_max = interval;
+			int bin = stats_hist_bin(interval);
+			b->hist[bin]++;
+			s->total.hist[bin]++;
+		}
+		s->last_arrival = arrival;
+	}
+	pthread_mutex_unlock(&s->lock);
+}
+
+void stream_stats_bytes(stream_stats* s, unsigned long bytes, double now) {
+	pthread_mutex_lock(&s->lock);
+	s->total.counts.bytes += bytes;
+	stream_stats_advance(s, now)->counts.bytes += bytes;
+	pthread_mutex_unlock(&s->lock);
+}
+
+void stream_stats_read_error(stream_stats* s, double now) {
+	pthread_mutex_lock(&s->lock);
+	s->total.counts.read_errors++;
+	stream_stats_advance(s, now)->counts.read_errors++;
+	pthread_mutex_unlock(&s->lock);
+}
+
+void stream_stats_snapshot(stream_stats* s, double now, stream_stats* out) {
+	pthread_mutex_lock(&s->lock);
+	stream_stats_advance(s, now);
+	*out = *s;
+	pthread_mutex_unlock(&s->lock);
+}
+
+void stream_stats_window(const stream_stats* s, int seconds, stats_bucket* out) {
+	memset(out, 0, sizeof(*out));
+	if (seconds > STATS_HISTORY_SECONDS - 1)
+		seconds = STATS_HISTORY_SECONDS - 1;
+	for (int i = 1; i <= seconds; i++) {
+		const stats_bucket* b = &s->buckets[(s->second - i) % STATS_HISTORY_SECONDS];
+		stats_add(&out->counts, &b->counts);
+		for (int j = 0; j < STATS_HIST_BINS; j++)
+			out->hist[j] += b->hist[j];
+	}
+}
+
+double stream_stats_jitter(const stream_stats* s) {
+	return s->intervals > 1 ? sqrt(s->interval_m2 / (double)(s->intervals - 1)) : 0.0;
+}
+
+double stream_stats_percentile(const stream_stats* s, double q) {
+	unsigned long total = 0;
+	for (int j = 0; j < STATS_HIST_BINS; j++)
+		total += s->total.hist[j];
+	if (total == 0)
+		return 0.0;
+
+	unsigned long cumulative = 0;
+	double edge = STATS_HIST_MIN * 2.0;
+	for (int j = 0; j < STATS_HIST_BINS - 1; j++, edge *= 2.0) {
+		cumulative += s->total.hist[j];
+		if (cumulative >= q * total)
+			return edge;
+	}
+	return s->interval_max;
+}
+
+void stream_stats_report(FILE* f, stream_stats* stats) {
+	stream_stats s;
+	stream_stats_snapshot(stats, 0.0, &s);
+	fprintf(f, "%s: %lu frames, %lu dropped, %lu crc errors, %lu malformed, %lu read errors\n",
+		s.name, s.total.counts.frames, s.total.counts.dropped, s.total.counts.crc_errors,
+		s.total.counts.malformed, s.total.counts.read_errors);
+	if (s.intervals == 0)
+		return;
+	fprintf(f, "  inter-arrival mean %.3f ms, jitter %.3f ms, p50 <%.3g ms, p99 <%.3g ms, max %.3f ms\n",
+		s.interval_mean * 1e3, stream_stats_jitter(&s) * 1e3, stream_stats_percentile(&s, 0.5) * 1e3,
+		stream_stats_percentile(&s, 0.99) * 1e3, s.interval_max * 1e3);
+	fprintf(f, "  histogram (ms):");
+	double edge = STATS_HIST_MIN;
+	for (int j = 0; j < STATS_HIST_BINS; j++, edge *= 2.0)
+		if (s.total.hist[j] > 0)
+			fprintf(f, " %g:%lu", edge * 1e3, s.total.hist[j]);
+	fprintf(f, "\n");
+}
+
+void stream_stats_export(FILE* f, stream_stats** streams, int count, double now) {
+	static const struct { const char* name; const char* help; size_t offset; } counters[] = {
+		{ "imu_frames_total", "Frames parsed successfully", offsetof(stats_counters, frames) },
+		{ "imu_malformed_lines_total", "Lines that failed to convert", offsetof(stats_counters, malformed) },
+		{ "imu_crc_errors_total", "Frames with a checksum mismatch", offsetof(stats_counters, crc_errors) },
+		{ "imu_dropped_frames_total", "Frames missing from the sequence", offsetof(stats_counters, dropped) },
+		{ "imu_read_errors_total", "Failed reads from the serial port", offsetof(stats_counters, read_errors) },
+		{ "imu_bytes_total", "Bytes received", offsetof(stats_counters, bytes) },
+	};
+
+	stream_stats snap[count];
+	for (int i = 0; i < count; i++)
+		stream_stats_snapshot(streams[i], now, &snap[i]);
+
+	for (size_t c = 0; c < sizeof(counters) / sizeof(counters[0]); c++) {
+		fprintf(f, "# HELP %s %s\n# TYPE %s counter\n", counters[c].name, counters[c].help, counters[c].name);
+		for (int i = 0; i < count; i++) {
+			const unsigned long* value = (const unsigned long*)((const char*)&snap[i].total.counts + counters[c].offset);
+			fprintf(f, "%s{stream=\"%s\"} %lu\n", counters[c].name, snap[i].name, *value);
+		}
+	}
+
+	fprintf(f, "# HELP imu_sample_rate_hz Frames received over the last 10 seconds per second\n");
+	fprintf(f, "# TYPE imu_sample_rate_hz gauge\n");
+	for (int i = 0; i < count; i++) {
+		stats_bucket window = { 0 };
+		stream_stats_window(&snap[i], 10, &window);
+		fprintf(f, "imu_sample_rate_hz{stream=\"%s\"} %.3f\n", snap[i].name, window.counts.frames / 10.0);
+	}
+
+	fprintf(f, "# HELP imu_interarrival_jitter_seconds Standard deviation of frame inter-arrival time\n");
+	fprintf(f, "# TYPE imu_interarrival_jitter_seconds gauge\n");
+	for (int i = 0; i < count; i++)
+		fprintf(f, "imu_interarrival_jitter_seconds{stream=\"%s\"} %.9f\n", snap[i].name, stream_stats_jitter(&snap[i]));
+
+	fprintf(f, "# HELP imu_interarrival_seconds Frame inter-arrival time\n");
+	fprintf(f, "# TYPE imu_interarrival_seconds histogram\n");
+	for (int i = 0; i < count; i++) {
+		unsigned long cumulative = 0;
+		double edge = STATS_HIST_MIN * 2.0;
+		for (int j = 0; j < STATS_HIST_BINS - 1; j++, edge *= 2.0) {
+			cumulative += snap[i].total.hist[j];
+			fprintf(f, "imu_interarrival_seconds_bucket{stream=\"%s\",le=\"%g\"} %lu\n", snap[i].name, edge, cumulative);
+		}
+		fprintf(f, "imu_interarrival_seconds_bucket{stream=\"%s\",le=\"+Inf\"} %lu\n", snap[i].name, snap[i].intervals);
+		fprintf(f, "imu_interarrival_seconds_sum{stream=\"%s\"} %.9f\n", snap[i].name, snap[i].interval_mean * snap[i].intervals);
+		fprintf(f, "imu_interarrival_seconds_count{stream=\"%s\"} %lu\n", snap[i].name, snap[i].intervals);
+	}
+}
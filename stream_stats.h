@@ -0,0 +1,89 @@
+//
+// Stream statistics
+// Counts dropped, corrupt and malformed frames and tracks arrival timing
+//
+// Copyright (c) 2023 Jonathan Tainer. Subject to the BSD 2-Clause License.
+//
+
+#ifndef STREAM_STATS_H
+#define STREAM_STATS_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include "frame.h"
+
+// Length of the rolling history in one second buckets
+#define STATS_HISTORY_SECONDS 60
+
+// Inter-arrival histogram bins, doubling from STATS_HIST_MIN seconds
+#define STATS_HIST_BINS 12
+#define STATS_HIST_MIN 0.000125
+
+typedef struct stats_counters {
+	unsigned long frames;
+	unsigned long malformed;
+	unsigned long crc_errors;
+	unsigned long dropped;
+	unsigned long read_errors;
+	unsigned long bytes;
+} stats_counters;
+
+typedef struct stats_bucket {
+	stats_counters counts;
+	unsigned long hist[STATS_HIST_BINS];
+} stats_bucket;
+
+typedef struct stream_stats {
+	pthread_mutex_t lock;
+	const char* name;
+
+	stats_bucket total;
+
+	// Rolling history, bucket i holds second (second - i) % STATS_HISTORY_SECONDS
+	stats_bucket buckets[STATS_HISTORY_SECONDS];
+	long second;
+
+	// Inter-arrival intervals of good frames (Welford)
+	double last_arrival;
+	unsigned long intervals;
+	double interval_mean;
+	double interval_m2;
+	double interval_max;
+
+	// Gap detection from sequence numbers or device timestamps
+	bool have_seq;
+	uint32_t last_seq;
+	double last_time;
+	double period;
+} stream_stats;
+
+void stream_stats_init(stream_stats* s, const char* name);
+
+// Record the outcome of parsing one line
+// time is the (synchronized) sample time, used for gap detection when the
+// frame carries no sequence number
+void stream_stats_frame(stream_stats* s, frame_status status, const imu_frame* frame, double time, double arrival);
+
+void stream_stats_bytes(stream_stats* s, unsigned long bytes, double now);
+void stream_stats_read_error(stream_stats* s, double now);
+
+// Consistent copy for display or export
+void stream_stats_snapshot(stream_stats* s, double now, stream_stats* out);
+
+// Sum of the last seconds of history, excluding the current partial second
+void stream_stats_window(const stream_stats* s, int seconds, stats_bucket* out);
+
+double stream_stats_jitter(const stream_stats* s);
+
+// Inter-arrival percentile estimated from the session histogram (upper bin edge)
+double stream_stats_percentile(const stream_stats* s, double q);
+
+// Human readable timing summary
+void stream_stats_report(FILE* f, stream_stats* s);
+
+// Write all streams in Prometheus text exposition format
+void stream_stats_export(FILE* f, stream_stats** streams, int count, double now);
+
+#endif
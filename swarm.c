@@ -0,0 +1,199 @@
+//
+// Swarm
+// Many simulated IMU bodies drawn with one instanced draw call
+//
+// Copyright (c) 2023 Jonathan Tainer. Subject to the BSD 2-Clause License.
+//
+
+#include "swarm.h"
+#include <rlgl.h>
+#include <stdlib.h>
+#include <math.h>
+
+// Frames rendered per body count and draw path in the benchmark
+#define BENCH_WARMUP 10
+#define BENCH_FRAMES 60
+
+// Transform per instance as a vertex attribute, lit by a fixed light
+static const char* swarm_vs =
+	"#version 330\n"
+	"in vec3 vertexPosition;\n"
+	"in vec3 vertexNormal;\n"
+	"in mat4 instanceTransform;\n"
+	"uniform mat4 mvp;\n"
+	"out vec3 fragNormal;\n"
+	"void main() {\n"
+	"	fragNormal = mat3(instanceTransform) * vertexNormal;\n"
+	"	gl_Position = mvp * instanceTransform * vec4(vertexPosition, 1.0);\n"
+	"}\n";
+
+static const char* swarm_fs =
+	"#version 330\n"
+	"in vec3 fragNormal;\n"
+	"uniform vec4 colDiffuse;\n"
+	"out vec4 finalColor;\n"
+	"void main() {\n"
+	"	float light = 0.6 + 0.4 * max(dot(normalize(fragNormal), normalize(vec3(-0.4, 1.0, -0.3))), 0.0);\n"
+	"	finalColor = vec4(colDiffuse.rgb * light, colDiffuse.a);\n"
+	"}\n";
+
+int swarm_init(swarm* s, int count) {
+	*s = (swarm) { 0 };
+	if (count < 1 || count > SWARM_MAX)
+		return -1;
+	s->count = count;
+	s->side = (int)ceilf(sqrtf((float)count));
+	s->instanced = true;
+	s->transforms = malloc(count * sizeof(Matrix));
+	s->visible = malloc(count * sizeof(Matrix));
+	s->phase = malloc(count * sizeof(float));
+	if (!s->transforms || !s->visible || !s->phase) {
+		free(s->transforms);
+		free(s->visible);
+		free(s->phase);
+		return -1;
+	}
+	for (int i = 0; i < count; i++)
+		s->phase[i] = (float)i * 2.399963f;	// Golden angle, evenly spread
+
+	s->model = LoadModelFromMesh(GenMeshCube(1.f, 1.f, 1.f));
+	s->mesh = s->model.meshes[0];
+	s->shader = LoadShaderFromMemory(swarm_vs, swarm_fs);
+	s->shader.locs[SHADER_LOC_MATRIX_MVP] = GetShaderLocation(s->shader, "mvp");
+	s->shader.locs[SHADER_LOC_MATRIX_MODEL] = GetShaderLocationAttrib(s->shader, "instanceTransform");
+	s->material = LoadMaterialDefault();
+	s->material.shader = s->shader;
+
+	wireframe_init(&s->wire);
+	s->single_pass = true;
+	s->edged_mesh = wireframe_mesh(s->mesh);
+	s->edged_model = LoadModelFromMesh(s->edged_mesh);
+	s->edged_model.materials[0].shader = s->wire.shader;
+	s->edged_material = LoadMaterialDefault();
+	s->edged_material.shader = s->wire.instanced;
+	return 0;
+}
+
+void swarm_update(swarm* s, Quaternion live, double time) {
+	const float half = 0.5f * (s->side - 1) * SWARM_SPACING;
+	for (int i = 0; i < s->count; i++) {
+		float p = s->phase[i];
+		Quaternion wobble = QuaternionFromEuler(0.3f * sinf((float)time + p), 0.f, 0.3f * cosf(1.3f * (float)time + p));
+		Matrix rotation = QuaternionToMatrix(QuaternionMultiply(live, wobble));
+		float x = (i % s->side) * SWARM_SPACING - half;
+		float z = (i / s->side) * SWARM_SPACING - half;
+		s->transforms[i] = MatrixMultiply(rotation, MatrixTranslate(x, 1.f, z));
+	}
+}
+
+// Bounding sphere of a unit cube
+#define BODY_RADIUS 0.866f
+
+void swarm_draw(swarm* s, const frustum* f) {
+	const Matrix* transforms = s->transforms;
+	int count = s->count;
+	if (f) {
+		count = 0;
+		for (int i = 0; i < s->count; i++) {
+			const Matrix* m = &s->transforms[i];
+			if (frustum_sphere(f, (Vector3) { m->m12, m->m13, m->m14 }, BODY_RADIUS))
+				s->visible[count++] = *m;
+		}
+		transforms = s->visible;
+	}
+	if (count == 0)
+		return;
+
+	if (s->single_pass && s->instanced) {
+		// Faces and edges from one call
+		s->edged_material.maps[MATERIAL_MAP_DIFFUSE].color = RED;
+		DrawMeshInstanced(s->edged_mesh, s->edged_material, transforms, count);
+		return;
+	}
+	if (s->single_pass) {
+		Model model = s->edged_model;
+		for (int i = 0; i < count; i++) {
+			model.transform = transforms[i];
+			DrawModel(model, Vector3Zero(), 1.f, RED);
+		}
+		return;
+	}
+	if (s->instanced) {
+		// One call for the faces and one for the edges, the transforms
+		// uploaded as a single instance buffer by each
+		MaterialMap* diffuse = &s->material.maps[MATERIAL_MAP_DIFFUSE];
+		diffuse->color = RED;
+		DrawMeshInstanced(s->mesh, s->material, transforms, count);
+		rlEnableWireMode();
+		diffuse->color = BLACK;
+		DrawMeshInstanced(s->mesh, s->material, transforms, count);
+		rlDisableWireMode();
+		return;
+	}
+	Model model = s->model;
+	for (int i = 0; i < count; i++) {
+		model.transform = transforms[i];
+		DrawModel(model, Vector3Zero(), 1.f, RED);
+		DrawModelWires(model, Vector3Zero(), 1.f, BLACK);
+	}
+}
+
+void swarm_unload(swarm* s) {
+	if (s->count == 0)
+		return;
+	UnloadMaterial(s->material);	// Also the shader
+	UnloadModel(s->model);	// Also the mesh
+	UnloadModel(s->edged_model);
+	MemFree(s->edged_material.maps);	// The shader belongs to the wireframe
+	wireframe_unload(&s->wire);
+	free(s->transforms);
+	free(s->visible);
+	free(s->phase);
+	*s = (swarm) { 0 };
+}
+
+float swarm_extent(const swarm* s) {
+	return 0.5f * s->side * SWARM_SPACING;
+}
+
+// Mean frame time in milliseconds, presenting every frame
+static double bench_frames(swarm* s, Camera camera) {
+	double total = 0.0;
+	for (int f = 0; f < BENCH_WARMUP + BENCH_FRAMES && !WindowShouldClose(); f++) {
+		double start = GetTime();
+		swarm_update(s, QuaternionIdentity(), start);
+		BeginDrawing();
+		ClearBackground(BLACK);
+		BeginMode3D(camera);
+		swarm_draw(s, NULL);
+		EndMode3D();
+		DrawText(TextFormat("%d bodies, %s, %s", s->count, s->instanced ? "instanced" : "per body",
+			s->single_pass ? "one pass" : "two passes"), 10, 10, 20, LIGHTGRAY);
+		EndDrawing();
+		if (f >= BENCH_WARMUP)
+			total += GetTime() - start;
+	}
+	return total * 1e3 / BENCH_FRAMES;
+}
+
+void swarm_benchmark(FILE* out, int max) {
+	fprintf(out, "%8s %12s %12s %12s %12s\n", "", "instanced", "instanced", "per body", "per body");
+	fprintf(out, "%8s %12s %12s %12s %12s\n", "bodies", "2-pass ms", "1-pass ms", "2-pass ms", "1-pass ms");
+	for (int count = 1; count <= max && !WindowShouldClose(); count *= 2) {
+		swarm s;
+		if (swarm_init(&s, count) != 0)
+			break;
+		float d = swarm_extent(&s) + 2.f;
+		Camera camera = { .position = { -d, d, -d }, .target = { 0.f, 0.f, 0.f }, .up = { 0.f, 1.f, 0.f },
+			.fovy = 90.f, .projection = CAMERA_PERSPECTIVE };
+		double ms[4];
+		for (int path = 0; path < 4; path++) {
+			s.instanced = path < 2;
+			s.single_pass = path % 2;
+			ms[path] = bench_frames(&s, camera);
+		}
+		fprintf(out, "%8d %12.3f %12.3f %12.3f %12.3f\n", count, ms[0], ms[1], ms[2], ms[3]);
+		fflush(out);
+		swarm_unload(&s);
+	}
+}
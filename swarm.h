@@ -0,0 +1,60 @@
+//
+// Swarm
+// Many simulated IMU bodies drawn with one instanced draw call
+//
+// Copyright (c) 2023 Jonathan Tainer. Subject to the BSD 2-Clause License.
+//
+
+#ifndef SWARM_H
+#define SWARM_H
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <raylib.h>
+#include <raymath.h>
+#include "wireframe.h"
+#include "viewport.h"
+
+#define SWARM_MAX 65536
+#define SWARM_SPACING 1.6f
+
+// Bodies on a square grid, each following the live orientation with its
+// own wobble so they can be told apart
+typedef struct swarm {
+	int count;
+	int side;	// Bodies per grid row
+	bool instanced;	// Otherwise one DrawModelEx per body, for comparison
+	bool single_pass;	// Edges from the edge shader, otherwise a wire pass
+
+	Mesh mesh;
+	Model model;	// Per-body path, sharing the mesh
+	Shader shader;
+	Material material;
+	wireframe wire;
+	Mesh edged_mesh;	// Barycentric copy of the mesh for the edge shader
+	Model edged_model;
+	Material edged_material;
+	Matrix* transforms;
+	Matrix* visible;	// Transforms left after culling, per draw
+	float* phase;
+} swarm;
+
+// Needs a window; returns -1 if count is out of range or allocation fails
+int swarm_init(swarm* s, int count);
+
+// Rebuild every transform from the live rotation
+void swarm_update(swarm* s, Quaternion live, double time);
+
+// Bodies outside the frustum are skipped, unless it is NULL
+void swarm_draw(swarm* s, const frustum* f);
+
+void swarm_unload(swarm* s);
+
+// Distance the camera needs to see the whole grid
+float swarm_extent(const swarm* s);
+
+// Frame time of all four draw paths for doubling body counts up to max,
+// rendering into the current window; prints a table
+void swarm_benchmark(FILE* out, int max);
+
+#endif
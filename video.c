@@ -0,0 +1,297 @@
+//
+// Video
+// Rendered frames read back asynchronously and written by an encoder thread
+//
+// Copyright (c) 2023 Jonathan Tainer. Subject to the BSD 2-Clause License.
+//
+
+#define GL_GLEXT_PROTOTYPES
+#include "video.h"
+#include "clock_sync.h"
+#include "realtime.h"
+#include <raylib.h>
+#include <rlgl.h>
+#include <GL/gl.h>
+#include <GL/glext.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+
+// Search PATH, as popen would
+static bool have_ffmpeg(void) {
+	const char* path = getenv("PATH");
+	if (!path)
+		return false;
+	char dir[PATH_MAX];
+	while (*path) {
+		size_t n = strcspn(path, ":");
+		snprintf(dir, sizeof(dir), "%.*s/ffmpeg", (int)n, path);
+		if (access(dir, X_OK) == 0)
+			return true;
+		path += n + (path[n] == ':');
+	}
+	return false;
+}
+
+static int open_output(video_recorder* v, const char* path) {
+	if (IsFileExtension(path, ".y4m")) {
+		v->format = VIDEO_Y4M;
+		v->out = fopen(path, "wb");
+		if (v->out)
+			fprintf(v->out, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n", v->width, v->height, v->fps);
+	}
+	else if (IsFileExtension(path, ".rgba")) {
+		v->format = VIDEO_RAW;
+		v->out = fopen(path, "wb");
+	}
+	else {
+		if (!have_ffmpeg()) {
+			printf("ffmpeg not found, record to .y4m or .rgba instead\n");
+			return -1;
+		}
+		if (strchr(path, '\'')) {
+			printf("Video path can't contain quotes: %s\n", path);
+			return -1;
+		}
+		char command[PATH_MAX + 256];
+		snprintf(command, sizeof(command), "ffmpeg -loglevel error -y -f rawvideo -pixel_format rgba "
+			"-video_size %dx%d -framerate %d -i - -pix_fmt yuv420p '%s'", v->width, v->height, v->fps, path);
+		v->format = VIDEO_PIPE;
+		// A failed encoder shows as a write error, not a signal
+		signal(SIGPIPE, SIG_IGN);
+		v->out = popen(command, "w");
+	}
+	if (!v->out) {
+		printf("Failed to open video output %s\n", path);
+		return -1;
+	}
+	return 0;
+}
+
+// Sum over four pixels of 8-bit weights, centered on 128
+static unsigned char chroma(int sum) {
+	int c = (sum + 1024 * 128 + 512) >> 10;
+	return (unsigned char)(c > 255 ? 255 : c);
+}
+
+// Full-range BT.601 with the chroma of each 2x2 block averaged, rows
+// flipped from OpenGL's bottom-up order
+static void rgba_to_i420(const unsigned char* rgba, int width, int height, unsigned char* out) {
+	unsigned char* y = out;
+	unsigned char* u = y + width * height;
+	unsigned char* v = u + (width / 2) * (height / 2);
+	for (int row = 0; row < height; row++) {
+		const unsigned char* p = rgba + (size_t)(height - 1 - row) * width * 4;
+		for (int col = 0; col < width; col++, p += 4)
+			y[row * width + col] = (unsigned char)((77 * p[0] + 150 * p[1] + 29 * p[2] + 128) >> 8);
+	}
+	for (int row = 0; row < height / 2; row++) {
+		const unsigned char* top = rgba + (size_t)(height - 1 - 2 * row) * width * 4;
+		const unsigned char* bottom = top - (size_t)width * 4;
+		for (int col = 0; col < width / 2; col++) {
+			const unsigned char* a = top + 8 * col;
+			const unsigned char* b = bottom + 8 * col;
+			int r = a[0] + a[4] + b[0] + b[4];
+			int g = a[1] + a[5] + b[1] + b[5];
+			int bl = a[2] + a[6] + b[2] + b[6];
+			u[row * (width / 2) + col] = chroma(-43 * r - 85 * g + 128 * bl);
+			v[row * (width / 2) + col] = chroma(128 * r - 107 * g - 21 * bl);
+		}
+	}
+}
+
+static bool write_frame(video_recorder* v, const unsigned char* rgba, int repeat) {
+	size_t bytes;
+	if (v->format == VIDEO_Y4M) {
+		rgba_to_i420(rgba, v->width, v->height, v->scratch);
+		bytes = (size_t)v->width * v->height * 3 / 2;
+	}
+	else {
+		const size_t stride = (size_t)v->width * 4;
+		for (int row = 0; row < v->height; row++)
+			memcpy(v->scratch + row * stride, rgba + (v->height - 1 - row) * stride, stride);
+		bytes = v->frame_bytes;
+	}
+	for (int i = 0; i < repeat; i++) {
+		if (v->format == VIDEO_Y4M && fputs("FRAME\n", v->out) == EOF)
+			return false;
+		if (fwrite(v->scratch, 1, bytes, v->out) != bytes)
+			return false;
+	}
+	return true;
+}
+
+static void* encoder_thread(void* arg) {
+	video_recorder* v = arg;
+	pthread_mutex_lock(&v->lock);
+	while (true) {
+		if (v->head == v->tail) {
+			if (v->quit)
+				break;
+			pthread_cond_wait(&v->wake, &v->lock);
+			continue;
+		}
+		int slot = v->head % VIDEO_POOL;
+		int index = v->queue[slot];
+		int repeat = v->queue_repeat[slot];
+		v->head++;
+		bool failed = v->failed;
+		pthread_mutex_unlock(&v->lock);
+
+		bool ok = failed || write_frame(v, v->buffers[index], repeat);
+
+		pthread_mutex_lock(&v->lock);
+		v->free_list[v->free_count++] = index;
+		if (!failed && ok) {
+			v->written += repeat;
+			v->duplicated += repeat - 1;
+		}
+		if (!ok)
+			v->failed = true;
+	}
+	pthread_mutex_unlock(&v->lock);
+	return NULL;
+}
+
+int video_start(video_recorder* v, const char* path, int fps) {
+	*v = (video_recorder) { 0 };
+	snprintf(v->path, sizeof(v->path), "%s", path);
+	v->fps = fps;
+	// 4:2:0 needs even dimensions; the odd row or column is left out
+	v->width = GetRenderWidth() & ~1;
+	v->height = GetRenderHeight() & ~1;
+	v->frame_bytes = (size_t)v->width * v->height * 4;
+	if (v->width == 0 || v->height == 0 || open_output(v, path) != 0)
+		return -1;
+
+	v->scratch = malloc(v->frame_bytes);
+	bool ok = v->scratch != NULL;
+	for (int i = 0; i < VIDEO_POOL; i++) {
+		v->buffers[i] = malloc(v->frame_bytes);
+		ok = ok && v->buffers[i];
+		v->free_list[v->free_count++] = i;
+	}
+	if (!ok) {
+		for (int i = 0; i < VIDEO_POOL; i++)
+			free(v->buffers[i]);
+		free(v->scratch);
+		if (v->format == VIDEO_PIPE)
+			pclose(v->out);
+		else
+			fclose(v->out);
+		printf("Out of memory for video frames\n");
+		return -1;
+	}
+
+	glGenBuffers(VIDEO_PBOS, v->pbo);
+	for (int i = 0; i < VIDEO_PBOS; i++) {
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, v->pbo[i]);
+		glBufferData(GL_PIXEL_PACK_BUFFER, v->frame_bytes, NULL, GL_STREAM_READ);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	pthread_mutex_init(&v->lock, NULL);
+	pthread_cond_init(&v->wake, NULL);
+	// Off the render CPU, if the render thread is pinned
+	rt_thread_create_elsewhere(&v->thread, encoder_thread, v);
+	v->next_due = clock_monotonic();
+	v->active = true;
+	return 0;
+}
+
+// Hand a finished read to the encoder
+static void collect(video_recorder* v, int i) {
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, v->pbo[i]);
+	const void* pixels = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, v->frame_bytes, GL_MAP_READ_BIT);
+	if (pixels) {
+		pthread_mutex_lock(&v->lock);
+		int index = v->free_count > 0 ? v->free_list[--v->free_count] : -1;
+		if (index < 0)
+			v->dropped += v->pbo_repeat[i];
+		pthread_mutex_unlock(&v->lock);
+
+		// The copy is the only work here that scales with the frame
+		if (index >= 0) {
+			memcpy(v->buffers[index], pixels, v->frame_bytes);
+			pthread_mutex_lock(&v->lock);
+			int slot = v->tail % VIDEO_POOL;
+			v->queue[slot] = index;
+			v->queue_repeat[slot] = v->pbo_repeat[i];
+			v->tail++;
+			pthread_cond_signal(&v->wake);
+			pthread_mutex_unlock(&v->lock);
+		}
+		glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+void video_frame(video_recorder* v) {
+	if (!v->active)
+		return;
+	double now = clock_monotonic();
+	if (now < v->next_due)
+		return;
+	// Slots since the last frame taken, all filled with this one
+	int repeat = 1 + (int)((now - v->next_due) * v->fps);
+	v->next_due += (double)repeat / v->fps;
+	if ((GetRenderWidth() & ~1) != v->width || (GetRenderHeight() & ~1) != v->height) {
+		pthread_mutex_lock(&v->lock);
+		v->skipped += repeat;
+		pthread_mutex_unlock(&v->lock);
+		return;
+	}
+
+	rlDrawRenderBatchActive();
+	const int i = v->issued % VIDEO_PBOS;
+	if (v->issued >= VIDEO_PBOS)
+		collect(v, i);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, v->pbo[i]);
+	glReadPixels(0, 0, v->width, v->height, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	v->pbo_repeat[i] = repeat;
+	v->issued++;
+	v->readback_time += clock_monotonic() - now;
+}
+
+void video_stop(video_recorder* v) {
+	if (!v->active)
+		return;
+	// Oldest first; these maps wait for the GPU, which is fine on the way out
+	uint64_t first = v->issued > VIDEO_PBOS ? v->issued - VIDEO_PBOS : 0;
+	for (uint64_t k = first; k < v->issued; k++)
+		collect(v, k % VIDEO_PBOS);
+	glDeleteBuffers(VIDEO_PBOS, v->pbo);
+
+	pthread_mutex_lock(&v->lock);
+	v->quit = true;
+	pthread_cond_signal(&v->wake);
+	pthread_mutex_unlock(&v->lock);
+	pthread_join(v->thread, NULL);
+	pthread_mutex_destroy(&v->lock);
+	pthread_cond_destroy(&v->wake);
+
+	int status = v->format == VIDEO_PIPE ? pclose(v->out) : fclose(v->out);
+	if (status != 0)
+		v->failed = true;
+	for (int i = 0; i < VIDEO_POOL; i++)
+		free(v->buffers[i]);
+	free(v->scratch);
+	v->active = false;
+}
+
+void video_status(video_recorder* v, char* buf, size_t len) {
+	pthread_mutex_lock(&v->lock);
+	snprintf(buf, len, "%s, %lu frames at %d fps, %lu dropped%s", v->path, v->written, v->fps, v->dropped,
+		v->failed ? ", write failed" : "");
+	pthread_mutex_unlock(&v->lock);
+}
+
+void video_report(FILE* f, video_recorder* v) {
+	fprintf(f, "Video: %s, %dx%d at %d fps, %lu frames written (%lu repeated), %lu dropped, %lu skipped after a resize%s\n",
+		v->path, v->width, v->height, v->fps, v->written, v->duplicated, v->dropped, v->skipped,
+		v->failed ? ", write failed" : "");
+	if (v->issued > 0)
+		fprintf(f, "  readback %.3f ms per frame on the render thread\n", v->readback_time * 1e3 / v->issued);
+}
@@ -0,0 +1,87 @@
+//
+// Video
+// Rendered frames read back asynchronously and written by an encoder thread
+//
+// Copyright (c) 2023 Jonathan Tainer. Subject to the BSD 2-Clause License.
+//
+
+#ifndef VIDEO_H
+#define VIDEO_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <limits.h>
+
+// Pixel buffers read into in turn; a buffer is mapped again only this many
+// frames after its read was issued, by when the copy has finished
+#define VIDEO_PBOS 3
+
+// Frames waiting for the encoder; when all are taken, frames are dropped
+// rather than holding up the render thread
+#define VIDEO_POOL 6
+
+#define VIDEO_DEFAULT_FPS 60
+
+typedef enum video_format {
+	VIDEO_Y4M,	// YUV 4:2:0, readable by most players and encoders
+	VIDEO_RAW,	// RGBA, top row first
+	VIDEO_PIPE,	// RGBA into ffmpeg, for any other extension
+} video_format;
+
+typedef struct video_recorder {
+	bool active;
+	video_format format;
+	char path[PATH_MAX];
+	FILE* out;
+	int width;
+	int height;
+	int fps;
+	size_t frame_bytes;
+
+	// Render thread only
+	unsigned int pbo[VIDEO_PBOS];
+	int pbo_repeat[VIDEO_PBOS];
+	uint64_t issued;
+	double next_due;
+	double readback_time;	// Seconds spent on the render thread
+
+	// Shared with the encoder thread
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t wake;
+	bool quit;
+	unsigned char* buffers[VIDEO_POOL];
+	int free_list[VIDEO_POOL];
+	int free_count;
+	int queue[VIDEO_POOL];
+	int queue_repeat[VIDEO_POOL];
+	int head;
+	int tail;
+	uint64_t written;
+	uint64_t duplicated;	// Written again as the renderer fell behind the frame rate
+	uint64_t dropped;	// Encoder busy
+	uint64_t skipped;	// Window resized since the start
+	bool failed;
+
+	unsigned char* scratch;	// Encoder thread
+} video_recorder;
+
+// Needs a window; records the render size at a fixed frame rate, the
+// format chosen by extension (.y4m, .rgba or anything for ffmpeg).
+// Returns -1 on failure
+int video_start(video_recorder* v, const char* path, int fps);
+
+// After everything is drawn, before EndDrawing; takes a frame when one is
+// due, repeating it for any slots the renderer missed
+void video_frame(video_recorder* v);
+
+// Collect the reads in flight, then let the encoder finish
+void video_stop(video_recorder* v);
+
+void video_status(video_recorder* v, char* buf, size_t len);
+
+void video_report(FILE* f, video_recorder* v);
+
+#endif
@@ -0,0 +1,169 @@
+//
+// Viewports
+// Split-screen orthographic and perspective views of the same scene
+//
+// Copyright (c) 2023 Jonathan Tainer. Subject to the BSD 2-Clause License.
+//
+
+#include "viewport.h"
+#include <raymath.h>
+#include <rlgl.h>
+#include <string.h>
+#include <math.h>
+
+#define CLIP_NEAR 0.01
+#define CLIP_FAR 1000.0
+
+// Radians per pixel dragged
+#define ORBIT_SPEED 0.005f
+
+static const char* layout_names[LAYOUT_COUNT] = { "single", "dual", "quad" };
+static const char* view_names[] = { "Perspective", "Front", "Side", "Top" };
+
+int layout_parse(const char* name, layout_kind* layout) {
+	for (int i = 0; i < LAYOUT_COUNT; i++) {
+		if (strcmp(name, layout_names[i]) == 0) {
+			*layout = i;
+			return 0;
+		}
+	}
+	return -1;
+}
+
+const char* layout_name(layout_kind layout) {
+	return layout_names[layout];
+}
+
+// Gribb and Hartmann: each plane is the last row of the clip transform
+// plus or minus one of the others
+static frustum frustum_from(Matrix m) {
+	const Vector4 row[4] = {
+		{ m.m0, m.m4, m.m8, m.m12 },
+		{ m.m1, m.m5, m.m9, m.m13 },
+		{ m.m2, m.m6, m.m10, m.m14 },
+		{ m.m3, m.m7, m.m11, m.m15 },
+	};
+	frustum f;
+	for (int i = 0; i < 6; i++) {
+		Vector4 r = row[i / 2];
+		float sign = i % 2 ? -1.f : 1.f;
+		Vector4 p = { row[3].x + sign * r.x, row[3].y + sign * r.y, row[3].z + sign * r.z, row[3].w + sign * r.w };
+		float length = sqrtf(p.x * p.x + p.y * p.y + p.z * p.z);
+		f.plane[i] = length > 0.f ? (Vector4) { p.x / length, p.y / length, p.z / length, p.w / length } : p;
+	}
+	return f;
+}
+
+bool frustum_sphere(const frustum* f, Vector3 c, float radius) {
+	for (int i = 0; i < 6; i++) {
+		const Vector4 p = f->plane[i];
+		if (p.x * c.x + p.y * c.y + p.z * c.z + p.w < -radius)
+			return false;
+	}
+	return true;
+}
+
+static void setup_view(viewport* v, view_kind kind, Rectangle area, const Camera* camera) {
+	v->kind = kind;
+	v->area = area;
+	const float aspect = area.height > 0.f ? area.width / area.height : 1.f;
+	const Vector3 target = camera->target;
+	const float distance = Vector3Distance(camera->position, camera->target);
+	if (kind == VIEW_PERSPECTIVE) {
+		v->view = MatrixLookAt(camera->position, target, camera->up);
+		v->projection = MatrixPerspective(DEG2RAD * camera->fovy, aspect, CLIP_NEAR, CLIP_FAR);
+	}
+	else {
+		Vector3 eye = target;
+		Vector3 up = { 0.f, 1.f, 0.f };
+		if (kind == VIEW_FRONT)
+			eye.x -= distance;
+		else if (kind == VIEW_SIDE)
+			eye.z += distance;
+		else {
+			eye.y += distance;
+			up = (Vector3) { 1.f, 0.f, 0.f };
+		}
+		const float top = VIEWPORT_ORTHO_ZOOM * distance * tanf(0.5f * DEG2RAD * camera->fovy);
+		v->view = MatrixLookAt(eye, target, up);
+		v->projection = MatrixOrtho(-top * aspect, top * aspect, -top, top, CLIP_NEAR, CLIP_FAR);
+	}
+	v->frustum = frustum_from(MatrixMultiply(v->view, v->projection));
+}
+
+int layout_viewports(layout_kind layout, const Camera* camera, viewport views[VIEWPORT_MAX]) {
+	const float w = (float)GetScreenWidth();
+	const float h = (float)GetScreenHeight();
+	switch (layout) {
+	case LAYOUT_DUAL:
+		setup_view(&views[0], VIEW_PERSPECTIVE, (Rectangle) { 0.f, 0.f, w / 2, h }, camera);
+		setup_view(&views[1], VIEW_FRONT, (Rectangle) { w / 2, 0.f, w / 2, h }, camera);
+		return 2;
+	case LAYOUT_QUAD:
+		setup_view(&views[0], VIEW_PERSPECTIVE, (Rectangle) { w / 2, h / 2, w / 2, h / 2 }, camera);
+		setup_view(&views[1], VIEW_FRONT, (Rectangle) { 0.f, 0.f, w / 2, h / 2 }, camera);
+		setup_view(&views[2], VIEW_SIDE, (Rectangle) { w / 2, 0.f, w / 2, h / 2 }, camera);
+		setup_view(&views[3], VIEW_TOP, (Rectangle) { 0.f, h / 2, w / 2, h / 2 }, camera);
+		return 4;
+	default:
+		setup_view(&views[0], VIEW_PERSPECTIVE, (Rectangle) { 0.f, 0.f, w, h }, camera);
+		return 1;
+	}
+}
+
+void viewport_orbit(Camera* camera, const viewport* views, int count) {
+	const Vector2 mouse = GetMousePosition();
+	for (int i = 0; i < count; i++) {
+		if (views[i].kind != VIEW_PERSPECTIVE || !CheckCollisionPointRec(mouse, views[i].area))
+			continue;
+		Vector3 offset = Vector3Subtract(camera->position, camera->target);
+		if (IsMouseButtonDown(MOUSE_BUTTON_LEFT)) {
+			Vector2 d = GetMouseDelta();
+			offset = Vector3RotateByAxisAngle(offset, camera->up, -d.x * ORBIT_SPEED);
+			// Stop short of the poles, where the up vector degenerates
+			Vector3 right = Vector3Normalize(Vector3CrossProduct(offset, camera->up));
+			Vector3 pitched = Vector3RotateByAxisAngle(offset, right, d.y * ORBIT_SPEED);
+			if (fabsf(Vector3DotProduct(Vector3Normalize(pitched), camera->up)) < 0.99f)
+				offset = pitched;
+		}
+		float wheel = GetMouseWheelMove();
+		if (wheel != 0.f)
+			offset = Vector3Scale(offset, powf(0.9f, wheel));
+		camera->position = Vector3Add(camera->target, offset);
+	}
+}
+
+void viewport_begin(const viewport* v) {
+	// Framebuffer pixels differ from screen coordinates on HiDPI displays
+	// and in a scaled render target
+	const float sx = (float)rlGetFramebufferWidth() / GetScreenWidth();
+	const float sy = (float)rlGetFramebufferHeight() / GetScreenHeight();
+	rlDrawRenderBatchActive();
+	rlViewport((int)(v->area.x * sx), (int)((GetScreenHeight() - v->area.y - v->area.height) * sy),
+		(int)(v->area.width * sx), (int)(v->area.height * sy));
+
+	// As BeginMode3D, with this view's matrices
+	rlMatrixMode(RL_PROJECTION);
+	rlPushMatrix();
+	rlLoadIdentity();
+	rlMultMatrixf(MatrixToFloat(v->projection));
+	rlMatrixMode(RL_MODELVIEW);
+	rlLoadIdentity();
+	rlMultMatrixf(MatrixToFloat(v->view));
+	rlEnableDepthTest();
+}
+
+void viewport_end(void) {
+	EndMode3D();
+	rlViewport(0, 0, rlGetFramebufferWidth(), rlGetFramebufferHeight());
+}
+
+void viewport_decorate(hud* h, const viewport* views, int count) {
+	if (count < 2)
+		return;
+	for (int i = 0; i < count; i++) {
+		DrawRectangleLinesEx(views[i].area, 2.f, DARKGRAY);
+		hud_text(h, view_names[views[i].kind], views[i].area.x + 10,
+			views[i].area.y + views[i].area.height - 30, 20, GRAY);
+	}
+}
@@ -0,0 +1,70 @@
+//
+// Viewports
+// Split-screen orthographic and perspective views of the same scene
+//
+// Copyright (c) 2023 Jonathan Tainer. Subject to the BSD 2-Clause License.
+//
+
+#ifndef VIEWPORT_H
+#define VIEWPORT_H
+
+#include <stdbool.h>
+#include <raylib.h>
+#include "hud.h"
+
+#define VIEWPORT_MAX 4
+
+// Orthographic views show this fraction of the perspective view's height
+// at the target, so zooming one zooms all
+#define VIEWPORT_ORTHO_ZOOM 0.5f
+
+typedef enum view_kind {
+	VIEW_PERSPECTIVE,
+	VIEW_FRONT,	// From -X, the default camera's side
+	VIEW_SIDE,	// From +Z
+	VIEW_TOP,	// From +Y, X up
+} view_kind;
+
+typedef enum layout_kind {
+	LAYOUT_SINGLE,	// Perspective only
+	LAYOUT_DUAL,	// Perspective and front side by side
+	LAYOUT_QUAD,	// Front, side and top around the perspective view
+	LAYOUT_COUNT,
+} layout_kind;
+
+// Planes as (normal, distance), normals pointing inwards
+typedef struct frustum {
+	Vector4 plane[6];
+} frustum;
+
+typedef struct viewport {
+	view_kind kind;
+	Rectangle area;	// Screen coordinates
+	Matrix view;
+	Matrix projection;
+	frustum frustum;
+} viewport;
+
+// Returns -1 for an unknown name
+int layout_parse(const char* name, layout_kind* layout);
+
+const char* layout_name(layout_kind layout);
+
+// Views of the layout over the whole window, all following the free
+// camera's target and distance; returns the number of views
+int layout_viewports(layout_kind layout, const Camera* camera, viewport views[VIEWPORT_MAX]);
+
+// Orbit the free camera by dragging in its view, zoom with the wheel
+void viewport_orbit(Camera* camera, const viewport* views, int count);
+
+// Like BeginMode3D/EndMode3D, restricted to the view's area
+void viewport_begin(const viewport* v);
+void viewport_end(void);
+
+// Frame and name of each view, in 2D after the views are drawn, the names
+// queued on the HUD
+void viewport_decorate(hud* h, const viewport* views, int count);
+
+bool frustum_sphere(const frustum* f, Vector3 center, float radius);
+
+#endif
@@ -0,0 +1,173 @@
+//
+// Wireframe
+// Solid faces with their edges in one pass, from barycentric coordinates
+//
+// Copyright (c) 2023 Jonathan Tainer. Subject to the BSD 2-Clause License.
+//
+
+#include "wireframe.h"
+#include <raymath.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Normals closer than this are taken as one face, e.g. the two triangles
+// of a quad
+#define COPLANAR_DOT 0.9999f
+
+// The barycentric coordinates come in as vertex colors; a component that
+// is 1 at all three corners never nears 0, hiding its edge
+// Edges are blended over a width measured in pixels with the derivatives
+#define WIREFRAME_VS_COMMON \
+	"in vec3 vertexPosition;\n" \
+	"in vec3 vertexNormal;\n" \
+	"in vec4 vertexColor;\n" \
+	"uniform mat4 mvp;\n" \
+	"out vec3 fragBary;\n" \
+	"out vec3 fragNormal;\n"
+
+static const char* wireframe_vs =
+	"#version 330\n"
+	WIREFRAME_VS_COMMON
+	"uniform mat4 matModel;\n"
+	"void main() {\n"
+	"	fragBary = vertexColor.rgb;\n"
+	"	fragNormal = mat3(matModel) * vertexNormal;\n"
+	"	gl_Position = mvp * vec4(vertexPosition, 1.0);\n"
+	"}\n";
+
+static const char* wireframe_instanced_vs =
+	"#version 330\n"
+	WIREFRAME_VS_COMMON
+	"in mat4 instanceTransform;\n"
+	"void main() {\n"
+	"	fragBary = vertexColor.rgb;\n"
+	"	fragNormal = mat3(instanceTransform) * vertexNormal;\n"
+	"	gl_Position = mvp * instanceTransform * vec4(vertexPosition, 1.0);\n"
+	"}\n";
+
+// Flat faces as the default shader draws them, or lit for the swarm
+static const char* wireframe_fs =
+	"#version 330\n"
+	"in vec3 fragBary;\n"
+	"in vec3 fragNormal;\n"
+	"uniform vec4 colDiffuse;\n"
+	"uniform vec4 edgeColor;\n"
+	"uniform float edgeWidth;\n"
+	"uniform float lighting;\n"
+	"out vec4 finalColor;\n"
+	"void main() {\n"
+	"	vec3 d = fwidth(fragBary);\n"
+	"	vec3 a = smoothstep(vec3(0.0), d * edgeWidth, fragBary);\n"
+	"	float edge = 1.0 - min(a.x, min(a.y, a.z));\n"
+	"	float light = mix(1.0, 0.6 + 0.4 * max(dot(normalize(fragNormal), normalize(vec3(-0.4, 1.0, -0.3))), 0.0), lighting);\n"
+	"	vec4 face = vec4(colDiffuse.rgb * light, colDiffuse.a);\n"
+	"	finalColor = mix(face, edgeColor, edge);\n"
+	"}\n";
+
+static void set_uniforms(Shader s, float lighting) {
+	const float edge[4] = { 0.f, 0.f, 0.f, 1.f };
+	const float width = WIREFRAME_WIDTH;
+	SetShaderValue(s, GetShaderLocation(s, "edgeColor"), edge, SHADER_UNIFORM_VEC4);
+	SetShaderValue(s, GetShaderLocation(s, "edgeWidth"), &width, SHADER_UNIFORM_FLOAT);
+	SetShaderValue(s, GetShaderLocation(s, "lighting"), &lighting, SHADER_UNIFORM_FLOAT);
+}
+
+void wireframe_init(wireframe* w) {
+	w->shader = LoadShaderFromMemory(wireframe_vs, wireframe_fs);
+	set_uniforms(w->shader, 0.f);
+	w->instanced = LoadShaderFromMemory(wireframe_instanced_vs, wireframe_fs);
+	w->instanced.locs[SHADER_LOC_MATRIX_MVP] = GetShaderLocation(w->instanced, "mvp");
+	w->instanced.locs[SHADER_LOC_MATRIX_MODEL] = GetShaderLocationAttrib(w->instanced, "instanceTransform");
+	set_uniforms(w->instanced, 1.f);
+}
+
+void wireframe_unload(wireframe* w) {
+	UnloadShader(w->shader);
+	UnloadShader(w->instanced);
+}
+
+// Edge of a triangle with its endpoints in a canonical order, so the two
+// triangles sharing it sort next to each other
+typedef struct edge_key {
+	float a[3];
+	float b[3];
+	int triangle;
+	int corner;	// Opposite vertex, whose coordinate the edge is
+} edge_key;
+
+static int compare_edges(const void* x, const void* y) {
+	const edge_key* p = x;
+	const edge_key* q = y;
+	return memcmp(p->a, q->a, sizeof(p->a) + sizeof(p->b));
+}
+
+static bool position_less(const float* p, const float* q) {
+	return memcmp(p, q, 3 * sizeof(float)) < 0;
+}
+
+Mesh wireframe_mesh(Mesh src) {
+	const int triangles = src.indices ? src.triangleCount : src.vertexCount / 3;
+	const int vertices = 3 * triangles;
+	Mesh m = { 0 };
+	m.vertexCount = vertices;
+	m.triangleCount = triangles;
+	m.vertices = MemAlloc(vertices * 3 * sizeof(float));
+	m.normals = MemAlloc(vertices * 3 * sizeof(float));
+	m.colors = MemAlloc(vertices * 4);
+
+	// Unshare the vertices, each corner needs its own coordinate
+	for (int v = 0; v < vertices; v++) {
+		int k = src.indices ? src.indices[v] : v;
+		memcpy(&m.vertices[3 * v], &src.vertices[3 * k], 3 * sizeof(float));
+		if (src.normals)
+			memcpy(&m.normals[3 * v], &src.normals[3 * k], 3 * sizeof(float));
+		unsigned char* c = &m.colors[4 * v];
+		c[0] = v % 3 == 0 ? 255 : 0;
+		c[1] = v % 3 == 1 ? 255 : 0;
+		c[2] = v % 3 == 2 ? 255 : 0;
+		c[3] = 255;
+	}
+
+	Vector3* normal = MemAlloc(triangles * sizeof(Vector3));
+	edge_key* edges = MemAlloc(vertices * sizeof(edge_key));
+	for (int t = 0; t < triangles; t++) {
+		const float* p[3];
+		for (int k = 0; k < 3; k++)
+			p[k] = &m.vertices[3 * (3 * t + k)];
+		Vector3 u = { p[1][0] - p[0][0], p[1][1] - p[0][1], p[1][2] - p[0][2] };
+		Vector3 w = { p[2][0] - p[0][0], p[2][1] - p[0][1], p[2][2] - p[0][2] };
+		normal[t] = Vector3Normalize(Vector3CrossProduct(u, w));
+		for (int k = 0; k < 3; k++) {
+			const float* a = p[(k + 1) % 3];
+			const float* b = p[(k + 2) % 3];
+			edge_key* e = &edges[3 * t + k];
+			if (position_less(b, a)) {
+				const float* swap = a;
+				a = b;
+				b = swap;
+			}
+			memcpy(e->a, a, sizeof(e->a));
+			memcpy(e->b, b, sizeof(e->b));
+			e->triangle = t;
+			e->corner = k;
+		}
+	}
+
+	// Hide an edge shared by coplanar triangles in both of them
+	qsort(edges, vertices, sizeof(edge_key), compare_edges);
+	for (int i = 0; i + 1 < vertices; i++) {
+		edge_key* e = &edges[i];
+		edge_key* f = &edges[i + 1];
+		if (compare_edges(e, f) != 0 || Vector3DotProduct(normal[e->triangle], normal[f->triangle]) < COPLANAR_DOT)
+			continue;
+		for (int k = 0; k < 3; k++) {
+			m.colors[4 * (3 * e->triangle + k) + e->corner] = 255;
+			m.colors[4 * (3 * f->triangle + k) + f->corner] = 255;
+		}
+	}
+	MemFree(edges);
+	MemFree(normal);
+
+	UploadMesh(&m, false);
+	return m;
+}
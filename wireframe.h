@@ -0,0 +1,32 @@
+//
+// Wireframe
+// Solid faces with their edges in one pass, from barycentric coordinates
+//
+// Copyright (c) 2023 Jonathan Tainer. Subject to the BSD 2-Clause License.
+//
+
+#ifndef WIREFRAME_H
+#define WIREFRAME_H
+
+#include <stdbool.h>
+#include <raylib.h>
+
+// Edge width in pixels
+#define WIREFRAME_WIDTH 1.5f
+
+typedef struct wireframe {
+	Shader shader;	// Transform from the model matrix
+	Shader instanced;	// Transform per instance
+} wireframe;
+
+// Needs a window
+void wireframe_init(wireframe* w);
+
+void wireframe_unload(wireframe* w);
+
+// Copy of a mesh with unshared vertices carrying barycentric coordinates
+// in their colors, edges between coplanar triangles hidden; uploaded
+// The source mesh is not modified
+Mesh wireframe_mesh(Mesh src);
+
+#endif